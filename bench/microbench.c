@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime, fmemopen, open_memstream */
+
+/* Local includes */
+#include "../header/symbols.h"
+#include "../header/opcode.h"
+#include "../header/word.h"
+#include "../header/validators.h"
+#include "../header/preprocessing.h"
+
+/* Standard includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define BENCH_SAMPLES 15             /* Timed samples per benchmark */
+#define BENCH_MIN_SAMPLE_NS 5000000.0 /* Iterations are doubled until a sample takes this long */
+#define BENCH_MAX_ITERATIONS (1UL << 30) /* Bound of the calibration */
+#define BENCH_LABELS 256             /* Labels in the symbol table benchmarks */
+#define BENCH_MACROS 8               /* Macros defined by the preprocessor benchmark */
+#define BENCH_MACRO_CALLS 64         /* Macro calls in the preprocessor benchmark */
+
+/**
+ * @brief A benchmark: runs its operation `iterations` times.
+ *
+ * @param iterations Number of times to run the operation.
+ * @return Number of operations performed (several per iteration for batched benchmarks).
+ */
+typedef unsigned long (*BenchFunction)(unsigned long iterations);
+
+/**
+ * @brief A benchmark and the unit of its operations.
+ */
+typedef struct {
+    const char *name;          /* Name reported in the results */
+    BenchFunction run;         /* The benchmark */
+} Bench;
+
+/**
+ * @brief Summary of the samples of a benchmark, in nanoseconds per operation.
+ */
+typedef struct {
+    unsigned long iterations;  /* Iterations per sample */
+    unsigned long operations;  /* Operations per sample */
+    double min;                /* Fastest sample */
+    double median;             /* Median sample */
+    double mean;               /* Mean of the samples */
+    double stddev;             /* Standard deviation of the samples */
+    double max;                /* Slowest sample */
+} BenchResult;
+
+static volatile unsigned long bench_sink; /* Results are folded here, so the work is not optimized away */
+
+static SymbolList *bench_symbols = NULL; /* Table of BENCH_LABELS labels */
+static SymbolIndex bench_index; /* Index of bench_symbols */
+static char bench_labels[BENCH_LABELS][16]; /* Labels of bench_symbols */
+static FILE *bench_null = NULL; /* Output of the writing benchmarks */
+static char *bench_source = NULL; /* Source of the preprocessor benchmark */
+static size_t bench_source_size = 0; /* Size of bench_source */
+static unsigned long bench_source_lines = 0; /* Lines of bench_source */
+
+/**
+ * @brief Returns a monotonic time.
+ *
+ * @return The time, in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec time; /* The time */
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+/**
+ * @brief Builds and frees a table of BENCH_LABELS labels, one operation per label.
+ */
+static unsigned long bench_add_symbol_number(unsigned long iterations) {
+    SymbolList *symbols; /* Table being built */
+    unsigned long i; /* Iteration loop variable */
+    int j; /* Label loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        symbols = NULL;
+        for (j = 0; j < BENCH_LABELS; j++) {
+            add_symbol_number(&symbols, bench_labels[j], (int16_t)j, SYMBOL_INSTRUCTION);
+        }
+        bench_sink += symbols->value.number;
+        free_symbol_list(symbols);
+    }
+
+    return iterations * BENCH_LABELS;
+}
+
+/**
+ * @brief Finds every label of the table in turn.
+ */
+static unsigned long bench_get_symbol_by_label(unsigned long iterations) {
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += get_symbol_by_label(bench_symbols, bench_labels[i % BENCH_LABELS])->value.number;
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Looks a missing label up, walking the whole table.
+ */
+static unsigned long bench_get_symbol_by_label_miss(unsigned long iterations) {
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += get_symbol_by_label(bench_symbols, "MISSING") == NULL;
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Finds every label of the table in turn, through its hashed index.
+ */
+static unsigned long bench_symbol_index_find(unsigned long iterations) {
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += symbol_index_find(&bench_index, bench_labels[i % BENCH_LABELS])->value.number;
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Looks command names up, including names that are not commands.
+ */
+static unsigned long bench_is_command(unsigned long iterations) {
+    static char *names[] = { "mov", "cmp", "jsr", "stop", "mcro", "MAIN:" }; /* First, middle and last commands, then misses */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += is_command(names[i % (sizeof(names) / sizeof(names[0]))]);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Encodes and frees an instruction word.
+ */
+static unsigned long bench_create_word(unsigned long iterations) {
+    Word *word; /* Word created */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        word = create_word((uint8_t)(i & 15), 1, 3, 3, (uint8_t)(i & 7), 2, 1, 0, 0);
+        bench_sink += word->word;
+        free_word(word);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Encodes and frees an operand word.
+ */
+static unsigned long bench_create_word_from_number(unsigned long iterations) {
+    Word *word; /* Word created */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        word = create_word_from_number((int16_t)(i & 0x3FFF) - 0x2000, 0, 1, 0);
+        bench_sink += word->word;
+        free_word(word);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Validates register operands.
+ */
+static unsigned long bench_is_valid_reg(unsigned long iterations) {
+    static char *args[] = { "r0", "r7", "r8", "LOOP" }; /* Valid, out of bounds and not a register */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += is_valid_reg(args[i & 3]);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Validates immediate operands.
+ */
+static unsigned long bench_is_valid_immediate_number(unsigned long iterations) {
+    static char *args[] = { "#5", "#-1024", "#+77", "#abc" }; /* Valid values, then an invalid one */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += is_valid_immediate_number(args[i & 3]);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Validates .data values.
+ */
+static unsigned long bench_is_valid_number(unsigned long iterations) {
+    static char *args[] = { "7", "-123", " +45 ", "12a" }; /* Valid values, then an invalid one */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        bench_sink += is_valid_number(args[i & 3]);
+    }
+
+    return iterations;
+}
+
+/**
+ * @brief Defines and expands macros, one operation per source line.
+ */
+static unsigned long bench_preprocess(unsigned long iterations) {
+    SymbolList *macros; /* Macros defined by the source */
+    FILE *source; /* The source, read from memory */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        source = fmemopen(bench_source, bench_source_size, "r");
+        if (!source) {
+            perror("Error reading benchmark source");
+            exit(EXIT_FAILURE);
+        }
+
+        macros = NULL;
+        preprocess(source, bench_null, &macros, NULL);
+        bench_sink += macros != NULL;
+        free_symbol_list(macros);
+        fclose(source);
+    }
+
+    return iterations * bench_source_lines;
+}
+
+/**
+ * @brief Prints words in the .ob format.
+ */
+static unsigned long bench_print_word_hex(unsigned long iterations) {
+    Word word; /* Word printed */
+    uint16_t line = 100; /* Address of the word */
+    unsigned long i; /* Loop variable */
+
+    for (i = 0; i < iterations; i++) {
+        word.word = (uint32_t)(i * 2654435761UL) & 0xFFFFFF;
+        print_word_hex(&word, &line, bench_null);
+    }
+
+    bench_sink += line;
+    return iterations;
+}
+
+/**
+ * @brief Builds the inputs shared by the benchmarks.
+ */
+static void setup(void) {
+    FILE *source; /* Stream writing bench_source */
+    int i; /* Loop variable */
+
+    for (i = 0; i < BENCH_LABELS; i++) {
+        sprintf(bench_labels[i], "LABEL%d", i);
+        add_symbol_number(&bench_symbols, bench_labels[i], (int16_t)i, SYMBOL_INSTRUCTION);
+    }
+    symbol_index_init(&bench_index, bench_symbols);
+
+    bench_null = fopen("/dev/null", "w");
+    source = open_memstream(&bench_source, &bench_source_size);
+    if (!bench_null || !source) {
+        perror("Error opening benchmark streams");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Macro definitions, then plain lines calling them */
+    for (i = 0; i < BENCH_MACROS; i++) {
+        fprintf(source, "mcro m%d\n    mov r%d, r%d\n    add #%d, r1\nmcroend\n", i, i % 8, (i + 1) % 8, i);
+        bench_source_lines += 4;
+    }
+    for (i = 0; i < BENCH_MACRO_CALLS; i++) {
+        fprintf(source, "L%d: inc r2\nm%d\n", i, i % BENCH_MACROS);
+        bench_source_lines += 2;
+    }
+    fclose(source);
+}
+
+/**
+ * @brief Frees the inputs shared by the benchmarks.
+ */
+static void teardown(void) {
+    symbol_index_free(&bench_index);
+    free_symbol_list(bench_symbols);
+    fclose(bench_null);
+    free(bench_source);
+}
+
+/**
+ * @brief Orders sample times.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Calibrates a benchmark, then times its samples.
+ *
+ * @param bench The benchmark.
+ * @param result Output for the summary.
+ */
+static void run_bench(const Bench *bench, BenchResult *result) {
+    double samples[BENCH_SAMPLES]; /* Nanoseconds per operation of every sample */
+    unsigned long iterations = 1; /* Iterations per sample */
+    unsigned long operations; /* Operations of a sample */
+    double start; /* Start of a sample */
+    double elapsed; /* Duration of a sample */
+    double sum = 0; /* Sum of the samples */
+    double squares = 0; /* Sum of the squared deviations */
+    int i; /* Loop variable */
+
+    /* Double the iterations until a sample is long enough to time reliably (this also warms up) */
+    while (1) {
+        start = now_ns();
+        operations = bench->run(iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= BENCH_MIN_SAMPLE_NS || iterations >= BENCH_MAX_ITERATIONS) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    for (i = 0; i < BENCH_SAMPLES; i++) {
+        start = now_ns();
+        operations = bench->run(iterations);
+        samples[i] = (now_ns() - start) / (double)operations;
+        sum += samples[i];
+    }
+
+    result->iterations = iterations;
+    result->operations = operations;
+    result->mean = sum / BENCH_SAMPLES;
+    for (i = 0; i < BENCH_SAMPLES; i++) {
+        squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+    }
+    result->stddev = sqrt(squares / (BENCH_SAMPLES - 1));
+
+    qsort(samples, BENCH_SAMPLES, sizeof(double), compare_doubles);
+    result->min = samples[0];
+    result->median = samples[BENCH_SAMPLES / 2];
+    result->max = samples[BENCH_SAMPLES - 1];
+}
+
+/**
+ * @brief Runs every benchmark, printing a table and writing the results as JSON.
+ *
+ * Usage: microbench [RESULTS.json]
+ *
+ * The JSON results (stdout when no path is given) hold, per benchmark, the
+ * iterations and operations of a sample, and the min/median/mean/stddev/max
+ * of the samples in nanoseconds per operation.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the results could not be written.
+ */
+int main(int argc, char *argv[]) {
+    static const Bench benches[] = {
+        { "add_symbol_number", bench_add_symbol_number },
+        { "get_symbol_by_label", bench_get_symbol_by_label },
+        { "get_symbol_by_label_miss", bench_get_symbol_by_label_miss },
+        { "symbol_index_find", bench_symbol_index_find },
+        { "is_command", bench_is_command },
+        { "create_word", bench_create_word },
+        { "create_word_from_number", bench_create_word_from_number },
+        { "is_valid_reg", bench_is_valid_reg },
+        { "is_valid_immediate_number", bench_is_valid_immediate_number },
+        { "is_valid_number", bench_is_valid_number },
+        { "preprocess", bench_preprocess },
+        { "print_word_hex", bench_print_word_hex }
+    };
+    BenchResult results[sizeof(benches) / sizeof(benches[0])]; /* Summary of every benchmark */
+    int count = sizeof(benches) / sizeof(benches[0]); /* Number of benchmarks */
+    FILE *json = stdout; /* Output of the JSON results */
+    FILE *table = stdout; /* Output of the table */
+    int i; /* Loop variable */
+
+    if (argc > 1) {
+        json = fopen(argv[1], "w");
+        if (!json) {
+            fprintf(stderr, "Error opening results file for writing: %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    } else {
+        table = stderr; /* stdout carries the JSON results */
+    }
+
+    setup();
+    fprintf(table, "%-28s %12s %10s %10s %10s %10s\n", "Benchmark", "Ops/sample", "Min ns", "Median ns", "Mean ns", "Stddev");
+    for (i = 0; i < count; i++) {
+        run_bench(&benches[i], &results[i]);
+        fprintf(table, "%-28s %12lu %10.2f %10.2f %10.2f %10.2f\n", benches[i].name, results[i].operations,
+                results[i].min, results[i].median, results[i].mean, results[i].stddev);
+    }
+    teardown();
+
+    fprintf(json, "{\"samples\":%d,\"labels\":%d,\"preprocess_lines\":%lu,\"results\":[",
+            BENCH_SAMPLES, BENCH_LABELS, bench_source_lines);
+    for (i = 0; i < count; i++) {
+        fprintf(json, "%s\n{\"name\":\"%s\",\"iterations\":%lu,\"operations\":%lu,\"unit\":\"ns/op\","
+                "\"min\":%.3f,\"median\":%.3f,\"mean\":%.3f,\"stddev\":%.3f,\"max\":%.3f}",
+                i > 0 ? "," : "", benches[i].name, results[i].iterations, results[i].operations,
+                results[i].min, results[i].median, results[i].mean, results[i].stddev, results[i].max);
+    }
+    fprintf(json, "\n]}\n");
+
+    if (json != stdout && fclose(json) != 0) {
+        perror("Error writing results");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
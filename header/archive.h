@@ -0,0 +1,66 @@
+/**
+ * @file archive.h
+ * @brief Header file for object archives (--archive).
+ *
+ * An archive packs assembled modules (the .ob, .ent and .ext outputs of an
+ * input) into a single NAME.lib file, with a hashed index from every entry
+ * symbol to the module declaring it. A consumer hashes the symbol, probes the
+ * index, then reads the module with a single seek, without opening the others.
+ *
+ * Layout of the .lib file (every number little-endian):
+ * - Header, ARCHIVE_HEADER_SIZE bytes: magic "ARC1", member count (u32),
+ *   index slot count (u32, a power of two), size of the string table (u32).
+ * - Members, ARCHIVE_MEMBER_SIZE bytes each, in command-line order: name
+ *   offset in the string table (u32), offset of the member's data in the file
+ *   (u32), sizes of its .ob, .ent and .ext files (u32 each).
+ * - Index, ARCHIVE_SLOT_SIZE bytes per slot: hash of the symbol (u32), name
+ *   offset in the string table (u32), member (u32, ARCHIVE_EMPTY_SLOT for a
+ *   free slot), address of the symbol (u32).
+ * - String table: the member and symbol names, each followed by a null terminator.
+ * - Member data: the .ob, .ent and .ext files of every member, back to back.
+ *
+ * Looking a symbol up: start at slot `archive_hash(name) & (slots - 1)` and
+ * move to the next slot (wrapping around) until a free slot, or a slot with
+ * the same hash and name. The index is at most half full, so probes are short.
+ */
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./options.h"
+
+#define ARCHIVE_MAGIC "ARC1"               /* First bytes of a .lib file */
+#define ARCHIVE_HEADER_SIZE 16             /* Size of the header, in bytes */
+#define ARCHIVE_MEMBER_SIZE 20             /* Size of a member record, in bytes */
+#define ARCHIVE_SLOT_SIZE 16               /* Size of an index slot, in bytes */
+#define ARCHIVE_EMPTY_SLOT 0xFFFFFFFFUL    /* Member of a free index slot */
+#define ARCHIVE_MIN_SLOTS 8                /* Smallest index */
+
+/**
+ * @brief Hashes a symbol name for the archive index (32-bit FNV-1a).
+ *
+ * @param name The symbol name.
+ * @return The hash.
+ */
+uint32_t archive_hash(const char *name);
+
+/**
+ * @brief Packs assembled modules into an archive.
+ *
+ * The modules' outputs are read from the output directory, and the archive is
+ * written there as NAME.lib. Assembling a module (or restoring it from the
+ * cache) removes the .ent or .ext file it no longer produces, so only the
+ * outputs of the latest assembly are packed. Entry symbols declared by several modules are
+ * indexed to the first one, with a warning.
+ *
+ * @param name Base name of the archive.
+ * @param modules Base names of the modules, in order.
+ * @param count Number of modules.
+ * @param options Modes selected on the command line (output directory).
+ * @return true if the archive was written, false otherwise.
+ */
+bool write_archive(const char *name, char **modules, int count, const AssemblerOptions *options);
+
+#endif /* ARCHIVE_H */
@@ -18,11 +18,18 @@
 
 #include <stdio.h>
 
+#include "./options.h"
+
 /* General Constants */
+#define ASSEMBLER_VERSION "1.0"      /* Version of the assembler, part of every cache key (--cache) */
 #define BUFFER_SIZE 81               /* Buffer size for reading lines from input files */
 #define MACRO_SIZE (BUFFER_SIZE * 7) /* Maximum size allowed for macro contents */
 #define NUM_REGISTERS 8              /* Number of registers available in the assembler (e.g., r0 to r7) */
-#define START_LINE 100               /* Starting line number for the memory image (.ob file) */
+#define MAX_ADDRESS 0x7FFF           /* Highest address of the image, as labels hold signed 16-bit addresses */
+#define MAX_LOAD_ADDRESS 0x7000        /* Highest load address (the first pass checks the whole image fits below MAX_ADDRESS) */
+#define MAX_SPACE_SIZE 0x1000        /* Largest .space reservation, in words */
+#define MAX_INCBIN_SIZE (MAX_SPACE_SIZE * 3L) /* Largest .incbin range, in bytes (3 bytes per word) */
+#define START_LINE 100               /* Default load address of the memory image (.ob file), see --load-address */
 
 /* Addressing Modes */
 #define IMMEDIATE_ADRS 0          /* Immediate addressing (e.g., #5) */
@@ -36,7 +43,10 @@
  * @param file Input source file to be assembled.
  * @param am Preprocessed file after macro expansion.
  * @param base_name Base name for the output files (e.g., .ob, .ent, .ext).
+ * @param options Modes selected on the command line.
+ * @return true if the file assembled without errors and its outputs were written
+ *         (with --check, if it has no errors, as nothing is written).
  */
-void assemble(FILE* file, FILE* am, char* base_name);
+bool assemble(FILE* file, FILE* am, char* base_name, const AssemblerOptions* options);
 
 #endif
\ No newline at end of file
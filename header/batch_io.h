@@ -0,0 +1,105 @@
+/**
+ * @file batch_io.h
+ * @brief Header file for batched, asynchronous file I/O across many input files.
+ *
+ * When many files are assembled in one run, a pool of I/O threads keeps the
+ * storage busy while the assembler works:
+ * - Upcoming inputs are read into memory ahead of time (a few per I/O thread),
+ *   and handed to the assembler as in-memory streams.
+ * - Outputs (.am, .ob, .ent, .ext and flat images) are built in memory, then
+ *   queued to a writer thread that creates, writes and closes the files in
+ *   batches, in the order they were queued. Stale outputs are removed through
+ *   the same queue, so the operations on a path keep their order.
+ *
+ * Every input is still assembled on the main thread, in command-line order.
+ */
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "./lib.h"
+
+#define BATCH_IO_WINDOW 2 /* Inputs prefetched ahead of the assembler, per I/O thread */
+
+/**
+ * @brief An input file read ahead of time.
+ */
+typedef struct {
+    char *path;      /* Path of the input, or NULL if it could not be built */
+    char *buffer;    /* Contents of the input, or NULL if it could not be read */
+    size_t size;     /* Size of `buffer` */
+    int error;       /* errno of the failed read */
+    bool ready;      /* true once the read finished */
+} PrefetchSlot;
+
+/**
+ * @brief An output file waiting to be written, or removed.
+ */
+typedef struct WriteJob {
+    char *path;              /* Path of the output file */
+    char *buffer;            /* Contents of the output */
+    size_t size;             /* Size of `buffer` */
+    bool remove;             /* true to remove the file rather than write it */
+    struct WriteJob *next;   /* Next queued output */
+} WriteJob;
+
+/**
+ * @brief Starts the I/O threads and begins prefetching the inputs.
+ *
+ * @param threads The number of prefetching threads.
+ * @param paths The paths of the inputs, in the order they will be assembled (NULL entries fail to open).
+ * @param count The number of inputs.
+ * @param if_changed true to only replace the output files whose contents changed (--write-if-changed).
+ * @return true if batched I/O is active, false if the threads could not be started.
+ */
+bool batch_io_start(int threads, char **paths, int count, bool if_changed);
+
+/**
+ * @brief Tells whether batched I/O is active.
+ *
+ * @return true between a successful `batch_io_start` and `batch_io_finish`.
+ */
+bool batch_io_active(void);
+
+/**
+ * @brief Opens the next input, waiting for its prefetch if needed.
+ *
+ * Must be called once per input, in order.
+ *
+ * @return A stream over the input's contents, or NULL (with errno set) if it could not be read.
+ */
+FILE* batch_io_next_input(void);
+
+/**
+ * @brief Closes an input opened by `batch_io_next_input` and frees its contents.
+ *
+ * @param file The stream to close.
+ */
+void batch_io_close_input(FILE *file);
+
+/**
+ * @brief Queues an output file to be written by the writer thread.
+ *
+ * @param path Path of the output file (ownership is taken).
+ * @param buffer Contents of the output (ownership is taken).
+ * @param size Size of `buffer`.
+ */
+void batch_io_write(char *path, char *buffer, size_t size);
+
+/**
+ * @brief Queues the removal of an output file, after the outputs already queued.
+ *
+ * @param path Path of the output file (ownership is taken).
+ */
+void batch_io_remove(char *path);
+
+/**
+ * @brief Writes every queued output and stops the I/O threads.
+ *
+ * @return false if an output could not be written, true otherwise.
+ */
+bool batch_io_finish(void);
+
+#endif /* BATCH_IO_H */
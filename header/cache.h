@@ -0,0 +1,109 @@
+/**
+ * @file cache.h
+ * @brief Header file for the content-addressed output cache (--cache DIR).
+ *
+ * Every successful assembly stores its outputs (.am, .ob, .ent, .ext and flat
+ * images) in the cache directory, under a key computed from everything the
+ * outputs depend on. When a later input has the same key, `process_file`
+ * restores the outputs from the cache instead of assembling it.
+ *
+ * Key Features:
+ * - The key is a 64-bit FNV-1a hash of the assembler version (the version
+ *   string and, when readable, the assembler's own executable), the options
+ *   that change the outputs, the checksum of the macro snapshot (--macros),
+ *   the source bytes and the bytes of every file it includes. The base name is only part of the key with a flat image, since
+ *   S-records embed it.
+ * - Each entry is a directory named by the key in hexadecimal, holding one
+ *   file per output, named by its extension. Entries are built in a temporary
+ *   directory and renamed into place, so a partial entry is never used.
+ * - Outputs are stored and restored as hard links when possible, and copied
+ *   otherwise. Outputs are always replaced rather than rewritten in place, so
+ *   a hard link never lets a later run modify a cache entry. A restored
+ *   output is given the time of the restore as its modification time (shared
+ *   with the entry's file when linked), so make-style builds see it change.
+ * - The cache is bounded in size: once it grows past the bound, the least
+ *   recently used entries are evicted.
+ * - Hits, misses, stores and evictions are counted and reported at the end of
+ *   the run.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "./lib.h"
+#include "./options.h"
+
+#define CACHE_KEY_SIZE 17        /* Hexadecimal key, with its terminator */
+
+/**
+ * @brief An entry of the cache.
+ */
+typedef struct CacheEntry {
+    char key[CACHE_KEY_SIZE];  /* Key of the entry, also its directory name */
+    long size;                 /* Total size of the entry's outputs, in bytes */
+    time_t used;               /* Last time the entry was stored or restored */
+    struct CacheEntry *next;   /* Next entry */
+} CacheEntry;
+
+/**
+ * @brief Opens the cache, creating its directory if needed.
+ *
+ * @param dir The cache directory.
+ * @param max_kib The bound of the cache, in KiB.
+ * @return true if the cache is usable, false otherwise (the run goes on uncached).
+ */
+bool cache_open(const char *dir, long max_kib);
+
+/**
+ * @brief Tells whether the cache is open.
+ *
+ * @return true between a successful `cache_open` and `cache_close`.
+ */
+bool cache_active(void);
+
+/**
+ * @brief Looks an input up, restoring its outputs on a hit.
+ *
+ * On a miss, the outputs written until `cache_commit` are recorded under the
+ * input's key.
+ *
+ * @param source The input's source bytes.
+ * @param size The size of `source`.
+ * @param base_name The base name of the input.
+ * @param options Modes selected on the command line.
+ * @return true if the outputs were restored, false if the input must be assembled.
+ */
+bool cache_lookup(const char *source, size_t size, const char *base_name,
+                  const AssemblerOptions *options);
+
+/**
+ * @brief Records an output of the input being assembled.
+ *
+ * Does nothing unless `cache_lookup` missed for the current input.
+ *
+ * @param extension The extension of the output (e.g., "ob").
+ * @param path The output file, or NULL if the output is given by `buffer`.
+ * @param buffer The contents of the output, when `path` is NULL.
+ * @param size The size of `buffer`.
+ */
+void cache_record(const char *extension, const char *path, const char *buffer, size_t size);
+
+/**
+ * @brief Ends the assembly of the current input.
+ *
+ * Stores the recorded outputs if the assembly succeeded (its .ob output was
+ * recorded), discards them otherwise, then evicts entries past the bound.
+ */
+void cache_commit(void);
+
+/**
+ * @brief Reports the cache counters and closes the cache.
+ *
+ * @param log The stream to report to.
+ */
+void cache_close(FILE *log);
+
+#endif /* CACHE_H */
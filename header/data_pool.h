@@ -0,0 +1,134 @@
+/**
+ * @file data_pool.h
+ * @brief Header file for pooling duplicate data blocks.
+ *
+ * Every `.data` or `.string` directive produces a block of data words. When
+ * pooling is enabled, the blocks are grouped in regions: a region starts at a
+ * labelled data directive and runs up to the next one (or the end of the
+ * data), so it holds everything its label may address. Each region is hashed
+ * and stored once: a labelled region identical to an earlier one is not
+ * emitted again, and its label is pointed at the earlier copy instead.
+ *
+ * Key Features:
+ * - Parses directive operands into the exact values `second_pass` emits.
+ * - Interns regions in a hash table keyed by their contents.
+ * - Records which directives were merged, so `second_pass` can skip them.
+ * - Tracks the number of merged blocks and saved words for reporting.
+ *
+ * Only labelled regions are merged: the data before the first label has no
+ * name to point elsewhere. A region reserving words (`.space`, `.incbin`) is
+ * never merged nor shared, since the pool does not know their contents.
+ */
+#ifndef DATA_POOL_H
+#define DATA_POOL_H
+
+#include <stdint.h>
+
+#include "./lib.h"
+
+#define POOL_BUCKETS 64 /* Number of buckets in the pool's hash table */
+#define WORD_BYTES 3    /* Size of a 24-bit machine word in bytes */
+
+/**
+ * @brief A data block stored in the pool.
+ */
+typedef struct DataBlock {
+    uint32_t hash;            /* Hash of the block's values */
+    int length;               /* Number of words in the block */
+    int16_t *values;          /* The block's values */
+    int16_t offset;           /* Data counter offset of the stored copy */
+    struct DataBlock *next;   /* Next block in the same bucket */
+} DataBlock;
+
+/**
+ * @brief Hash table of data blocks, plus the merge decision of every directive.
+ */
+typedef struct {
+    DataBlock *buckets[POOL_BUCKETS]; /* Blocks, chained by hash */
+    bool *merged;                     /* merged[k] is true if the k-th directive was merged */
+    int capacity;                     /* Allocated size of `merged` */
+    int directives;                   /* Number of directives interned so far */
+    int merged_blocks;                /* Number of regions merged into an earlier copy */
+    int merged_words;                 /* Number of data words saved by merging */
+    int16_t *region;                  /* Values of the open region */
+    int region_length;                /* Number of values in the open region */
+    int region_capacity;              /* Allocated size of `region` */
+    int region_first;                 /* Ordinal of the open region's first directive */
+    int region_directives;            /* Number of directives in the open region */
+    int16_t region_dc;                /* Data counter at the open region's start */
+    bool region_open;                 /* Whether a region is open */
+    bool region_labelled;             /* Whether the open region starts with a label */
+    bool region_opaque;               /* Whether the open region reserves words */
+} DataPool;
+
+/**
+ * @brief Creates an empty data pool.
+ *
+ * @return Pointer to the new pool.
+ */
+DataPool* create_data_pool(void);
+
+/**
+ * @brief Parses the operands of a `.data` or `.string` directive.
+ *
+ * Produces the same values `second_pass` would emit for the directive.
+ * Malformed operands are left for `second_pass` to report.
+ *
+ * @param directive The directive name (".data" or ".string").
+ * @param metadata The rest of the line after the directive.
+ * @param values Output array for the block's values.
+ * @param max_values Capacity of `values`.
+ * @return The number of values in the block.
+ */
+int parse_data_block(const char *directive, char *metadata, int16_t *values, int max_values);
+
+/**
+ * @brief Adds the block of the next `.data` or `.string` directive to the open region.
+ *
+ * @param pool The data pool.
+ * @param values The block's values.
+ * @param length The number of values in the block.
+ * @param dc The data counter at the directive.
+ * @param labelled Whether the directive carries a label (and starts a region, once the open one ended).
+ */
+void pool_add_block(DataPool *pool, const int16_t *values, int length,
+                    int16_t dc, bool labelled);
+
+/**
+ * @brief Adds a `.space` or `.incbin` directive to the open region, which is then never merged.
+ *
+ * @param pool The data pool.
+ * @param dc The data counter at the directive.
+ * @param labelled Whether the directive carries a label (and starts a region, once the open one ended).
+ */
+void pool_add_reservation(DataPool *pool, int16_t dc, bool labelled);
+
+/**
+ * @brief Ends the open region, merging it into an identical earlier copy or storing it.
+ *
+ * Must be called before a labelled data directive is added, and after the last one.
+ *
+ * @param pool The data pool.
+ * @param offset Output for the data counter offset of the region's stored copy.
+ * @param length Output for the number of words of the region.
+ * @return true if the region was merged and must not be counted, false otherwise.
+ */
+bool pool_end_region(DataPool *pool, int16_t *offset, int *length);
+
+/**
+ * @brief Checks whether a data directive was merged into an earlier copy.
+ *
+ * @param pool The data pool, or NULL when pooling is disabled.
+ * @param ordinal The index of the directive among all data directives.
+ * @return true if the directive must not be emitted, false otherwise.
+ */
+bool pool_is_merged(DataPool *pool, int ordinal);
+
+/**
+ * @brief Frees all memory used by the pool.
+ *
+ * @param pool The pool to free.
+ */
+void free_data_pool(DataPool *pool);
+
+#endif /* DATA_POOL_H */
@@ -14,8 +14,12 @@
 #ifndef ERRORS_H
 #define ERRORS_H
 
+#include <stdio.h>
 #include <stdint.h>
 
+#include "./lib.h"
+#include "./line_map.h"
+
 /**
  * @brief Enum for error codes used throughout the assembler.
  * 
@@ -52,7 +56,15 @@ enum {
     CONFLICTING_ENTRY_AND_EXTERN,   /* Extern and entry cannot have the same name */
     MACRO_ALREADY_DEFINED,          /* Macro with that name already exists */
     MACRO_NAME_IS_COMMAND,          /* Macro name conflicts with a command */
-    LABEL_IS_MACRO_NAME             /* Label name conflicts with a macro name */
+    LABEL_IS_MACRO_NAME,            /* Label name conflicts with a macro name */
+
+    INVALID_INCLUDE,                /* Invalid .include, expected a quoted file name */
+    INCLUDE_NOT_FOUND,              /* Included file cannot be read */
+
+    INVALID_SPACE_SIZE,             /* Invalid size in .space declaration */
+    INVALID_INCBIN,                 /* Invalid .incbin, or a range outside the file */
+    IMAGE_TOO_LARGE,                /* Instructions and data do not fit below MAX_ADDRESS */
+    TOO_MANY_INCBINS                /* More than MAX_BINARIES .incbin ranges held at once */
 };
 
 /**
@@ -62,7 +74,7 @@ enum {
  * @param line The line number where the error occurred.
  * @param errors_counter Pointer to the error counter to increment.
  */
-void error_with_code(int code, uint8_t line, uint8_t *errors_counter);
+void error_with_code(int code, uint32_t line, uint8_t *errors_counter);
 
 /**
  * @brief Outputs an error message corresponding to the given error code.
@@ -73,4 +85,51 @@ void error_with_code(int code, uint8_t line, uint8_t *errors_counter);
  */
 void error_with_code_only(int code);
 
+/**
+ * @brief Sets the stream error messages are printed to.
+ * 
+ * Error messages go to stdout by default. Streaming mode moves them to stderr,
+ * as stdout then carries the object image.
+ * 
+ * @param stream The stream to print error messages to.
+ */
+void set_error_stream(FILE *stream);
+
+/**
+ * @brief Sets the stream error messages of the calling thread are printed to.
+ * 
+ * Overrides the stream of `set_error_stream` for the calling thread only, so
+ * that concurrent assemblies (e.g., server requests) keep their messages apart.
+ * 
+ * @param stream The stream, or NULL to use the stream of `set_error_stream` again.
+ */
+void set_thread_error_stream(FILE *stream);
+
+/**
+ * @brief Silences or restores error messages of the calling thread.
+ * 
+ * Errors are still counted while muted. Used when a result may be discarded,
+ * such as the pipeline's symbol collection, which runs before macros are known.
+ * 
+ * @param muted true to silence error messages, false to print them again.
+ */
+void mute_errors(bool muted);
+
+/**
+ * @brief Prints the error messages as JSON lines, for editors (--check).
+ * 
+ * Each message becomes a single line:
+ * 
+ *     {"file":"NAME","line":12,"am_line":14,"origin":"MACRO","code":12,"message":"..."}
+ * 
+ * where `line` is the line of the input (the call site for expanded lines),
+ * `am_line` the line of the preprocessed source, `origin` the macro or included
+ * file the line was expanded from (null otherwise), and `code` the error code.
+ * Both lines are null for messages without a line.
+ * 
+ * @param file Name of the input, or NULL to print plain messages again.
+ * @param sources Origins of the preprocessed lines, or NULL to report them as input lines.
+ */
+void set_error_json(const char *file, const SourceMap *sources);
+
 #endif /* ERRORS_H */
\ No newline at end of file
@@ -19,6 +19,8 @@
 #include <stdint.h>
 
 #include "./symbols.h"
+#include "./data_pool.h"
+#include "./options.h"
 
 /**
  * @brief Performs the first pass of the assembler.
@@ -32,9 +34,12 @@
  * @param errors Pointer to the error counter to track the number of errors.
  * @param number_of_lines Pointer to the variable to store the number of lines in the input file.
  * @param macros Pointer to the linked list of macros.
+ * @param pool Data pool for merging duplicate data blocks, or NULL when pooling is disabled.
+ * @param options Modes selected on the command line (load address).
  */
 void first_pass(FILE* file, SymbolList** symbols_ptr, 
                 uint8_t* errors, uint8_t* number_of_lines,
-                SymbolList* macros);
+                SymbolList* macros, DataPool* pool,
+                const AssemblerOptions* options);
 
 #endif /* FIRST_PASS_H */
\ No newline at end of file
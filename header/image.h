@@ -0,0 +1,98 @@
+/**
+ * @file image.h
+ * @brief Header file for exporting the memory image in flat formats.
+ *
+ * Besides the text .ob file, the linked code+data image can be written as a flat
+ * image ready for flashing. Every 24-bit word takes 3 bytes, most significant byte
+ * first, so the word at address N sits at byte address N * 3.
+ *
+ * Key Features:
+ * - Raw binary (.bin): the packed bytes only.
+ * - Intel HEX (.hex): 16-byte data records, with extended linear address records
+ *   whenever the upper 16 bits of the byte address change.
+ * - Motorola S-record (.srec): S0 header, S1/S2/S3 data records sized to the image's
+ *   last address, an S5 record count and the matching S9/S8/S7 terminator.
+ * - All formats share a buffered writer, so large images take few write calls.
+ */
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdio.h>
+
+#include "./word.h"
+
+#define IMAGE_BUFFER_SIZE 4096  /* Size of the buffered writer's buffer */
+#define IMAGE_RECORD_SIZE 16    /* Data bytes per Intel HEX / S-record record */
+
+/**
+ * @brief Flat image formats.
+ */
+typedef enum {
+    IMAGE_NONE,    /* No flat image */
+    IMAGE_BINARY,  /* Raw binary */
+    IMAGE_IHEX,    /* Intel HEX */
+    IMAGE_SREC     /* Motorola S-record */
+} ImageFormat;
+
+/**
+ * @brief Buffered writer shared by all image formats.
+ */
+typedef struct {
+    FILE *file;                                /* Destination file */
+    unsigned char buffer[IMAGE_BUFFER_SIZE];   /* Pending bytes */
+    size_t used;                               /* Number of pending bytes */
+} BufferedWriter;
+
+/**
+ * @brief State of an image being written.
+ */
+typedef struct {
+    ImageFormat format;                          /* Format being written */
+    BufferedWriter writer;                       /* Buffered output */
+    unsigned long address;                       /* Byte address of the next byte */
+    unsigned long start;                         /* Byte address of the first byte */
+    unsigned char record[IMAGE_RECORD_SIZE];     /* Bytes of the pending data record */
+    int record_length;                           /* Number of bytes in the pending record */
+    unsigned long record_address;                /* Byte address of the pending record */
+    unsigned long upper;                         /* Current Intel HEX upper address */
+    int address_bytes;                           /* S-record address width (2, 3 or 4) */
+    unsigned long records;                       /* Number of S-record data records */
+} ImageWriter;
+
+/**
+ * @brief Parses an image format name ("bin", "ihex" or "srec").
+ *
+ * @param name The format name.
+ * @return The matching format, or IMAGE_NONE if the name is unknown.
+ */
+ImageFormat parse_image_format(const char *name);
+
+/**
+ * @brief Starts writing an image.
+ *
+ * @param image The image state to initialize.
+ * @param format The format to write.
+ * @param file The destination file.
+ * @param load_address Address of the first word.
+ * @param words Total number of words in the image.
+ * @param name Name stored in the S-record header.
+ */
+void image_begin(ImageWriter *image, ImageFormat format, FILE *file,
+                 unsigned long load_address, unsigned long words, const char *name);
+
+/**
+ * @brief Appends the next word of the image.
+ *
+ * @param image The image being written.
+ * @param inst The word to append.
+ */
+void image_put_word(ImageWriter *image, Word *inst);
+
+/**
+ * @brief Finishes the image, writing pending records and the terminator.
+ *
+ * @param image The image being written.
+ */
+void image_end(ImageWriter *image);
+
+#endif /* IMAGE_H */
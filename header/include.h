@@ -0,0 +1,170 @@
+/**
+ * @file include.h
+ * @brief Header file for the files brought in by the `.include "file"` and
+ * `.incbin "file"[, offset, length]` directives.
+ *
+ * Included files are shared by every input of a run, so each one is read
+ * into memory and preprocessed once, the first time it is included, and the
+ * result is reused by every later `.include` of it. Files embedded by `.incbin`
+ * are read the same way, and their bytes are used in place, never parsed.
+ * A long-running server calls `include_refresh` before every request, so an
+ * included file changed on disk is read again.
+ *
+ * Key Features:
+ * - Names are resolved against the inputs directory ("../inputs/NAME").
+ * - An included file is expanded on its own: it sees the macros it defines and
+ *   those of the files it includes, but not those of the including file.
+ * - The expanded text of a file excludes its own `.include` lines, which are
+ *   kept as splice points, so include guards still apply to nested includes.
+ * - A file is spliced at most once per input (include guards), which also
+ *   breaks include cycles.
+ * - Inputs may be preprocessed on several threads at once (server mode): the
+ *   list of files and the preprocessing of a new file are guarded by a lock,
+ *   and a file is only read without it once its state is INCLUDE_PARSED.
+ */
+#ifndef INCLUDE_H
+#define INCLUDE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "./lib.h"
+#include "./symbols.h"
+
+#define INCLUDE_PATH_FORMAT "../inputs/%s" /* Path of an included file, from its name */
+#define INCLUDE_NAME_SIZE 128              /* Longest included file name, with its terminator */
+#define INCLUDE_DIRECTIVE ".include"       /* The include directive */
+#define INCBIN_DIRECTIVE ".incbin"         /* The binary include directive */
+
+/**
+ * @brief Preprocessing state of an included file.
+ */
+typedef enum {
+    INCLUDE_NEW,      /* Read, not preprocessed yet */
+    INCLUDE_PARSING,  /* Being preprocessed (an include cycle reaches it again) */
+    INCLUDE_PARSED    /* Preprocessed, ready to be spliced */
+} IncludeState;
+
+struct IncludeUnit;
+
+/**
+ * @brief A nested include, spliced into the expanded text of a file.
+ */
+typedef struct IncludeSplice {
+    size_t offset;                 /* Offset in the expanded text where the file is spliced */
+    struct IncludeUnit *unit;      /* The included file */
+    struct IncludeSplice *next;    /* Next splice, by offset */
+} IncludeSplice;
+
+/**
+ * @brief An included file, shared by the whole run.
+ */
+typedef struct IncludeUnit {
+    char *name;                    /* Name given to `.include` */
+    char *data;                    /* Contents, NULL if the file cannot be read */
+    size_t size;                   /* Size of `data` */
+    struct stat status;            /* Status of the file when it was read */
+    IncludeState state;            /* Preprocessing state */
+    char *text;                    /* Expanded text, without nested includes */
+    size_t text_size;              /* Size of `text` */
+    IncludeSplice *splices;        /* Nested includes, by offset */
+    IncludeSplice *last_splice;    /* Last of `splices` */
+    SymbolList *macros;            /* Macros visible at the end of the file */
+    struct IncludeUnit *next;      /* Next file of the run */
+} IncludeUnit;
+
+/**
+ * @brief A list of included files, used as include guards.
+ */
+typedef struct IncludeList {
+    IncludeUnit *unit;             /* An included file */
+    struct IncludeList *next;      /* Next file */
+} IncludeList;
+
+/**
+ * @brief Takes the lock guarding included files (recursive).
+ */
+void include_lock(void);
+
+/**
+ * @brief Releases the lock taken by `include_lock`.
+ */
+void include_unlock(void);
+
+/**
+ * @brief Returns an included file, reading it on first use.
+ *
+ * @param name The name given to `.include`.
+ * @return The file. Its `data` is NULL if it cannot be read.
+ */
+IncludeUnit* include_load(const char *name);
+
+/**
+ * @brief Drops every included file if one of them changed on disk since it was read.
+ *
+ * Later lookups read and preprocess the files again. The dropped files stay
+ * allocated until `include_free_all`, since a request being assembled on
+ * another thread may still use them.
+ */
+void include_refresh(void);
+
+/**
+ * @brief Parses the argument of an `.include` directive.
+ *
+ * @param args The rest of the line, after the directive.
+ * @param name Output for the file name, INCLUDE_NAME_SIZE bytes.
+ * @return true if the argument is a single quoted file name, false otherwise.
+ */
+bool include_parse_name(const char *args, char *name);
+
+/**
+ * @brief Resolves the argument of an `.incbin` directive to bytes of an included file.
+ *
+ * The argument is a quoted file name, optionally followed by `, offset, length`
+ * selecting a range of the file (the whole file by default).
+ *
+ * @param args The rest of the line, after the directive.
+ * @param bytes Output for the first byte of the range.
+ * @param size Output for the size of the range, 1 to MAX_INCBIN_SIZE bytes.
+ * @param error Output for the error code, when the directive is rejected.
+ * @return true if the range is valid, false otherwise.
+ */
+bool include_binary(const char *args, const unsigned char **bytes, size_t *size, int *error);
+
+/**
+ * @brief Adds a file to a list of included files, unless it is already there.
+ *
+ * @param list The list.
+ * @param unit The file.
+ * @return true if the file was added, false if it was already included.
+ */
+bool include_guard(IncludeList **list, IncludeUnit *unit);
+
+/**
+ * @brief Frees a list of included files (not the files).
+ *
+ * @param list The list.
+ */
+void include_free_list(IncludeList *list);
+
+/**
+ * @brief Calls a function on every file a source includes, directly or not, once each.
+ *
+ * Only reads the `.include` and `.incbin` lines of the raw sources, without
+ * preprocessing. Used to make the output cache depend on included content.
+ *
+ * @param source The source.
+ * @param size The size of the source.
+ * @param visit The function, given each included file and `arg`.
+ * @param arg Argument passed to `visit`.
+ */
+void include_visit(const char *source, size_t size,
+                   void (*visit)(IncludeUnit *unit, void *arg), void *arg);
+
+/**
+ * @brief Frees every included file of the run.
+ */
+void include_free_all(void);
+
+#endif /* INCLUDE_H */
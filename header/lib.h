@@ -10,11 +10,16 @@
  * - Defines a `bool` type for better readability and compatibility.
  * - Provides utility functions for:
  *   - Skipping leading spaces in strings.
- *   - Duplicating strings with dynamic memory allocation.
+ *   - Duplicating strings with dynamic memory allocation (optionally counted by --mem-stats).
+ *   - Reading whole streams into memory.
  */
 #ifndef LIB_H
 #define LIB_H
 
+#include <stdio.h>
+
+#include "./mem_stats.h"
+
 /**
  * @brief Boolean type definition.
  * 
@@ -43,4 +48,26 @@ void skip_leading_spaces(char **line);
  */
 char *strdup(const char *s);
 
+/**
+ * @brief Duplicates a string, counting it under a memory category.
+ * 
+ * Release it with `mem_track_free(category, strlen(copy) + 1)` before freeing it.
+ * 
+ * @param s The string to duplicate.
+ * @param category The category the copy is counted under.
+ * @return A pointer to the newly allocated copy of the string, or NULL if allocation fails.
+ */
+char *strdup_tracked(const char *s, MemCategory category);
+
+/**
+ * @brief Reads the rest of a stream into memory.
+ * 
+ * The contents are null-terminated. The caller is responsible for freeing them.
+ * 
+ * @param file The stream to read.
+ * @param size Output for the number of bytes read (excluding the terminator).
+ * @return A pointer to the contents, or NULL if allocation fails.
+ */
+char *read_stream(FILE *file, size_t *size);
+
 #endif /* LIB_H */
\ No newline at end of file
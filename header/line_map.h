@@ -0,0 +1,128 @@
+/**
+ * @file line_map.h
+ * @brief Header file for the address-to-source line table (--line-map).
+ *
+ * Emulator traces and crash addresses are mapped back to the source with a .map
+ * file, written next to the .ob file. Every row starts a run of words coming
+ * from the same line, and the run lasts until the address of the next row:
+ *
+ *     ADDRESS AM_LINE SOURCE_LINE ORIGIN
+ *
+ * - ADDRESS: address of the run's first word, padded to 7 digits like the .ob file.
+ * - AM_LINE: line of the preprocessed (.am) source that produced the words.
+ * - SOURCE_LINE: line of the input (.as) source, the call site for expanded lines.
+ * - ORIGIN: the macro or included file the line was expanded from, "-" otherwise.
+ *
+ * Rows are sorted by address, so a reader finds the row of an address with a
+ * binary search.
+ *
+ * Key Features:
+ * - The preprocessor records where every .am line comes from in a `SourceMap`,
+ *   run-length encoded: a run of plain lines, or all the lines of an expansion,
+ *   take a single segment, found again by binary search.
+ * - The second pass only marks, in the word lists, the .am line of the words
+ *   that follow (`add_line`), so the table costs nothing unless requested.
+ */
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./lib.h"
+
+/**
+ * @brief A run of .am lines coming from the same place of the input.
+ *
+ * Plain lines advance together (.am line `am_line + k` is source line
+ * `source_line + k`), while expanded lines all map to their call site.
+ */
+typedef struct {
+    uint32_t am_line;          /* First .am line of the segment */
+    uint32_t source_line;      /* Source line of the first .am line */
+    const char *origin;        /* Macro or included file expanded, NULL for plain lines */
+} SourceSegment;
+
+/**
+ * @brief Where every line of a preprocessed source comes from.
+ */
+typedef struct {
+    SourceSegment *segments;   /* Segments, by .am line */
+    size_t count;              /* Number of segments */
+    size_t capacity;           /* Allocated segments */
+    uint32_t am_lines;         /* Number of .am lines recorded */
+} SourceMap;
+
+/**
+ * @brief State of a .map file being written.
+ */
+typedef struct {
+    FILE *stream;              /* The .map output */
+    const SourceMap *sources;  /* Origins of the .am lines */
+    uint32_t line;             /* .am line of the words being written, 0 if unknown */
+    uint32_t row_line;         /* .am line of the last row written, 0 before the first */
+} LineMapWriter;
+
+/**
+ * @brief Initializes an empty source map.
+ *
+ * @param map The map.
+ */
+void source_map_init(SourceMap *map);
+
+/**
+ * @brief Records the origin of the next .am lines.
+ *
+ * @param map The map.
+ * @param source_line Line of the input the lines come from.
+ * @param origin Macro or included file they were expanded from, NULL for a plain line.
+ *               Must outlive the map.
+ * @param am_lines Number of .am lines written for the input line.
+ */
+void source_map_add(SourceMap *map, uint32_t source_line, const char *origin, uint32_t am_lines);
+
+/**
+ * @brief Finds where a .am line comes from, in O(log n).
+ *
+ * @param map The map.
+ * @param am_line The .am line, counted from 1.
+ * @param source_line Output for the source line, 0 if unknown.
+ * @param origin Output for the macro or included file, NULL for a plain line.
+ */
+void source_map_lookup(const SourceMap *map, uint32_t am_line,
+                       uint32_t *source_line, const char **origin);
+
+/**
+ * @brief Frees the segments of a source map.
+ *
+ * @param map The map.
+ */
+void source_map_free(SourceMap *map);
+
+/**
+ * @brief Starts writing a .map file.
+ *
+ * @param writer The writer.
+ * @param stream The .map output.
+ * @param sources Origins of the .am lines.
+ */
+void line_map_begin(LineMapWriter *writer, FILE *stream, const SourceMap *sources);
+
+/**
+ * @brief Sets the .am line of the words written next.
+ *
+ * @param writer The writer.
+ * @param line The .am line, from a line marker of the word lists.
+ */
+void line_map_set_line(LineMapWriter *writer, uint32_t line);
+
+/**
+ * @brief Accounts for a word written to the .ob file, starting a row if its line changed.
+ *
+ * @param writer The writer.
+ * @param address Address of the word.
+ */
+void line_map_put(LineMapWriter *writer, uint16_t address);
+
+#endif /* LINE_MAP_H */
@@ -0,0 +1,87 @@
+/**
+ * @file macro_snapshot.h
+ * @brief Header file for precompiled macro libraries (--compile-macros, --macros).
+ *
+ * A macro library is a set of sources whose `mcro` definitions every input
+ * shares. `--compile-macros FILE` preprocesses it once and writes its macros
+ * to a binary snapshot; `--macros FILE` maps the snapshot at startup, so the
+ * inputs expand its macros without parsing them again.
+ *
+ * Snapshot layout (every number is a little-endian 32-bit word):
+ * - Header: magic "MSN1", number of macros, number of slots, size of the
+ *   strings, and the checksum (FNV-1a) of everything after the header.
+ * - Macros: offsets of the name and the body in the strings, size of the
+ *   body, and its number of lines.
+ * - Slots: hash index of the names (`hash_label`, linear probing), each slot
+ *   holding the hash of a name and its macro, or MACRO_SNAPSHOT_EMPTY.
+ * - Strings: the names and bodies, each ending with '\0'.
+ *
+ * The macros of a snapshot were validated when it was compiled: their names
+ * are not commands and are defined once, with a single body. A snapshot is
+ * checked when loaded (bounds and checksum), then read in place, so it may be
+ * shared by the threads of a run (--server) without locking.
+ *
+ * An input may not define a macro of the loaded snapshot again, nor use one of
+ * its names as a label.
+ */
+#ifndef MACRO_SNAPSHOT_H
+#define MACRO_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./lib.h"
+#include "./symbols.h"
+
+#define MACRO_SNAPSHOT_MAGIC "MSN1"        /* First bytes of a snapshot */
+#define MACRO_SNAPSHOT_EMPTY 0xFFFFFFFFUL  /* Macro of a free slot */
+
+/**
+ * @brief A macro of the loaded snapshot.
+ */
+typedef struct {
+    const char *name;          /* Name of the macro, in the mapped snapshot */
+    const char *body;          /* Expanded lines, each ending with '\n' */
+    uint32_t size;             /* Size of `body` */
+    uint32_t lines;            /* Number of lines of `body` */
+} SnapshotMacro;
+
+/**
+ * @brief Writes a list of macros to a snapshot file.
+ *
+ * @param path Path of the snapshot.
+ * @param macros The macros, with unique names.
+ * @return true on success, false if the file could not be written.
+ */
+bool macro_snapshot_write(const char *path, SymbolList *macros);
+
+/**
+ * @brief Maps a snapshot, whose macros are then expanded in every input.
+ *
+ * @param path Path of the snapshot.
+ * @return true on success, false if the file cannot be read or is not a valid snapshot.
+ */
+bool macro_snapshot_load(const char *path);
+
+/**
+ * @brief Finds a macro of the loaded snapshot.
+ *
+ * @param name Name of the macro.
+ * @param macro Output for the macro, or NULL when only its existence matters.
+ * @return true if the snapshot defines the macro, false otherwise (or if none is loaded).
+ */
+bool macro_snapshot_find(const char *name, SnapshotMacro *macro);
+
+/**
+ * @brief Returns the checksum of the loaded snapshot, which identifies its macros.
+ *
+ * @return The checksum, or 0 if no snapshot is loaded.
+ */
+uint32_t macro_snapshot_checksum(void);
+
+/**
+ * @brief Unmaps the loaded snapshot, if any.
+ */
+void macro_snapshot_unload(void);
+
+#endif /* MACRO_SNAPSHOT_H */
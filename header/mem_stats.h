@@ -0,0 +1,76 @@
+/**
+ * @file mem_stats.h
+ * @brief Header file for memory accounting (--mem-stats).
+ *
+ * Allocation sites of the assembler's data structures report to per-category
+ * counters: number of allocations, live bytes and peak live bytes. Counting is
+ * off unless enabled, and counters are updated atomically, since the passes may
+ * run on several threads.
+ *
+ * Counters are reported per phase: allocations and peaks restart at the
+ * beginning of every phase, while live bytes carry over.
+ */
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * @brief Categories of tracked allocations.
+ */
+typedef enum {
+    MEM_WORDS,          /* Machine words */
+    MEM_LIST_NODES,     /* Word list nodes */
+    MEM_SYMBOL_NODES,   /* Symbol and macro list nodes */
+    MEM_LABELS,         /* Label strings of symbols and macros */
+    MEM_MACRO_BODIES,   /* Macro bodies */
+    MEM_CATEGORIES      /* Number of categories */
+} MemCategory;
+
+/**
+ * @brief Counters of one category.
+ */
+typedef struct {
+    long allocations;   /* Allocations made during the current phase */
+    long live_bytes;    /* Bytes currently allocated */
+    long peak_bytes;    /* Most bytes allocated at once during the current phase */
+} MemCounter;
+
+/**
+ * @brief Turns memory accounting on.
+ */
+void mem_stats_enable(void);
+
+/**
+ * @brief Records an allocation.
+ *
+ * @param category The category of the allocation.
+ * @param size The size of the allocation in bytes.
+ */
+void mem_track_alloc(MemCategory category, size_t size);
+
+/**
+ * @brief Records a release.
+ *
+ * @param category The category of the released allocation.
+ * @param size The size of the released allocation in bytes.
+ */
+void mem_track_free(MemCategory category, size_t size);
+
+/**
+ * @brief Starts a new phase: allocation counts restart, peaks restart from the live bytes.
+ */
+void mem_stats_begin_phase(void);
+
+/**
+ * @brief Prints the counters of the current phase, then starts a new phase.
+ *
+ * Does nothing unless memory accounting is on.
+ *
+ * @param log The stream to print to.
+ * @param phase The name of the phase that ended.
+ */
+void mem_stats_report(FILE *log, const char *phase);
+
+#endif /* MEM_STATS_H */
@@ -0,0 +1,89 @@
+/**
+ * @file options.h
+ * @brief Header file for the assembler's command-line options.
+ *
+ * This file defines the `AssemblerOptions` structure, which carries every
+ * opt-in mode selected on the command line down to `assemble` and the passes.
+ *
+ * Key Features:
+ * - Defines the `AssemblerOptions` structure and its defaults.
+ * - Provides a parser for `--flag` style command-line arguments.
+ */
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./image.h"
+
+#define MAX_JOBS 64 /* Maximum number of threads or worker processes */
+#define CACHE_DEFAULT_SIZE 65536L /* Default bound of the cache (--cache-size), in KiB */
+#define MAX_CACHE_SIZE 2097151L   /* Largest cache bound, in KiB (its size in bytes fits a long) */
+#define DEFAULT_SERVER_THREADS 4  /* Default number of server workers (--server-threads) */
+
+/**
+ * @brief Structure holding the modes selected on the command line.
+ */
+typedef struct {
+    bool pool_data;      /* --pool-data: store identical .data/.string blocks once */
+    bool relax_branches; /* --relax-branches: encode branches to local code labels as relative */
+    bool stream;         /* Input "-": read stdin and stream the object image to stdout */
+    bool framed;         /* --framed: stream every output as a frame on stdout */
+    int ent_fd;          /* --ent-fd N: descriptor for the .ent output when streaming (-1 = none) */
+    int ext_fd;          /* --ext-fd N: descriptor for the .ext output when streaming (-1 = none) */
+    FILE *log;           /* Stream for progress messages and reports (stderr when streaming) */
+    ImageFormat image_format; /* --format bin|ihex|srec: also write a flat image */
+    uint16_t load_address;    /* --load-address N: address of the first word (START_LINE by default) */
+    bool pipeline;            /* --pipeline: read, expand macros and collect symbols on separate threads */
+    bool mem_stats;           /* --mem-stats: print memory use per phase of assemble() */
+    int io_threads;           /* --io-threads N: threads prefetching inputs and writing outputs (0 = synchronous) */
+    const char *trace_path;   /* --trace FILE: write a Chrome trace-event timeline to FILE (NULL = off) */
+    const char *cache_dir;    /* --cache DIR: restore unchanged inputs' outputs from DIR (NULL = off) */
+    long cache_size;          /* --cache-size N: bound of the cache, in KiB */
+    const char *server_address; /* --server ADDR: serve requests on a Unix socket, or on stdin/stdout for "-" (NULL = off) */
+    int server_threads;       /* --server-threads N: workers assembling server requests */
+    const char *output_dir;   /* Directory the outputs are written to, ending with '/' (set per server request) */
+    bool line_map;            /* --line-map: write the address-to-source line table (.map) */
+    bool xref;                /* --xref: write the cross-reference index of the symbols (.xref) */
+    const char *archive_name; /* --archive NAME: pack the assembled inputs into NAME.lib (NULL = off) */
+    bool stream_encode;       /* --stream-encode: write the words to the .ob file while encoding */
+    bool size_report;         /* --size-report: write the words per label and per macro (.size, .size.csv) */
+    bool check;               /* --check: only validate the input, printing its errors as JSON lines */
+    bool write_if_changed;    /* --write-if-changed: only replace the output files whose contents changed */
+    const char *compile_macros; /* --compile-macros FILE: write the inputs' macros to the snapshot FILE instead of assembling (NULL = off) */
+    const char *macros_path;  /* --macros FILE: expand the macros of the snapshot FILE in every input (NULL = none) */
+    int workers;              /* --workers N: processes assembling the inputs, isolating crashes (0 = this process) */
+} AssemblerOptions;
+
+/**
+ * @brief Initializes the options with their default values.
+ *
+ * @param options The options structure to initialize.
+ */
+void init_options(AssemblerOptions *options);
+
+/**
+ * @brief Parses a single command-line option.
+ *
+ * Options start with "--". Options that take a value consume the following
+ * argument, in which case `*index` is advanced past it.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @param index Pointer to the index of the current argument.
+ * @param options The options structure to update.
+ * @return true if the argument was a valid option, false otherwise.
+ */
+bool parse_option(int argc, char *argv[], int *index, AssemblerOptions *options);
+
+/**
+ * @brief Checks whether a command-line argument is an option.
+ *
+ * @param arg The command-line argument.
+ * @return true if the argument starts with "--", false otherwise.
+ */
+bool is_option(const char *arg);
+
+#endif /* OPTIONS_H */
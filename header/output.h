@@ -0,0 +1,143 @@
+/**
+ * @file output.h
+ * @brief Header file for opening the assembler's output files.
+ *
+ * This file decides where each output (.am, .ob, .ent, .ext, ...) is written, so that
+ * `assemble` only prints to a stream and never deals with paths.
+ *
+ * Destinations:
+ * - Default: "../outputs/NAME.ob", "../outputs/NAME.ent", "../outputs/NAME.ext"
+ *   (server requests may name another directory than "../outputs/").
+ * - Streaming (input "-"): the object image goes to stdout, while .ent/.ext go to
+ *   the file descriptors given by --ent-fd/--ext-fd, and are dropped otherwise.
+ *   Flat images are only kept when framed.
+ * - Framed streaming (--framed): every output goes to stdout as a frame, made of a
+ *   header line "EXT SIZE\n" (e.g. "ob 312\n") followed by exactly SIZE bytes.
+ * - Batched I/O (--io-threads): outputs are built in memory, then queued to the
+ *   writer thread which creates the file at its default path.
+ *
+ * The .am output is only used with batched I/O or --write-if-changed (otherwise
+ * the .am file is opened by `process_file`), and never when streaming.
+ *
+ * Output files are replaced rather than truncated, since a file restored by the
+ * output cache (--cache) may be a hard link to a cache entry. Closed outputs are
+ * recorded by the cache. A .ent or .ext file the input no longer produces is
+ * removed, so that it is never mistaken for an output of the latest assembly.
+ *
+ * With --write-if-changed, outputs are built in memory and compared with the
+ * existing file, by size and then by content. An identical file is left alone,
+ * keeping its modification time so that downstream steps are not rerun. Other
+ * files are written to a temporary file which is renamed over them, so readers
+ * never see a partial output.
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+
+#include "./lib.h"
+#include "./options.h"
+#include "./trace.h"
+
+#define OUTPUT_DIR "../outputs/" /* Directory of the output files */
+
+/**
+ * @brief Kinds of output files produced by the assembler.
+ */
+typedef enum {
+    OUTPUT_PREPROCESSED, /* .am file */
+    OUTPUT_OBJECT,    /* .ob file */
+    OUTPUT_ENTRIES,   /* .ent file */
+    OUTPUT_EXTERNALS, /* .ext file */
+    OUTPUT_BINARY,    /* .bin flat image */
+    OUTPUT_IHEX,      /* .hex flat image */
+    OUTPUT_SREC,      /* .srec flat image */
+    OUTPUT_LINE_MAP,  /* .map address-to-source line table */
+    OUTPUT_XREF,      /* .xref cross-reference index */
+    OUTPUT_ARCHIVE,   /* .lib archive of assembled modules, written by `write_archive` */
+    OUTPUT_SIZE_REPORT, /* .size image size breakdown */
+    OUTPUT_SIZE_CSV   /* .size.csv image size breakdown, as a table */
+} OutputKind;
+
+/**
+ * @brief An output file opened for writing.
+ */
+typedef struct {
+    FILE *stream;      /* Stream to write the output to */
+    OutputKind kind;   /* Kind of the output */
+    bool owns_stream;  /* true if the stream must be closed after writing */
+    bool framed;       /* true if the output is sent as a frame on stdout */
+    char *buffer;      /* In-memory contents, for framed outputs */
+    size_t size;       /* Size of `buffer` */
+    char *path;        /* Path of the output file, or NULL when streaming */
+    bool deferred;     /* true if the file is written by the writer thread (batched I/O) */
+    bool if_changed;   /* true if the file is only replaced when its contents changed (--write-if-changed) */
+    TraceSpan span;    /* Span from opening to closing the output (--trace) */
+} Output;
+
+/**
+ * @brief Returns the file extension of an output kind.
+ *
+ * @param kind The output kind.
+ * @return The extension, without the leading dot (e.g., "ob").
+ */
+const char* output_extension(OutputKind kind);
+
+/**
+ * @brief Opens an output for writing.
+ *
+ * @param output The output to open.
+ * @param base_name Base name of the input file.
+ * @param kind The kind of output to open.
+ * @param options Modes selected on the command line.
+ * @return true if the output should be written, false if it is dropped or failed to open.
+ */
+bool open_output(Output *output, const char *base_name, OutputKind kind,
+                 const AssemblerOptions *options);
+
+/**
+ * @brief Finishes writing an output, flushing, framing or queuing it as needed.
+ *
+ * Does nothing if the output was never opened.
+ *
+ * @param output The output to close.
+ * @return false if the file could not be replaced (--write-if-changed), true otherwise.
+ */
+bool close_output(Output *output);
+
+/**
+ * @brief Drops an output that must not be kept, removing its file.
+ *
+ * Does nothing if the output was never opened.
+ *
+ * @param output The output to drop.
+ */
+void discard_output(Output *output);
+
+/**
+ * @brief Removes the file of an output the input no longer produces.
+ *
+ * A .ent or .ext file is only written when the input has entries or uses
+ * externals; a file left by an earlier assembly of the input would otherwise
+ * be taken for its current output. Does nothing when streaming. With batched
+ * I/O, the removal is queued after the writes already queued.
+ *
+ * @param base_name Base name of the input file.
+ * @param kind The kind of output to remove.
+ * @param options Modes selected on the command line.
+ */
+void remove_output(const char *base_name, OutputKind kind, const AssemblerOptions *options);
+
+/**
+ * @brief Replaces a file with in-memory contents, unless it already holds them.
+ *
+ * The contents are written to a temporary file next to it, then renamed over it.
+ *
+ * @param path Path of the file.
+ * @param buffer The contents.
+ * @param size Size of `buffer`.
+ * @return true if the file holds the contents, false if it could not be written.
+ */
+bool replace_if_changed(const char *path, const char *buffer, size_t size);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,81 @@
+/**
+ * @file pipeline.h
+ * @brief Header file for running preprocessing and the first pass as a pipeline.
+ *
+ * Instead of preprocessing the whole file before the first pass starts, the
+ * phases run at the same time, each on its own thread:
+ * 1. The reader reads the source file.
+ * 2. The macro expander preprocesses what was read.
+ * 3. The calling thread collects symbols from the expanded lines, and copies
+ *    them to the .am file for the second pass.
+ *
+ * Stages are connected by bounded, lock-free, single-producer/single-consumer
+ * rings of line records, wrapped in FILE streams so every phase keeps reading
+ * and writing through stdio. The second pass (encoding) starts as soon as the
+ * symbol table is sealed.
+ *
+ * Macros are only known once preprocessing ends, so the first pass runs without
+ * the macro list. If it found errors, or a label turns out to be a macro name,
+ * its result is discarded and the caller runs the serial first pass over the
+ * .am file, which also prints the diagnostics.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./symbols.h"
+#include "./data_pool.h"
+#include "./options.h"
+#include "./line_map.h"
+
+#define PIPELINE_RING_SIZE 256     /* Line records per ring (a power of two) */
+#define PIPELINE_RECORD_SIZE 128   /* Bytes per line record */
+#define PIPELINE_READ_SIZE 4096    /* Bytes read from the source file at once */
+
+/**
+ * @brief A line, or part of a long line, passed between stages.
+ */
+typedef struct {
+    char data[PIPELINE_RECORD_SIZE]; /* Bytes of the record */
+    size_t length;                   /* Number of bytes in the record */
+} LineRecord;
+
+/**
+ * @brief Bounded single-producer/single-consumer ring of line records.
+ */
+typedef struct {
+    LineRecord records[PIPELINE_RING_SIZE]; /* Ring storage */
+    unsigned long head;    /* Next record to read, advanced by the consumer only */
+    unsigned long tail;    /* Next record to write, advanced by the producer only */
+    int closed;            /* Set by the producer after its last record */
+    LineRecord pending;    /* Record being filled by the producer */
+    size_t offset;         /* Bytes of the head record already read by the consumer */
+    FILE *tee;             /* Receives a copy of everything read, or NULL */
+} LineRing;
+
+/**
+ * @brief Preprocesses a file and runs the first pass on it as a pipeline.
+ *
+ * Always preprocesses `file` into `am`. If the pipeline cannot be set up, the
+ * preprocessing runs serially and no symbols are collected.
+ *
+ * @param file The source file.
+ * @param am The preprocessed (.am) output.
+ * @param macros_ptr Output for the linked list of macros.
+ * @param symbols_ptr Output for the symbol table.
+ * @param errors Pointer to the error counter.
+ * @param number_of_lines Pointer to the line counter.
+ * @param pool Shared data blocks, or NULL when pooling is disabled.
+ * @param map Receives the origin of every .am line (--line-map), or NULL.
+ * @param options Modes selected on the command line.
+ * @return true if the symbol table was collected, false if the caller must run the first pass.
+ */
+bool pipeline_first_pass(FILE *file, FILE *am, SymbolList **macros_ptr,
+                         SymbolList **symbols_ptr, uint8_t *errors,
+                         uint8_t *number_of_lines, DataPool *pool,
+                         SourceMap *map, const AssemblerOptions *options);
+
+#endif /* PIPELINE_H */
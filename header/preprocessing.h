@@ -15,6 +15,7 @@
 
 #include <stdio.h>
 #include "../header/symbols.h"
+#include "../header/line_map.h"
 
 /**
  * @brief Preprocesses the input file for the assembler.
@@ -25,7 +26,8 @@
  * @param file The input file to preprocess.
  * @param temp The temporary file to write the preprocessed content to.
  * @param macros_ptr Pointer to the linked list of macros.
+ * @param map Receives the origin of every preprocessed line (--line-map), or NULL.
  */
-void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr);
+void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr, SourceMap* map);
 
 #endif /* PREPROCESSING_C */
\ No newline at end of file
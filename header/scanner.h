@@ -0,0 +1,72 @@
+/**
+ * @file scanner.h
+ * @brief Header file for the vectorized line scanner.
+ *
+ * Finds delimiters in null-terminated lines 16 or 32 bytes at a time, instead
+ * of one byte at a time. Bytes are classified as spaces, tabs, commas, colons,
+ * semicolons, double quotes and newlines; callers pass the classes they are
+ * looking for as a bit set.
+ *
+ * The implementation is chosen at runtime, on first use:
+ * - AVX2 (32 bytes per step), when the CPU supports it.
+ * - SSE2 (16 bytes per step), on any other x86 CPU.
+ * - Scalar, on other architectures.
+ *
+ * Vector loads are aligned, so they never cross a page boundary, and bytes past
+ * the terminator are ignored.
+ */
+#ifndef SCANNER_H
+#define SCANNER_H
+
+/**
+ * @brief Classes of bytes the scanner recognizes (combinable as bits).
+ */
+typedef enum {
+    SCAN_SPACE     = 1 << 0,  /* ' ' */
+    SCAN_TAB       = 1 << 1,  /* '\t' */
+    SCAN_COMMA     = 1 << 2,  /* ',' */
+    SCAN_COLON     = 1 << 3,  /* ':' */
+    SCAN_SEMICOLON = 1 << 4,  /* ';' */
+    SCAN_QUOTE     = 1 << 5,  /* '"' */
+    SCAN_NEWLINE   = 1 << 6   /* '\n' */
+} ScanClass;
+
+#define SCAN_CLASSES 7                        /* Number of byte classes */
+#define SCAN_BLANK (SCAN_SPACE | SCAN_TAB)    /* Spaces and tabs */
+
+/**
+ * @brief Finds the first byte of the given classes.
+ *
+ * @param s The null-terminated string to scan.
+ * @param classes The classes to look for.
+ * @return A pointer to the first matching byte, or to the terminator if there is none.
+ */
+char* scan_find(const char *s, unsigned classes);
+
+/**
+ * @brief Skips the bytes of the given classes.
+ *
+ * @param s The null-terminated string to scan.
+ * @param classes The classes to skip.
+ * @return A pointer to the first byte not in the classes (possibly the terminator).
+ */
+char* scan_skip(const char *s, unsigned classes);
+
+/**
+ * @brief Splits a string into tokens, like `strtok_r` with a set of classes as delimiters.
+ *
+ * @param s The string to split, or NULL to continue the previous split.
+ * @param delimiters The classes separating tokens (0 returns the rest of the string).
+ * @param save The position where the next call continues.
+ * @return The next token, or NULL if there are no more tokens.
+ */
+char* scan_token(char *s, unsigned delimiters, char **save);
+
+/**
+ * @brief Returns the name of the implementation in use.
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char* scanner_implementation(void);
+
+#endif /* SCANNER_H */
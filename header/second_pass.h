@@ -2,6 +2,11 @@
 #define SECOND_PASS_H
 
 #include "./word_list.h"
+#include "./symbols.h"
+#include "./data_pool.h"
+#include "./options.h"
+#include "./xref.h"
+#include "./word_sink.h"
 
 /**
  * @brief Second pass of the assembler
@@ -13,10 +18,18 @@
  * - Machine code generation
  * 
  * Memory layout:
- * - Instructions start at START_LINE (100)
+ * - Instructions start at the load address (START_LINE, 100, by default)
  * - Data section follows instructions
  * - External references use special ARE bits
  * 
+ * Branch relaxation (--relax-branches):
+ * - jmp/bne/jsr to a local code label are encoded as &label
+ * - The displacement word is absolute, so the loader has nothing to relocate
+ * 
+ * Syntax check (--check):
+ * - Operands are validated and the counters advanced, but no word is built,
+ *   so both lists are left empty
+ * 
  * @param preprocessed Preprocessed source file
  * @param symbols_ptr Symbol table pointer
  * @param inst_list Instructions list pointer
@@ -24,10 +37,17 @@
  * @param ic Instruction counter
  * @param dc Data counter
  * @param errors Error counter
+ * @param pool Data pool filled by the first pass, or NULL when pooling is disabled
+ * @param options Modes selected on the command line
+ * @param relaxed Counter of direct branch operands rewritten as relative
+ * @param xref Output for the label declarations and uses, or NULL without --xref
+ * @param sink Writes the words after every line, leaving the lists empty (--stream-encode), or NULL
  */
 void second_pass(FILE *preprocessed, SymbolList **symbols_ptr, 
                 WordList **inst_list, WordList **data_list, 
-                uint8_t *ic, uint8_t *dc, 
-                uint8_t *errors);
+                uint8_t *ic, uint16_t *dc, 
+                uint8_t *errors, DataPool *pool,
+                const AssemblerOptions *options, int *relaxed, XrefEvent **xref,
+                WordSink *sink);
 
 #endif /* SECOND_PASS_H */
\ No newline at end of file
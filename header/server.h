@@ -0,0 +1,70 @@
+/**
+ * @file server.h
+ * @brief Header file for the assembler server (--server ADDR).
+ *
+ * A long-running assembler serves assembly requests, so a build system that
+ * assembles one file at a time does not pay for process startup on every file,
+ * and every request finds the scanner selected and the included files already
+ * read and preprocessed (read again when they change on disk).
+ *
+ * Requests are read from stdin (ADDR "-") or from the connections of a Unix
+ * domain socket (ADDR is its path). A request is one line of space-separated
+ * fields, starting with an ID chosen by the client:
+ * - `ID FILE NAME PATH [DIR]`: assembles the file at PATH.
+ * - `ID SOURCE NAME SIZE [DIR]`: assembles the SIZE bytes following the line.
+ *
+ * Outputs are written to DIR (default "../outputs/") as NAME.am, NAME.ob, etc.
+ * Requests are assembled concurrently by a pool of worker threads, and every
+ * answer is a frame sent once its request is done, in completion order:
+ * a header line `ID STATUS SIZE`, where STATUS is "ok", "failed" or "invalid",
+ * followed by exactly SIZE bytes of diagnostics and reports.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "./lib.h"
+#include "./options.h"
+
+#define SERVER_STDIO "-"              /* Address serving requests on stdin/stdout */
+#define SERVER_FIELD_SIZE 256         /* Longest field of a request line, with its terminator */
+#define SERVER_MAX_SOURCE (16L << 20) /* Largest source sent in a request, in bytes */
+
+/**
+ * @brief A client of the server: stdin/stdout, or a socket connection.
+ */
+typedef struct {
+    FILE *in;                  /* Requests */
+    FILE *out;                 /* Answers */
+    pthread_mutex_t lock;      /* Guards `out` and `pending` */
+    pthread_cond_t idle;       /* Signaled when `pending` drops to 0 */
+    int pending;               /* Requests queued or being assembled */
+} ServerClient;
+
+/**
+ * @brief A request waiting for a worker.
+ */
+typedef struct ServerRequest {
+    ServerClient *client;              /* Client to answer */
+    char id[SERVER_FIELD_SIZE];        /* ID chosen by the client */
+    char name[SERVER_FIELD_SIZE];      /* Base name of the outputs */
+    char path[SERVER_FIELD_SIZE];      /* Source file, empty when the source was sent */
+    char output_dir[SERVER_FIELD_SIZE + 1]; /* Directory of the outputs, ending with '/' */
+    char *source;                      /* Source sent with the request, or NULL */
+    size_t size;                       /* Size of `source` */
+    struct ServerRequest *next;        /* Next queued request */
+} ServerRequest;
+
+/**
+ * @brief Serves requests until stdin ends (ADDR "-"), or forever (socket).
+ *
+ * @param address "-" for stdin/stdout, or the path of the Unix socket to listen on.
+ * @param options Modes selected on the command line, applied to every request.
+ * @return true if the server ran, false if it could not start.
+ */
+bool run_server(const char *address, const AssemblerOptions *options);
+
+#endif /* SERVER_H */
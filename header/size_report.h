@@ -0,0 +1,111 @@
+/**
+ * @file size_report.h
+ * @brief Header file for the image size breakdown (--size-report).
+ *
+ * Every word written to the .ob file is attributed to:
+ * - The label region holding it: the nearest code label at or before its
+ *   address for instruction words, the nearest data label for data words.
+ *   Words before the first label of their section count as "(none)".
+ * - The macro or included file its line was expanded from, found through the
+ *   preprocessor's `SourceMap`, or "-" for lines written in the source itself.
+ *
+ * Two outputs are written next to the .ob file:
+ * - NAME.size: the totals per section, then the top consumers of each kind.
+ * - NAME.size.csv: every region and origin, one per row, for sorting:
+ *
+ *       kind,section,name,words,bytes
+ *
+ *   where kind is "label", "origin" or "total".
+ */
+#ifndef SIZE_REPORT_H
+#define SIZE_REPORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./symbols.h"
+#include "./word_list.h"
+#include "./line_map.h"
+
+#define SIZE_REPORT_TOP 10 /* Consumers listed per kind in the text report */
+
+/**
+ * @brief Sections of the image.
+ */
+typedef enum {
+    SIZE_CODE,         /* Instruction words */
+    SIZE_DATA,         /* Data words */
+    SIZE_SECTIONS      /* Number of sections */
+} SizeSection;
+
+/**
+ * @brief Words of a label region.
+ */
+typedef struct {
+    const char *name;          /* Label starting the region, "(none)" before the first one */
+    uint16_t address;          /* Address of the label */
+    unsigned long words;       /* Words in the region */
+} SizeRegion;
+
+/**
+ * @brief Words expanded from a macro or included file.
+ */
+typedef struct {
+    const char *origin;                    /* Macro or included file, NULL for the source itself */
+    unsigned long words[SIZE_SECTIONS];    /* Words per section */
+} SizeOrigin;
+
+/**
+ * @brief State of a size report.
+ */
+typedef struct {
+    const SourceMap *sources;              /* Origins of the .am lines */
+    SizeRegion *regions[SIZE_SECTIONS];    /* Regions per section, by address */
+    size_t regions_count[SIZE_SECTIONS];   /* Number of regions per section */
+    SizeOrigin *origins;                   /* Origins seen so far */
+    size_t origins_count;                  /* Number of origins */
+    size_t origins_capacity;               /* Allocated origins */
+    unsigned long totals[SIZE_SECTIONS];   /* Words per section */
+    uint32_t line[SIZE_SECTIONS];          /* .am line of the next words, per section */
+    size_t origin[SIZE_SECTIONS];          /* Origin of that line, per section */
+} SizeReport;
+
+/**
+ * @brief Starts a report, taking the label regions from the resolved symbol table.
+ *
+ * @param report The report.
+ * @param symbols The symbol table, with final addresses.
+ * @param sources Origins of the .am lines.
+ */
+void size_report_begin(SizeReport *report, SymbolList *symbols, const SourceMap *sources);
+
+/**
+ * @brief Accounts for a node of a word list, in the order the words are written.
+ *
+ * @param report The report.
+ * @param node The node (a line marker moves the line of the section).
+ * @param address Address of the node's first word.
+ * @param section Section of the node.
+ */
+void size_report_add(SizeReport *report, const WordList *node, uint16_t address, SizeSection section);
+
+/**
+ * @brief Writes the text report and the CSV table.
+ *
+ * @param report The report.
+ * @param name Base name of the input.
+ * @param text The text output, or NULL.
+ * @param csv The CSV output, or NULL.
+ */
+void size_report_write(const SizeReport *report, const char *name, FILE *text, FILE *csv);
+
+/**
+ * @brief Frees a report.
+ *
+ * @param report The report.
+ */
+void size_report_free(SizeReport *report);
+
+#endif /* SIZE_REPORT_H */
@@ -16,6 +16,7 @@
  #define SYMBOLS_H
  
  #include <stdint.h>
+ #include <stddef.h>
  #include "../header/lib.h"
  
  /**
@@ -57,6 +58,21 @@
      } value;
      struct SymbolList *next;    /* Next symbol in table */
  } SymbolList;
+
+ /**
+  * @brief Hashed index of a symbol table, for lookups in constant time
+  * 
+  * Symbols are prepended to their table, so the newest symbol of a label is
+  * the one `get_symbol_by_label` finds; the index keeps that one as well,
+  * except that a label's definition is kept over its .entry (both have the
+  * same address once resolved, and the definition tells code from data).
+  * The passes build one over the table they search for every label.
+  */
+ typedef struct {
+     SymbolList **slots;         /* Newest symbol of each label, by hash (open addressing), NULL when free */
+     size_t capacity;            /* Number of slots, a power of two */
+     size_t count;               /* Number of labels indexed */
+ } SymbolIndex;
  
  /**
   * @brief Adds a numeric symbol to the symbol table
@@ -102,6 +118,41 @@
   * @return true if symbol exists, false otherwise
   */
  bool is_symbol_exists(SymbolList *head, const char *label);
+
+ /**
+  * @brief Hashes a label (32-bit FNV-1a), the same on every build
+  * @param label The label
+  * @return The hash
+  */
+ uint32_t hash_label(const char *label);
+
+ /**
+  * @brief Indexes the symbols of a table
+  * @param index Index to initialize
+  * @param head Symbol table head, may be NULL
+  */
+ void symbol_index_init(SymbolIndex *index, SymbolList *head);
+
+ /**
+  * @brief Indexes a symbol just prepended to the table, replacing older ones with its label
+  * @param index The index
+  * @param symbol The new symbol
+  */
+ void symbol_index_add(SymbolIndex *index, SymbolList *symbol);
+
+ /**
+  * @brief Finds a symbol by label, as `get_symbol_by_label` would, a definition before an .entry
+  * @param index The index
+  * @param label Symbol to find
+  * @return Pointer to symbol if found, NULL otherwise
+  */
+ SymbolList* symbol_index_find(const SymbolIndex *index, const char *label);
+
+ /**
+  * @brief Frees an index, leaving the symbols alone
+  * @param index The index
+  */
+ void symbol_index_free(SymbolIndex *index);
  
  /**
   * @brief Frees all memory used by symbol table
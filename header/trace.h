@@ -0,0 +1,96 @@
+/**
+ * @file trace.h
+ * @brief Header file for timeline tracing (--trace FILE).
+ *
+ * Records timed spans (a file being processed, a phase, an output being
+ * written) and exports them as Chrome trace-event JSON, which trace viewers
+ * such as chrome://tracing or Perfetto open directly.
+ *
+ * Key Features:
+ * - Timestamps come from the monotonic clock.
+ * - Every thread records into its own buffer, which only that thread writes,
+ *   so recording takes no lock. Buffers register themselves once, with an
+ *   atomic push onto a global list.
+ * - Spans are written as complete events (begin time and duration), so spans
+ *   of one thread do not need to nest.
+ * - When tracing is off, `trace_begin` and `trace_end` only test a flag.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#include "./lib.h"
+
+#define TRACE_DETAIL_SIZE 48     /* Bytes kept of a span's detail (e.g., a file name) */
+#define TRACE_BLOCK_EVENTS 1024  /* Events per buffer block */
+
+/**
+ * @brief A span being timed.
+ */
+typedef struct {
+    const char *name;                  /* Name of the span (a string literal), NULL if not recorded */
+    char detail[TRACE_DETAIL_SIZE];    /* Detail shown with the span */
+    double start;                      /* Start time, in microseconds */
+} TraceSpan;
+
+/**
+ * @brief A recorded span.
+ */
+typedef struct {
+    const char *name;                  /* Name of the span */
+    char detail[TRACE_DETAIL_SIZE];    /* Detail shown with the span */
+    double start;                      /* Start time, in microseconds */
+    double duration;                   /* Duration, in microseconds */
+} TraceEvent;
+
+/**
+ * @brief A block of events recorded by one thread.
+ */
+typedef struct TraceBlock {
+    TraceEvent events[TRACE_BLOCK_EVENTS]; /* Recorded events */
+    int count;                             /* Number of recorded events */
+    struct TraceBlock *next;               /* Next (older) block of the thread */
+} TraceBlock;
+
+/**
+ * @brief The buffer of one thread.
+ */
+typedef struct TraceBuffer {
+    int thread_id;                 /* Sequential id of the thread */
+    TraceBlock *blocks;            /* Newest block first */
+    struct TraceBuffer *next;      /* Next registered buffer */
+} TraceBuffer;
+
+/**
+ * @brief Turns tracing on.
+ */
+void trace_enable(void);
+
+/**
+ * @brief Starts timing a span.
+ *
+ * @param span The span to start.
+ * @param name The name of the span (must outlive the trace, e.g. a string literal).
+ * @param detail Detail shown with the span, or NULL.
+ */
+void trace_begin(TraceSpan *span, const char *name, const char *detail);
+
+/**
+ * @brief Stops timing a span and records it.
+ *
+ * @param span The span started by `trace_begin`.
+ */
+void trace_end(TraceSpan *span);
+
+/**
+ * @brief Writes every recorded span as Chrome trace-event JSON.
+ *
+ * Must be called once the threads that recorded spans have finished.
+ *
+ * @param path The path of the trace file.
+ * @return true on success, false if the file could not be written.
+ */
+bool trace_write(const char *path);
+
+#endif /* TRACE_H */
@@ -48,6 +48,16 @@ bool is_valid_immediate_number(char *arg);
  */
 bool is_valid_number(char *arg);
 
+/**
+ * @brief Validates if an argument represents a valid `.space` size.
+ * 
+ * The size must be a number of words between 1 and MAX_SPACE_SIZE.
+ * 
+ * @param arg The argument to validate.
+ * @return true if the argument is a valid size, false otherwise.
+ */
+bool is_valid_space_size(char *arg);
+
 /**
  * @brief Validates if an argument represents a valid addressing mode.
  * 
@@ -18,6 +18,7 @@
 #ifndef WORD_H
 #define WORD_H
 
+#include <stdio.h>
 #include <stdint.h>
 
 /**
@@ -105,6 +106,6 @@ uint32_t word_to_hex(Word* inst);
  * @param line Pointer to the current line number.
  * @param file The file to write the output to.
  */
-void print_word_hex(Word* inst, uint8_t *line, FILE* file);
+void print_word_hex(Word* inst, uint16_t *line, FILE* file);
 
 #endif /* WORD_H */
\ No newline at end of file
@@ -5,19 +5,43 @@
 #include "./lib.h"
 #include "./word.h"
 
+#define MAX_BINARIES 65536 /* .incbin ranges held by live nodes at once, indexed by a uint16_t */
+
+/**
+ * @brief What a word list node stores
+ */
+typedef enum {
+    WORD_NODE,            /* Machine word */
+    LINE_NODE,            /* Line marker */
+    FILL_NODE,            /* Run of zero words */
+    BINARY_NODE           /* Bytes of an included file */
+} WordNodeKind;
+
+/**
+ * @brief Bytes of an included file, kept in a side table so that nodes stay small
+ */
+typedef struct {
+    const unsigned char *bytes; /* First byte, in a mapping that outlives the list */
+    size_t size;                /* Number of bytes */
+} BinaryRange;
+
 /**
  * @brief Node in the linked list of machine words
  * 
  * Can store either:
  * - Machine word (instruction/data)
- * - Line number (for error reporting)
+ * - Line marker, giving the line of the words that follow (--line-map)
+ * - Run of zero words (a `.space` reservation), kept as a count
+ * - Bytes of an included file (an `.incbin`), packed into words when written
  */
 typedef struct WordList {
     union {
         Word *word;       /* Machine word pointer */
-        uint8_t line;     /* Source line number */
+        uint32_t line;    /* Line of the preprocessed source (--line-map) */
+        uint16_t fill;    /* Number of zero words in the run */
+        uint16_t binary;  /* Index of the byte range in the side table */
     } data;
-    bool is_line;         /* true if storing line number */
+    uint8_t kind;         /* A WordNodeKind */
     struct WordList *next;
 } WordList;
 
@@ -33,7 +57,36 @@ void add_word(WordList **head, Word *word);
  * @param head Pointer to list head
  * @param line Line number to store
  */
-void add_line(WordList **head, uint8_t line);
+void add_line(WordList **head, uint32_t line);
+
+/**
+ * @brief Adds a run of zero words to the list in O(1) time and memory
+ * 
+ * The words are only produced when the list is written out
+ * @param head Pointer to list head
+ * @param count Number of zero words in the run
+ */
+void add_fill(WordList **head, uint16_t count);
+
+/**
+ * @brief Adds the bytes of a file to the list in O(1) time and memory
+ * 
+ * The bytes are not copied, and are packed 3 per word, most significant
+ * first, when the list is written out. The range takes a slot of the side
+ * table until the node is freed
+ * @param head Pointer to list head
+ * @param bytes First byte (must stay allocated until the list is freed)
+ * @param size Number of bytes
+ * @return true on success, false if MAX_BINARIES ranges are already held
+ */
+bool add_binary(WordList **head, const unsigned char *bytes, size_t size);
+
+/**
+ * @brief Gets the byte range of a BINARY_NODE
+ * @param node The node
+ * @return The range, valid until the node is freed
+ */
+const BinaryRange* get_binary(const WordList *node);
 
 /**
  * @brief Reverses the word list in O(n) time complexity
@@ -43,6 +96,12 @@ void add_line(WordList **head, uint8_t line);
  */
 void reverse_list(WordList **head);
 
+/**
+ * @brief Frees a single node, and its word if it stores one
+ * @param node Node to free (already unlinked)
+ */
+void free_word_node(WordList *node);
+
 /**
  * @brief Frees all memory used by the list
  * @param head List to free
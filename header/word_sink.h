@@ -0,0 +1,97 @@
+/**
+ * @file word_sink.h
+ * @brief Header file for writing encoded words to the .ob file.
+ *
+ * `write_word_node` writes the words of a word list node to the .ob file, the
+ * flat image and the line table. `assemble` uses it for the word lists once
+ * the second pass is done.
+ *
+ * With --stream-encode, a `WordSink` is handed to the second pass instead, so
+ * that peak memory is bounded by the symbol table rather than the image:
+ * - Instruction words are written to a temporary file after every source line.
+ * - Data words only get their addresses once every instruction is written, so
+ *   they are spilled to another temporary file.
+ * - Once the section sizes are known, the .ob file receives the usual "IC DC"
+ *   header, the instruction words and the data words, so it is byte for byte
+ *   the file `assemble` writes from the word lists.
+ */
+#ifndef WORD_SINK_H
+#define WORD_SINK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./word_list.h"
+#include "./image.h"
+#include "./line_map.h"
+#include "./size_report.h"
+
+/**
+ * @brief State of an .ob file written while encoding.
+ */
+typedef struct {
+    FILE *ob;                  /* The .ob output */
+    LineMapWriter *map;        /* The line table, or NULL when it was not requested */
+    SizeReport *report;        /* The size breakdown, or NULL when it was not requested */
+    FILE *body;                /* Instruction words waiting for the header to be written */
+    FILE *spill;               /* Data nodes waiting for the instructions to be written */
+    WordList *binaries;        /* Spilled .incbin nodes, holding their byte ranges until written */
+    uint16_t address;          /* Address of the next instruction word */
+} WordSink;
+
+/**
+ * @brief Writes the words of a word list node.
+ *
+ * Reservations (.space) and embedded files (.incbin) are expanded here, one
+ * word at a time, so their words are never allocated. Line markers only tell
+ * the line table where the next words come from.
+ *
+ * @param node The node.
+ * @param address Address of the next word, advanced past the node's words.
+ * @param ob The .ob stream.
+ * @param image The flat image, or NULL when no format was requested.
+ * @param map The line table, or NULL when it was not requested.
+ */
+void write_word_node(WordList *node, uint16_t *address, FILE *ob, ImageWriter *image, LineMapWriter *map);
+
+/**
+ * @brief Opens the temporary files of the instruction and data words.
+ *
+ * @param sink The sink.
+ * @param ob The .ob output.
+ * @param map The line table, or NULL when it was not requested.
+ * @param report The size breakdown, or NULL when it was not requested.
+ * @param load_address Address of the first instruction word.
+ * @return true on success, false if a temporary file could not be created.
+ */
+bool word_sink_begin(WordSink *sink, FILE *ob, LineMapWriter *map, SizeReport *report, uint16_t load_address);
+
+/**
+ * @brief Stores the instruction words encoded so far, and spills the data words.
+ *
+ * Both lists are freed and left empty.
+ *
+ * @param sink The sink.
+ * @param inst_list Instruction words, newest first.
+ * @param data_list Data words, newest first.
+ */
+void word_sink_flush(WordSink *sink, WordList **inst_list, WordList **data_list);
+
+/**
+ * @brief Writes the header, the instruction words and the spilled data words to the .ob output.
+ *
+ * @param sink The sink.
+ * @param ic Size of the instruction section.
+ * @param dc Size of the data section.
+ */
+void word_sink_end(WordSink *sink, uint8_t ic, uint16_t dc);
+
+/**
+ * @brief Drops the stored words, when the output is discarded.
+ *
+ * @param sink The sink.
+ */
+void word_sink_abort(WordSink *sink);
+
+#endif /* WORD_SINK_H */
@@ -0,0 +1,71 @@
+/**
+ * @file workers.h
+ * @brief Header file for assembling the inputs in worker processes (--workers N).
+ *
+ * A malformed input may still stop the process assembling it: some errors
+ * exit on the spot, and a failed allocation always does. With --workers, the
+ * coordinator (the process started from the command line) forks a pool of
+ * worker processes and only hands out inputs, so such an input loses itself
+ * and nothing else, and the inputs are assembled on several cores at once.
+ *
+ * Protocol, over a pair of pipes per worker:
+ * - Job: the coordinator writes the index of an input (an int).
+ * - Result: once the input is done, the worker writes its index and whether
+ *   its outputs were written (two ints). A worker exits when its job pipe
+ *   is closed.
+ *
+ * The stdout and stderr of a worker are redirected to two temporary files
+ * created by the coordinator, which reads and empties them after every input.
+ * Diagnostics are then printed in input order, as a serial run prints them.
+ *
+ * A worker that dies (end of its result pipe) is reaped and reported, with
+ * the diagnostics it printed before it died, and replaced by a new one. Its
+ * input counts as failed, so the run exits with EXIT_FAILURE; the outputs it
+ * wrote before dying are left as is.
+ */
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "./lib.h"
+#include "./options.h"
+
+/**
+ * @brief Assembles one input, as `process_file` does.
+ *
+ * @param input Name of the input.
+ * @param options Modes selected on the command line.
+ * @return true if the outputs were written, false otherwise.
+ */
+typedef bool (*WorkerTask)(const char *input, const AssemblerOptions *options);
+
+/**
+ * @brief A worker process, as seen by the coordinator.
+ */
+typedef struct {
+    pid_t pid;                 /* Process of the worker, 0 when not running */
+    int jobs;                  /* Job pipe, written by the coordinator */
+    int results;               /* Result pipe, read by the coordinator */
+    FILE *out;                 /* Temporary file receiving the worker's stdout */
+    FILE *err;                 /* Temporary file receiving the worker's stderr */
+    int input;                 /* Input being assembled, -1 when idle */
+} Worker;
+
+/**
+ * @brief Assembles the inputs in a pool of worker processes.
+ *
+ * Returns once every input was assembled or lost with its worker.
+ *
+ * @param inputs The input file names.
+ * @param inputs_count The number of input files.
+ * @param task Assembles an input, in a worker.
+ * @param options Modes selected on the command line (`workers` processes at most).
+ * @param failed Incremented by the number of inputs whose outputs were not written.
+ * @return true if the inputs were handed to workers, false if no worker could be started.
+ */
+bool run_workers(char **inputs, int inputs_count, WorkerTask task,
+                 const AssemblerOptions *options, int *failed);
+
+#endif /* WORKERS_H */
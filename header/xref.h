@@ -0,0 +1,86 @@
+/**
+ * @file xref.h
+ * @brief Header file for the cross-reference index (--xref).
+ *
+ * The second pass sees every label declaration and every label operand, so it
+ * records them as events. Once the file is assembled, the events are sorted
+ * and written to NAME.xref, an index answering "where is X defined, and who
+ * uses it" without parsing any source.
+ *
+ * Layout of the .xref file (every number little-endian, so the file can be
+ * mapped and read in place on common hosts):
+ * - Header, XREF_HEADER_SIZE bytes: magic "XRF1", symbol count (u32),
+ *   reference count (u32), size of the string table (u32).
+ * - Symbols, XREF_SYMBOL_SIZE bytes each, sorted by name (strcmp order):
+ *   name offset in the string table (u32), definition line (u32, 0 if not
+ *   defined in the file), address (u32, 0 if unknown), first reference index (u32),
+ *   reference count (u32), type (u8, an XrefType), flags (u8, XREF_ENTRY),
+ *   name length (u16).
+ * - References, 4 bytes each: the lines using the symbols, grouped by
+ *   symbol in the order of the symbol table, ascending within a symbol.
+ * - String table: the names, each followed by a null terminator.
+ *
+ * Lines are lines of the preprocessed (.am) source, like the .map table.
+ * Finding a symbol is a binary search over fixed-size records.
+ */
+#ifndef XREF_H
+#define XREF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "./lib.h"
+#include "./symbols.h"
+
+#define XREF_MAGIC "XRF1"      /* First bytes of a .xref file */
+#define XREF_HEADER_SIZE 16    /* Size of the header, in bytes */
+#define XREF_SYMBOL_SIZE 24    /* Size of a symbol record, in bytes */
+#define XREF_ENTRY 1           /* Flag of a symbol declared with .entry */
+
+/**
+ * @brief Types of the symbols of the index.
+ */
+typedef enum {
+    XREF_UNKNOWN,      /* Used, but not defined in the file */
+    XREF_CODE,         /* Instruction label */
+    XREF_DATA,         /* Data label */
+    XREF_EXTERNAL      /* Declared with .extern */
+} XrefType;
+
+/**
+ * @brief A definition or use of a symbol, seen by the second pass.
+ */
+typedef struct XrefEvent {
+    char *name;                /* Symbol name */
+    uint32_t line;             /* Line of the .am source */
+    bool definition;           /* true for a label or .extern, false for a use or .entry */
+    struct XrefEvent *next;    /* Previous event (newest first) */
+} XrefEvent;
+
+/**
+ * @brief Records an event, in O(1) time.
+ *
+ * @param events Pointer to the list head.
+ * @param name The symbol name (copied).
+ * @param line The line.
+ * @param definition true for a definition, false for a use.
+ */
+void xref_add(XrefEvent **events, const char *name, uint32_t line, bool definition);
+
+/**
+ * @brief Writes the index of a file.
+ *
+ * @param stream The .xref output.
+ * @param events The events of the file.
+ * @param symbols The resolved symbol table.
+ */
+void xref_write(FILE *stream, XrefEvent *events, SymbolList *symbols);
+
+/**
+ * @brief Frees a list of events.
+ *
+ * @param events The list.
+ */
+void xref_free(XrefEvent *events);
+
+#endif /* XREF_H */
@@ -0,0 +1,329 @@
+#define _POSIX_C_SOURCE 200809L /* open_memstream */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/archive.h"
+#include "../header/assembler.h"
+#include "../header/output.h"
+
+#define ARCHIVE_SECTIONS 3 /* Outputs of a member: .ob, .ent and .ext */
+#define ENTRIES_SECTION 1  /* Index of the .ent output in `archive_sections` */
+
+static const OutputKind archive_sections[ARCHIVE_SECTIONS] = {
+    OUTPUT_OBJECT, OUTPUT_ENTRIES, OUTPUT_EXTERNALS
+};
+
+/**
+ * @brief A module being packed.
+ */
+typedef struct {
+    const char *name;                   /* Base name of the module */
+    uint32_t name_offset;               /* Offset of the name in the string table */
+    char *data[ARCHIVE_SECTIONS];       /* Contents of the outputs, NULL if missing */
+    size_t size[ARCHIVE_SECTIONS];      /* Sizes of the outputs */
+} Member;
+
+/**
+ * @brief A slot of the index.
+ */
+typedef struct {
+    uint32_t hash;             /* Hash of the symbol */
+    uint32_t name_offset;      /* Offset of the symbol in the string table */
+    uint32_t member;           /* Member declaring the symbol, ARCHIVE_EMPTY_SLOT if free */
+    uint32_t address;          /* Address of the symbol */
+} Slot;
+
+/**
+ * @brief The string table, growing as names are added.
+ */
+typedef struct {
+    char *bytes;               /* Names, each followed by a null terminator */
+    size_t size;               /* Bytes used */
+    size_t capacity;           /* Bytes allocated */
+} StringTable;
+
+uint32_t archive_hash(const char *name) {
+    uint32_t hash = 2166136261u; /* FNV offset basis */
+
+    while (*name != '\0') {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u; /* FNV prime */
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Appends a name to the string table.
+ *
+ * @param table The string table.
+ * @param name The name.
+ * @param length Length of the name.
+ * @return Offset of the name in the table.
+ */
+static uint32_t add_string(StringTable *table, const char *name, size_t length) {
+    size_t offset = table->size; /* Where the name goes */
+    char *grown; /* Reallocated table */
+
+    while (table->size + length + 1 > table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 256;
+        grown = (char *)realloc(table->bytes, table->capacity);
+        if (!grown) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        table->bytes = grown;
+    }
+
+    memcpy(table->bytes + offset, name, length);
+    table->bytes[offset + length] = '\0';
+    table->size += length + 1;
+    return (uint32_t)offset;
+}
+
+/**
+ * @brief Reads an output of a module from the output directory.
+ *
+ * @param module Base name of the module.
+ * @param kind The output.
+ * @param options Modes selected on the command line.
+ * @param size Output for the size of the contents.
+ * @return The contents, or NULL if the module has no such output.
+ */
+static char* read_output(const char *module, OutputKind kind, const AssemblerOptions *options, size_t *size) {
+    char path[256]; /* Path of the output */
+    FILE *file; /* The output */
+    char *data; /* Its contents */
+    int res; /* snprintf result */
+
+    *size = 0;
+    res = snprintf(path, sizeof(path), "%s%s.%s", options->output_dir, module, output_extension(kind));
+    if (res < 0 || res >= (int)sizeof(path)) {
+        return NULL;
+    }
+
+    file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    data = read_stream(file, size);
+    fclose(file);
+    if (!data) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    return data;
+}
+
+/**
+ * @brief Adds an entry symbol to the index, keeping the first member declaring it.
+ *
+ * @param slots The index.
+ * @param slots_count Number of slots, a power of two.
+ * @param table The string table.
+ * @param members The members, to name them in warnings.
+ * @param member The member declaring the symbol.
+ * @param symbol The symbol.
+ * @param length Length of the symbol.
+ * @param address Address of the symbol.
+ */
+static void index_symbol(Slot *slots, uint32_t slots_count, StringTable *table,
+                         const Member *members, uint32_t member,
+                         const char *symbol, size_t length, uint32_t address) {
+    char name[BUFFER_SIZE]; /* The symbol, null-terminated */
+    uint32_t hash; /* Hash of the symbol */
+    uint32_t i; /* Slot probed */
+
+    if (length == 0 || length >= sizeof(name)) {
+        return; /* Not a line written by the assembler */
+    }
+
+    memcpy(name, symbol, length);
+    name[length] = '\0';
+    hash = archive_hash(name);
+
+    /* Linear probing, the index is at most half full */
+    for (i = hash & (slots_count - 1); slots[i].member != ARCHIVE_EMPTY_SLOT; i = (i + 1) & (slots_count - 1)) {
+        if (slots[i].hash == hash && !strcmp(table->bytes + slots[i].name_offset, name)) {
+            if (slots[i].member == member) {
+                return; /* Declared twice by the same module */
+            }
+
+            fprintf(stderr, "Warning: entry symbol %s of %s is already declared by %s, keeping the first\n",
+                    name, members[member].name, members[slots[i].member].name);
+            return;
+        }
+    }
+
+    slots[i].hash = hash;
+    slots[i].name_offset = add_string(table, name, length);
+    slots[i].member = member;
+    slots[i].address = address;
+}
+
+/**
+ * @brief Writes a 32-bit number, least significant byte first.
+ *
+ * @param stream The output.
+ * @param value The number.
+ */
+static void put_u32(FILE *stream, uint32_t value) {
+    fputc((int)(value & 0xFF), stream);
+    fputc((int)((value >> 8) & 0xFF), stream);
+    fputc((int)((value >> 16) & 0xFF), stream);
+    fputc((int)((value >> 24) & 0xFF), stream);
+}
+
+bool write_archive(const char *name, char **modules, int count, const AssemblerOptions *options) {
+    Member *members; /* Modules being packed */
+    Slot *slots; /* The index */
+    uint32_t slots_count = ARCHIVE_MIN_SLOTS; /* Number of slots */
+    StringTable table = { NULL, 0, 0 }; /* Member and symbol names */
+    size_t entries = 0; /* Upper bound of the entry symbols (lines of the .ent files) */
+    unsigned long offset; /* Offset of the next member's data */
+    char path[256]; /* Path of the archive */
+    const char *line; /* Line of a .ent file */
+    const char *space; /* Separator of a .ent line */
+    const char *next; /* Next line of a .ent file */
+    FILE *archive; /* The archive */
+    char *buffer = NULL; /* The archive, built in memory (--write-if-changed) */
+    size_t buffer_size = 0; /* Size of buffer */
+    bool ok = true; /* Whether the archive was written */
+    int res; /* snprintf result */
+    int i, k; /* Loop variables */
+    uint32_t j; /* Slot loop variable */
+
+    res = snprintf(path, sizeof(path), "%s%s.%s", options->output_dir, name, output_extension(OUTPUT_ARCHIVE));
+    if (res < 0 || res >= (int)sizeof(path)) {
+        fprintf(stderr, "Error creating archive path\n");
+        return false;
+    }
+
+    members = (Member *)calloc(count + 1, sizeof(Member));
+    if (!members) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Read every member, the object file is required */
+    for (i = 0; i < count && ok; i++) {
+        members[i].name = modules[i];
+        for (k = 0; k < ARCHIVE_SECTIONS; k++) {
+            members[i].data[k] = read_output(modules[i], archive_sections[k], options, &members[i].size[k]);
+        }
+
+        if (members[i].data[0] == NULL) {
+            fprintf(stderr, "Archive %s not written: %s has no object file\n", name, modules[i]);
+            ok = false;
+        }
+
+        for (line = members[i].data[ENTRIES_SECTION]; line != NULL && (line = strchr(line, '\n')) != NULL; line++) {
+            entries++;
+        }
+    }
+
+    if (!ok) {
+        goto cleanup;
+    }
+
+    /* Build the index */
+    while (slots_count < entries * 2) {
+        slots_count *= 2;
+    }
+
+    slots = (Slot *)malloc(slots_count * sizeof(Slot));
+    if (!slots) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (j = 0; j < slots_count; j++) {
+        slots[j].member = ARCHIVE_EMPTY_SLOT;
+    }
+
+    for (i = 0; i < count; i++) {
+        members[i].name_offset = add_string(&table, members[i].name, strlen(members[i].name));
+
+        /* Lines of a .ent file are "SYMBOL ADDRESS" */
+        for (line = members[i].data[ENTRIES_SECTION]; line != NULL && *line != '\0'; line = next) {
+            next = strchr(line, '\n');
+            next = next != NULL ? next + 1 : line + strlen(line);
+            space = memchr(line, ' ', next - line);
+            if (space != NULL) {
+                index_symbol(slots, slots_count, &table, members, (uint32_t)i,
+                             line, space - line, (uint32_t)strtoul(space + 1, NULL, 10));
+            }
+        }
+    }
+
+    /* Write the archive */
+    if (options->write_if_changed) {
+        archive = open_memstream(&buffer, &buffer_size); /* Compared with the existing archive once built */
+    } else {
+        remove(path); /* Replace the file, like the other outputs */
+        archive = fopen(path, "wb");
+    }
+    if (!archive) {
+        fprintf(stderr, "Error opening archive for writing: %s\n", path);
+        free(slots);
+        ok = false;
+        goto cleanup;
+    }
+
+    fwrite(ARCHIVE_MAGIC, 1, 4, archive);
+    put_u32(archive, (uint32_t)count);
+    put_u32(archive, slots_count);
+    put_u32(archive, (uint32_t)table.size);
+
+    offset = ARCHIVE_HEADER_SIZE + (unsigned long)count * ARCHIVE_MEMBER_SIZE +
+             (unsigned long)slots_count * ARCHIVE_SLOT_SIZE + table.size;
+    for (i = 0; i < count; i++) {
+        put_u32(archive, members[i].name_offset);
+        put_u32(archive, (uint32_t)offset);
+        for (k = 0; k < ARCHIVE_SECTIONS; k++) {
+            put_u32(archive, (uint32_t)members[i].size[k]);
+            offset += members[i].size[k];
+        }
+    }
+
+    for (j = 0; j < slots_count; j++) {
+        put_u32(archive, slots[j].member == ARCHIVE_EMPTY_SLOT ? 0 : slots[j].hash);
+        put_u32(archive, slots[j].member == ARCHIVE_EMPTY_SLOT ? 0 : slots[j].name_offset);
+        put_u32(archive, slots[j].member);
+        put_u32(archive, slots[j].member == ARCHIVE_EMPTY_SLOT ? 0 : slots[j].address);
+    }
+
+    fwrite(table.bytes, 1, table.size, archive);
+    for (i = 0; i < count; i++) {
+        for (k = 0; k < ARCHIVE_SECTIONS; k++) {
+            if (members[i].data[k] != NULL) {
+                fwrite(members[i].data[k], 1, members[i].size[k], archive);
+            }
+        }
+    }
+
+    if (ferror(archive) | fclose(archive)) {
+        perror("Error writing archive");
+        ok = false;
+    } else if (buffer != NULL) {
+        ok = replace_if_changed(path, buffer, buffer_size);
+    }
+    free(buffer);
+
+    free(slots);
+
+    /* Cleanup wrapper, significant to avoid memory leaks */
+    cleanup:
+        for (i = 0; i < count; i++) {
+            for (k = 0; k < ARCHIVE_SECTIONS; k++) {
+                free(members[i].data[k]);
+            }
+        }
+        free(members);
+        free(table.bytes);
+        return ok;
+}
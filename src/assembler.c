@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L /* open_memstream, fmemopen */
+
 /* Standard Includes */
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,29 +11,70 @@
 #include "../header/word.h"
 #include "../header/lib.h"
 #include "../header/symbols.h"
+#include "../header/data_pool.h"
 #include "../header/errors.h"
 #include "../header/preprocessing.h"
 #include "../header/first_pass.h"
 #include "../header/second_pass.h"
+#include "../header/pipeline.h"
 #include "../header/word_list.h"
 #include "../header/symbols.h"
+#include "../header/output.h"
+#include "../header/image.h"
+#include "../header/mem_stats.h"
+#include "../header/line_map.h"
+#include "../header/xref.h"
+#include "../header/word_sink.h"
+#include "../header/size_report.h"
 
 uint8_t errors; /* Prototype for errors counter, accessed widely through this file context */
 
-void assemble(FILE* file, FILE* am, char* base_name) {
+/**
+ * @brief Maps a flat image format to the output that stores it.
+ * 
+ * @param format The flat image format.
+ * @return The output kind of the format.
+ */
+static OutputKind image_output_kind(ImageFormat format) {
+    switch (format) {
+        case IMAGE_IHEX: return OUTPUT_IHEX;
+        case IMAGE_SREC: return OUTPUT_SREC;
+        default:         return OUTPUT_BINARY;
+    }
+}
+
+bool assemble(FILE* file, FILE* am, char* base_name, const AssemblerOptions* options) {
     /* Variable declarations */
-    uint8_t line = START_LINE; /* Current line number */
+    uint16_t line = options->load_address; /* Current line number */
     SymbolList *symbols = NULL;
     WordList *inst_list = NULL; /* Linked list for instruction instructions */
     WordList *data_list = NULL; /* Linked list for data instructions */
     FILE *preprocessed = am; /* Preprocessed is equivalent to 'after macro' in this context */
     uint8_t errors = 0; /* Counter for errors during runtime */
     uint8_t ic = 0; /* Instruction counter */
-    uint8_t dc = 0; /* Data counter */
-    FILE* ob = NULL; /* .ob file, to write down on */
-    FILE* ent = NULL; /* .ent file, to write down on */
-    FILE* ext = NULL; /* .ext file, to write down on */
-    char path[256]; /* Path buffer for output files */
+    uint16_t dc = 0; /* Data counter */
+    Output am_output; /* .am output, when the preprocessed source is kept in memory */
+    Output ob_output; /* .ob output, to write down on */
+    Output ent_output; /* .ent output, to write down on */
+    Output ext_output; /* .ext output, to write down on */
+    Output image_output; /* Flat image output, when a format was requested */
+    Output map_output; /* .map output, when the line table was requested */
+    LineMapWriter line_map; /* Line table state */
+    SourceMap sources; /* Origins of the preprocessed lines, filled when the line table was requested */
+    Output xref_output; /* .xref output, when the cross-reference index was requested */
+    XrefEvent *xref = NULL; /* Label declarations and uses, collected when the index was requested */
+    WordSink sink; /* .ob output written while encoding (--stream-encode) */
+    bool streaming = false; /* Whether the second pass writes the words through `sink` */
+    Output size_output; /* .size output, when the size breakdown was requested */
+    Output size_csv_output; /* .size.csv output, when the size breakdown was requested */
+    SizeReport size_report; /* Words per label region and per origin */
+    bool reporting = false; /* Whether `size_report` was started */
+    ImageWriter image; /* Flat image state */
+    FILE* ob = NULL; /* .ob stream */
+    FILE* ent = NULL; /* .ent stream */
+    FILE* ext = NULL; /* .ext stream */
+    char* am_buffer = NULL; /* In-memory preprocessed file, when streaming */
+    size_t am_size = 0; /* Size of am_buffer */
     uint8_t number_of_lines; /* Number of lines in the preprocessed file */
     int ic_length;/* Length of the instruction counter (IC) */
     int padding; /* Computed padding for IC and DC display */
@@ -39,17 +82,85 @@ void assemble(FILE* file, FILE* am, char* base_name) {
     WordList* curr_wl_nptr = NULL; /* Temporary pointer */
     SymbolList* macros = NULL; /* Macros that will be modified by preprocess */
     SymbolList* curr; /* SymbolList iterator variable */
+    DataPool* pool = NULL; /* Shared copies of data blocks, when pooling is enabled */
+    int relaxed = 0; /* Number of direct branches relaxed into relative form */
+    bool collected = false; /* Whether the pipeline already collected the symbols */
+    bool written = false; /* Whether the outputs were written */
+
+    ob_output.stream = NULL;
+    ent_output.stream = NULL;
+    ext_output.stream = NULL;
+    image_output.stream = NULL;
+    map_output.stream = NULL;
+    xref_output.stream = NULL;
+    size_output.stream = NULL;
+    size_csv_output.stream = NULL;
+    source_map_init(&sources);
+
+    if (options->check) {
+        set_error_json(base_name, &sources); /* Errors are reported at their input lines */
+    }
+
+    if (options->mem_stats) {
+        fprintf(options->log, "Memory statistics for %s:\n", base_name);
+        mem_stats_begin_phase();
+    }
+
+    number_of_lines = 0; /* Initialize number of lines counter */
+    if (options->pool_data) {
+        pool = create_data_pool(); /* Collects identical data blocks across both passes */
+    }
 
     /* Step 1: Preprocessing */
-    preprocess(file, preprocessed, &macros); /* Expand macros and preprocess the input file */
+    if (am == NULL) {
+        /* Streaming or batched I/O: keep the preprocessed source in memory rather than in a .am file */
+        preprocessed = open_memstream(&am_buffer, &am_size);
+        if (!preprocessed) {
+            perror("Error buffering preprocessed source");
+            goto cleanup;
+        }
+    }
+
+    if (options->pipeline && !options->check) {
+        /* Steps 1-2 as a pipeline, keeping the symbol table only if it matches the serial first pass */
+        collected = pipeline_first_pass(file, preprocessed, &macros, &symbols,
+                                        &errors, &number_of_lines, pool,
+                                        (options->line_map || options->size_report) ? &sources : NULL, options);
+        if (!collected && pool != NULL) {
+            free_data_pool(pool);
+            pool = create_data_pool(); /* Blocks are interned again by the serial first pass */
+        }
+    } else {
+        preprocess(file, preprocessed, &macros, (options->line_map || options->size_report || options->check) ? &sources : NULL); /* Expand macros and preprocess the input file */
+    }
+
+    if (am == NULL) {
+        fclose(preprocessed);
+        if (!options->check && open_output(&am_output, base_name, OUTPUT_PREPROCESSED, options)) {
+            fwrite(am_buffer, 1, am_size, am_output.stream); /* Keep the .am file (batched I/O only) */
+            if (!close_output(&am_output)) {
+                goto cleanup;
+            }
+        }
+
+        preprocessed = fmemopen(am_buffer, am_size, "r");
+        if (!preprocessed) {
+            perror("Error reading preprocessed source");
+            goto cleanup;
+        }
+    }
+
+    mem_stats_report(options->log, collected ? "preprocess + first pass" : "preprocess");
 
     /* Step 2: First Pass */
     rewind(preprocessed);
 
-    number_of_lines = 0; /* Initialize number of lines counter */
-    first_pass(preprocessed, &symbols, 
-                &errors, &number_of_lines,
-                macros); /* Extract labels and validate syntax, while counting the number of lines and updating number_of_lines */
+    if (!collected) {
+        first_pass(preprocessed, &symbols, 
+                    &errors, &number_of_lines,
+                    macros, pool, options); /* Extract labels and validate syntax, while counting the number of lines and updating number_of_lines */
+        mem_stats_report(options->log, "first pass");
+    }
 
     /* If there are already errors in the first pass, stop the program and perform cleanup */
     if (errors > 0) {
@@ -59,23 +170,86 @@ void assemble(FILE* file, FILE* am, char* base_name) {
 
     /* Step 3: Second Pass */
     rewind(preprocessed); /* Rewind the preprocessed file (also the after macro!) to be read again by second_pass */
+    if (options->stream_encode) {
+        /* The words are written as they are encoded, so their outputs are opened first */
+        if (!open_output(&ob_output, base_name, OUTPUT_OBJECT, options)) {
+            goto cleanup;
+        }
+
+        if (options->line_map && open_output(&map_output, base_name, OUTPUT_LINE_MAP, options)) {
+            line_map_begin(&line_map, map_output.stream, &sources);
+        }
+
+        if (options->size_report) {
+            size_report_begin(&size_report, symbols, &sources);
+            reporting = true;
+        }
+
+        streaming = word_sink_begin(&sink, ob_output.stream,
+                                    map_output.stream ? &line_map : NULL,
+                                    reporting ? &size_report : NULL, options->load_address);
+        if (!streaming) {
+            discard_output(&ob_output);
+            discard_output(&map_output);
+            goto cleanup;
+        }
+    }
+
     second_pass(preprocessed, &symbols, 
                 &inst_list, &data_list, 
-                &ic, &dc, &errors); /* Perform second pass */
+                &ic, &dc, &errors, pool,
+                options, &relaxed, options->xref ? &xref : NULL,
+                streaming ? &sink : NULL); /* Perform second pass */
+
+    mem_stats_report(options->log, "second pass");
+
+    if (pool != NULL && errors == 0) {
+        /* Report what pooling saved in the data section (3 bytes per 24-bit word) */
+        fprintf(options->log, "Data pooling: %d duplicate region(s) merged, %d word(s) (%d bytes) saved\n",
+               pool->merged_blocks, pool->merged_words, pool->merged_words * WORD_BYTES);
+    }
+
+    if (options->relax_branches && errors == 0) {
+        /* Every relaxed branch is one R-tagged word the loader no longer relocates */
+        fprintf(options->log, "Branch relaxation: %d relocation(s) eliminated\n", relaxed);
+    }
 
     /* Only if no errors occured, create output files */
-    if (errors == 0){
-        snprintf(path, sizeof(path), "../outputs/%s.ob", base_name); /* Set the proper path */
-        ob = fopen(path, "w+"); /* Open the path with writing+ perms */
-        if (!ob) {
-            fprintf(stderr, "Error opening .ob file for writing: %s\n", path);
+    if (errors == 0 && options->check) {
+        written = true; /* Syntax check: the input is valid, and nothing is written */
+    } else if (errors == 0){
+        if (!streaming && !open_output(&ob_output, base_name, OUTPUT_OBJECT, options)) {
             goto cleanup; /* Perform cleanup */
         }
+        ob = ob_output.stream;
+
+        if (streaming) {
+            /* The instruction words are written, append the data words and patch the header */
+            word_sink_end(&sink, ic, dc);
+        } else {
+            /* Write the instruction counter (IC) and data counter (DC) to the object file, dynamically */
+            ic_length = snprintf(NULL, 0, "%d", ic); /* Compute length for ic */
+            padding = 9 - ic_length; /* Formula for padding that matches our scenario */
+            fprintf(ob, "%*d %d\n", padding, ic, dc); /* Aligns IC and DC with an 8-character gap */
+        }
+
+        /* The flat image receives the same words as the .ob file, in the same order */
+        if (options->image_format != IMAGE_NONE &&
+            open_output(&image_output, base_name, image_output_kind(options->image_format), options)) {
+            image_begin(&image, options->image_format, image_output.stream,
+                        options->load_address, (unsigned long)ic + dc, base_name);
+        }
 
-        /* Write the instruction counter (IC) and data counter (DC) to the object file, dynamically */
-        ic_length = snprintf(NULL, 0, "%d", ic); /* Compute length for ic */
-        padding = 9 - ic_length; /* Formula for padding that matches our scenario */
-        fprintf(ob, "%*d %d\n", padding, ic, dc); /* Aligns IC and DC with an 8-character gap */
+        /* The line table follows the words to the .ob file */
+        if (options->line_map && !streaming && open_output(&map_output, base_name, OUTPUT_LINE_MAP, options)) {
+            line_map_begin(&line_map, map_output.stream, &sources);
+        }
+
+        /* The size breakdown counts the words as they are written */
+        if (options->size_report && !reporting) {
+            size_report_begin(&size_report, symbols, &sources);
+            reporting = true;
+        }
 
         /* Print out instructions (which come before data) */
         reverse_list(&inst_list); /* Reverse the data list for correct order */
@@ -87,8 +261,12 @@ void assemble(FILE* file, FILE* am, char* base_name) {
         
         /* Traverse the instruction list and process each node */
         while (curr_wl != NULL) {
-            /* Check if the current node represents a line (not a word) */
-            print_word_hex(curr_wl->data.word, &line, ob); /* Output the data instruction to the .ob file */
+            /* Output the instruction word to the .ob file (a line marker only moves the line table) */
+            if (reporting) {
+                size_report_add(&size_report, curr_wl, line, SIZE_CODE);
+            }
+            write_word_node(curr_wl, &line, ob, image_output.stream ? &image : NULL,
+                       map_output.stream ? &line_map : NULL);
 
             /* Store the current node in a temporary pointer for cleanup */
             curr_wl_nptr = curr_wl;
@@ -96,13 +274,8 @@ void assemble(FILE* file, FILE* am, char* base_name) {
             /* Move to the next node in the linked list */
             curr_wl = curr_wl->next;
 
-            /* Free the word in the current node if it is not a line and contains a word */
-            if (!curr_wl_nptr->is_line && curr_wl_nptr->data.word != NULL) {
-                free_word(curr_wl_nptr->data.word); /* Free the dynamically allocated word */
-            }
-
-            /* Free the memory allocated for the current node */
-            free(curr_wl_nptr);
+            /* Free the current node, and its word if it contains one */
+            free_word_node(curr_wl_nptr);
         }
 
         /* Print out directives (which come after instructions) */
@@ -111,8 +284,12 @@ void assemble(FILE* file, FILE* am, char* base_name) {
         
         /* Traverse the instruction list and process each node */
         while (curr_wl != NULL) {
-            /* Check if the current node represents a line (not a word) */
-            print_word_hex(curr_wl->data.word, &line, ob); /* Output the data instruction to the .ob file */
+            /* Output the data word(s) to the .ob file, and to the flat image */
+            if (reporting) {
+                size_report_add(&size_report, curr_wl, line, SIZE_DATA);
+            }
+            write_word_node(curr_wl, &line, ob, image_output.stream ? &image : NULL,
+                       map_output.stream ? &line_map : NULL);
 
             /* Store the current node in a temporary pointer for cleanup */
             curr_wl_nptr = curr_wl;
@@ -120,13 +297,8 @@ void assemble(FILE* file, FILE* am, char* base_name) {
             /* Move to the next node in the linked list */
             curr_wl = curr_wl->next;
 
-            /* Free the word in the current node if it is not a line and contains a word */
-            if (!curr_wl_nptr->is_line && curr_wl_nptr->data.word != NULL) {
-                free_word(curr_wl_nptr->data.word); /* Free the dynamically allocated word */
-            }
-
-            /* Free the memory allocated for the current node */
-            free(curr_wl_nptr);
+            /* Free the current node, and its word if it contains one */
+            free_word_node(curr_wl_nptr);
         }
 
 
@@ -136,6 +308,10 @@ void assemble(FILE* file, FILE* am, char* base_name) {
 
 
 
+        if (image_output.stream) {
+            image_end(&image); /* Flush the last record and the terminator */
+        }
+
         /*
         print_labels(entries);
         */
@@ -152,14 +328,10 @@ void assemble(FILE* file, FILE* am, char* base_name) {
          * where memory_address is padded to 7 digits.
          */
 
-         if (count_symbols_by_type(symbols, SYMBOL_ENTRY) > 0) {
+         if (count_symbols_by_type(symbols, SYMBOL_ENTRY) > 0 &&
+             open_output(&ent_output, base_name, OUTPUT_ENTRIES, options)) {
             /* Create .ent file only when entries exist */
-            snprintf(path, sizeof(path), "../outputs/%s.ent", base_name);
-            ent = fopen(path, "w+");
-            if (!ent) {
-                fprintf(stderr, "Error opening .ent file for writing: %s\n", path);
-                goto cleanup;
-            }
+            ent = ent_output.stream;
 
             /* Write each entry symbol and its resolved address */
             curr = symbols;
@@ -169,42 +341,84 @@ void assemble(FILE* file, FILE* am, char* base_name) {
                 }
                 curr = curr->next;
             }
+        } else {
+            remove_output(base_name, OUTPUT_ENTRIES, options); /* Left by an earlier assembly */
         }
 
         /**
          * @brief Handle external symbols and write to .ext file if any are used
          * 
          * Only creates the .ext file if there are external symbols that were 
-         * actually used in the code (value.number >= START_LINE).
+         * actually used in the code (value.number >= the load address).
          * Each external reference is written in format: "symbol_name usage_address"
          * where usage_address is padded to 7 digits.
          */
-        if (count_symbols_by_type(symbols, SYMBOL_EXTERN) > 0) {
+        if (count_symbols_by_type(symbols, SYMBOL_EXTERN) > 0 &&
+            open_output(&ext_output, base_name, OUTPUT_EXTERNALS, options)) {
             /* Create .ext file only when externals exist and were used */
-            snprintf(path, sizeof(path), "../outputs/%s.ext", base_name);
-            ext = fopen(path, "w+");
-            if (!ext) {
-                fprintf(stderr, "Error opening .ext file for writing: %s\n", path);
-                goto cleanup;
-            }
+            ext = ext_output.stream;
 
             /* Write each external symbol and its usage addresses */
             curr = symbols;
             while (curr != NULL) {
-                /* Only write externals that were actually used (have an address >= START_LINE) */
-                if (curr->symbol_type == SYMBOL_EXTERN && curr->value.number >= START_LINE) {
+                /* Only write externals that were actually used (have an address >= the load address) */
+                if (curr->symbol_type == SYMBOL_EXTERN && curr->value.number >= options->load_address) {
                     fprintf(ext, "%s %07d\n", curr->label, curr->value.number); /* Create .ext line */
                 }
                 curr = curr->next;
             }
+        } else {
+            remove_output(base_name, OUTPUT_EXTERNALS, options); /* Left by an earlier assembly */
+        }
+
+        /* Size breakdown, from the words written above */
+        if (reporting) {
+            open_output(&size_output, base_name, OUTPUT_SIZE_REPORT, options);
+            open_output(&size_csv_output, base_name, OUTPUT_SIZE_CSV, options);
+            size_report_write(&size_report, base_name, size_output.stream, size_csv_output.stream);
+        }
+
+        /* Cross-reference index, from the label declarations and uses of the second pass */
+        if (options->xref && open_output(&xref_output, base_name, OUTPUT_XREF, options)) {
+            xref_write(xref_output.stream, xref, symbols);
         }
+
+        mem_stats_report(options->log, "output");
+        written = true;
     }
 
    /* Cleanup wrapper, significant to avoid memory leaks */
    cleanup:
+        if (streaming && !written) {
+            /* The .ob file and line table hold the words encoded before the errors */
+            word_sink_abort(&sink);
+            discard_output(&ob_output);
+            discard_output(&map_output);
+        }
         if(symbols) free_symbol_list(symbols);
-        if(ob) fclose(ob);
-        if(ent) fclose(ent);
-        if(ext) fclose(ext);
-        return;
+        if(macros) free_symbol_list(macros);
+        if(pool) free_data_pool(pool);
+        written = close_output(&ob_output) && written;
+        written = close_output(&ent_output) && written;
+        written = close_output(&ext_output) && written;
+        written = close_output(&image_output) && written;
+        written = close_output(&map_output) && written;
+        written = close_output(&xref_output) && written;
+        written = close_output(&size_output) && written;
+        written = close_output(&size_csv_output) && written;
+        if (reporting) {
+            size_report_free(&size_report);
+        }
+        xref_free(xref);
+        if (options->check) {
+            set_error_json(NULL, NULL);
+        }
+        source_map_free(&sources);
+        if(am_buffer) {
+            /* Streaming: the preprocessed stream was opened here over am_buffer */
+            if(preprocessed) fclose(preprocessed);
+            free(am_buffer);
+        }
+        mem_stats_report(options->log, "cleanup");
+        return written;
 }
\ No newline at end of file
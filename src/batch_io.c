@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L /* fmemopen */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../header/batch_io.h"
+#include "../header/options.h"
+#include "../header/trace.h"
+#include "../header/output.h"
+
+/**
+ * @brief State shared by the assembler and the I/O threads.
+ */
+static struct {
+    bool active;                 /* true while batched I/O is running */
+    pthread_mutex_t lock;        /* Guards every field below */
+    pthread_cond_t changed;      /* Signaled whenever a field below changes */
+    PrefetchSlot *inputs;        /* Inputs, in assembly order */
+    int count;                   /* Number of inputs */
+    int next_fetch;              /* Next input to prefetch */
+    int next_use;                /* Next input to hand to the assembler */
+    int window;                  /* Inputs prefetched ahead of the assembler */
+    int current;                 /* Input currently assembled */
+    WriteJob *writes_head;       /* Oldest queued output */
+    WriteJob *writes_tail;       /* Newest queued output */
+    bool finishing;              /* Set by `batch_io_finish` */
+    bool if_changed;             /* Whether files are only replaced when their contents changed */
+    bool write_failed;           /* Set by the writer thread when an output could not be written */
+    pthread_t readers[MAX_JOBS]; /* Prefetching threads */
+    int readers_count;           /* Number of prefetching threads */
+    pthread_t writer;            /* Writer thread */
+} io;
+
+/**
+ * @brief Prefetching thread: reads upcoming inputs into memory.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void* prefetch_inputs(void *arg) {
+    PrefetchSlot *slot; /* Input being read */
+    FILE *file; /* Input file */
+    char *buffer; /* Contents read */
+    size_t size = 0; /* Size of the contents */
+    int error; /* errno of a failed read */
+
+    (void)arg;
+    pthread_mutex_lock(&io.lock);
+    while (1) {
+        while (!io.finishing && io.next_fetch < io.count &&
+               io.next_fetch >= io.next_use + io.window) {
+            pthread_cond_wait(&io.changed, &io.lock); /* Far enough ahead */
+        }
+
+        if (io.finishing || io.next_fetch >= io.count) {
+            break;
+        }
+
+        slot = &io.inputs[io.next_fetch++];
+        pthread_mutex_unlock(&io.lock);
+
+        buffer = NULL;
+        error = ENAMETOOLONG;
+        file = slot->path ? fopen(slot->path, "r") : NULL;
+        if (file) {
+            buffer = read_stream(file, &size);
+            error = ENOMEM;
+            fclose(file);
+        } else if (slot->path) {
+            error = errno;
+        }
+
+        pthread_mutex_lock(&io.lock);
+        slot->buffer = buffer;
+        slot->size = size;
+        slot->error = error;
+        slot->ready = true;
+        pthread_cond_broadcast(&io.changed);
+    }
+
+    pthread_mutex_unlock(&io.lock);
+    return NULL;
+}
+
+/**
+ * @brief Writer thread: writes queued outputs, a whole batch at a time.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void* write_outputs(void *arg) {
+    WriteJob *batch; /* Outputs taken from the queue */
+    WriteJob *next; /* Next output of the batch */
+    FILE *file; /* Output file */
+    TraceSpan span; /* Span of the file being written */
+    bool written; /* Whether the file was written */
+
+    (void)arg;
+    pthread_mutex_lock(&io.lock);
+    while (1) {
+        while (io.writes_head == NULL && !io.finishing) {
+            pthread_cond_wait(&io.changed, &io.lock);
+        }
+
+        if (io.writes_head == NULL) {
+            break; /* Finishing, and nothing left to write */
+        }
+
+        batch = io.writes_head;
+        io.writes_head = NULL;
+        io.writes_tail = NULL;
+        pthread_mutex_unlock(&io.lock);
+
+        for (; batch != NULL; batch = next) {
+            next = batch->next;
+            trace_begin(&span, batch->remove ? "remove_file" : "write_file", batch->path);
+            if (batch->remove) {
+                remove(batch->path); /* Fails harmlessly if there is no such file */
+                written = true;
+            } else if (io.if_changed) {
+                written = replace_if_changed(batch->path, batch->buffer, batch->size);
+            } else {
+                remove(batch->path); /* Replace the file, which may be a hard link into the cache */
+                file = fopen(batch->path, "w+");
+                written = file != NULL;
+                if (!file) {
+                    fprintf(stderr, "Error opening file for writing: %s\n", batch->path);
+                } else {
+                    written = fwrite(batch->buffer, 1, batch->size, file) == batch->size;
+                    written = (fclose(file) == 0) && written;
+                    if (!written) {
+                        fprintf(stderr, "Error writing file: %s\n", batch->path);
+                    }
+                }
+            }
+            trace_end(&span);
+
+            if (!written) {
+                pthread_mutex_lock(&io.lock);
+                io.write_failed = true;
+                pthread_mutex_unlock(&io.lock);
+            }
+
+            free(batch->path);
+            free(batch->buffer);
+            free(batch);
+        }
+
+        pthread_mutex_lock(&io.lock);
+    }
+
+    pthread_mutex_unlock(&io.lock);
+    return NULL;
+}
+
+bool batch_io_start(int threads, char **paths, int count, bool if_changed) {
+    int i; /* Loop variable */
+
+    io.inputs = (PrefetchSlot *)calloc(count > 0 ? count : 1, sizeof(PrefetchSlot));
+    if (!io.inputs) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < count; i++) {
+        io.inputs[i].path = paths[i];
+    }
+
+    io.count = count;
+    io.next_fetch = 0;
+    io.next_use = 0;
+    io.window = threads * BATCH_IO_WINDOW;
+    io.current = -1;
+    io.writes_head = NULL;
+    io.writes_tail = NULL;
+    io.finishing = false;
+    io.if_changed = if_changed;
+    io.write_failed = false;
+    io.readers_count = 0;
+    pthread_mutex_init(&io.lock, NULL);
+    pthread_cond_init(&io.changed, NULL);
+
+    if (pthread_create(&io.writer, NULL, write_outputs, NULL) != 0) {
+        pthread_mutex_destroy(&io.lock);
+        pthread_cond_destroy(&io.changed);
+        free(io.inputs);
+        return false;
+    }
+
+    for (i = 0; i < threads && i < MAX_JOBS; i++) {
+        if (pthread_create(&io.readers[io.readers_count], NULL, prefetch_inputs, NULL) == 0) {
+            io.readers_count++;
+        }
+    }
+
+    io.active = true;
+    if (io.readers_count == 0) {
+        batch_io_finish(); /* No prefetching thread could be started */
+        return false;
+    }
+
+    return true;
+}
+
+bool batch_io_active(void) {
+    return io.active;
+}
+
+FILE* batch_io_next_input(void) {
+    PrefetchSlot *slot; /* Input to open */
+    FILE *file; /* Stream over the input */
+
+    pthread_mutex_lock(&io.lock);
+    io.current = io.next_use++;
+    slot = &io.inputs[io.current];
+    pthread_cond_broadcast(&io.changed); /* Room to prefetch one more input */
+    while (!slot->ready) {
+        pthread_cond_wait(&io.changed, &io.lock);
+    }
+    pthread_mutex_unlock(&io.lock);
+
+    if (slot->buffer == NULL) {
+        errno = slot->error;
+        return NULL;
+    }
+
+    file = fmemopen(slot->buffer, slot->size, "r");
+    if (!file) {
+        free(slot->buffer);
+        slot->buffer = NULL;
+    }
+
+    return file;
+}
+
+void batch_io_close_input(FILE *file) {
+    fclose(file);
+    free(io.inputs[io.current].buffer);
+    io.inputs[io.current].buffer = NULL;
+}
+
+/**
+ * @brief Queues a job to the writer thread.
+ *
+ * @param path Path of the output file (ownership is taken).
+ * @param buffer Contents of the output (ownership is taken), NULL for a removal.
+ * @param size Size of `buffer`.
+ * @param remove true to remove the file rather than write it.
+ */
+static void queue_job(char *path, char *buffer, size_t size, bool remove) {
+    WriteJob *job = (WriteJob *)malloc(sizeof(WriteJob));
+    if (!job) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    job->path = path;
+    job->buffer = buffer;
+    job->size = size;
+    job->remove = remove;
+    job->next = NULL;
+
+    pthread_mutex_lock(&io.lock);
+    if (io.writes_tail) {
+        io.writes_tail->next = job;
+    } else {
+        io.writes_head = job;
+    }
+    io.writes_tail = job;
+    pthread_cond_broadcast(&io.changed);
+    pthread_mutex_unlock(&io.lock);
+}
+
+void batch_io_write(char *path, char *buffer, size_t size) {
+    queue_job(path, buffer, size, false);
+}
+
+void batch_io_remove(char *path) {
+    queue_job(path, NULL, 0, true);
+}
+
+bool batch_io_finish(void) {
+    int i; /* Loop variable */
+
+    if (!io.active) {
+        return true;
+    }
+
+    pthread_mutex_lock(&io.lock);
+    io.finishing = true;
+    pthread_cond_broadcast(&io.changed);
+    pthread_mutex_unlock(&io.lock);
+
+    for (i = 0; i < io.readers_count; i++) {
+        pthread_join(io.readers[i], NULL);
+    }
+    pthread_join(io.writer, NULL);
+
+    for (i = 0; i < io.count; i++) {
+        free(io.inputs[i].buffer); /* Prefetched but never assembled */
+    }
+
+    free(io.inputs);
+    pthread_mutex_destroy(&io.lock);
+    pthread_cond_destroy(&io.changed);
+    io.active = false;
+    return !io.write_failed;
+}
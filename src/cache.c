@@ -0,0 +1,542 @@
+#define _POSIX_C_SOURCE 200809L /* link, mkdir, opendir, utime, getpid */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../header/cache.h"
+#include "../header/assembler.h"
+#include "../header/output.h"
+#include "../header/include.h"
+#include "../header/macro_snapshot.h"
+
+#define CACHE_PATH_SIZE 512 /* Size of the paths built inside the cache */
+
+/**
+ * @brief State of the cache for the run.
+ */
+static struct {
+    bool active;                   /* true while the cache is open */
+    char dir[CACHE_PATH_SIZE];     /* Cache directory */
+    long max_bytes;                /* Bound of the cache */
+    long total_bytes;              /* Total size of the entries */
+    CacheEntry *entries;           /* Entries of the cache */
+    uint64_t version;              /* Hash of the assembler version */
+    bool recording;                /* true while the outputs of a missed input are recorded */
+    bool succeeded;                /* true once the .ob output of the input was recorded */
+    char key[CACHE_KEY_SIZE];      /* Key of the recorded input */
+    char staging[CACHE_PATH_SIZE]; /* Temporary directory receiving the recorded outputs */
+    long staged_bytes;             /* Size of the recorded outputs */
+    int staged_count;              /* Number of temporary directories created */
+    int hits;                      /* Inputs restored from the cache */
+    int misses;                    /* Inputs assembled */
+    int stores;                    /* Entries stored */
+    int evictions;                 /* Entries evicted */
+} cache;
+
+/**
+ * @brief Returns the FNV-1a offset basis.
+ *
+ * @return The initial hash.
+ */
+static uint64_t hash_init(void) {
+    return (uint64_t)0xcbf29ce4UL << 32 | 0x84222325UL;
+}
+
+/**
+ * @brief Adds bytes to an FNV-1a hash.
+ *
+ * @param hash The hash so far.
+ * @param bytes The bytes to add.
+ * @param size The number of bytes.
+ * @return The updated hash.
+ */
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size) {
+    const unsigned char *p = (const unsigned char *)bytes;
+    const uint64_t prime = (uint64_t)1 << 40 | 0x1b3; /* FNV 64-bit prime */
+    size_t i; /* Loop variable */
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * prime;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Hashes the assembler version: its version string, then its executable when readable.
+ *
+ * @return The hash.
+ */
+static uint64_t hash_version(void) {
+    uint64_t hash = hash_bytes(hash_init(), ASSEMBLER_VERSION, sizeof(ASSEMBLER_VERSION));
+    FILE *exe = fopen("/proc/self/exe", "rb"); /* The running assembler */
+    char buffer[4096]; /* Bytes read from the executable */
+    size_t read; /* Number of bytes read */
+
+    if (exe) {
+        /* A rebuilt assembler never reuses the outputs of an older one */
+        while ((read = fread(buffer, 1, sizeof(buffer), exe)) > 0) {
+            hash = hash_bytes(hash, buffer, read);
+        }
+        fclose(exe);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Adds an included file to the key of an input.
+ *
+ * @param unit The included file.
+ * @param arg The hash so far, updated.
+ */
+static void hash_include(IncludeUnit *unit, void *arg) {
+    uint64_t *hash = (uint64_t *)arg;
+
+    *hash = hash_bytes(*hash, unit->name, strlen(unit->name) + 1);
+    *hash = hash_bytes(*hash, unit->data != NULL ? "+" : "-", 1); /* Whether the file exists */
+    if (unit->data != NULL) {
+        *hash = hash_bytes(*hash, unit->data, unit->size);
+    }
+}
+
+/**
+ * @brief Builds the path of a file inside the cache.
+ *
+ * @param path Output buffer, CACHE_PATH_SIZE bytes.
+ * @param entry The entry (or temporary) directory.
+ * @param name The file name, or NULL for the directory itself.
+ * @return true if the path fits, false otherwise.
+ */
+static bool cache_path(char *path, const char *entry, const char *name) {
+    int res; /* Result of formatting the path */
+
+    if (name == NULL) {
+        res = snprintf(path, CACHE_PATH_SIZE, "%s/%s", cache.dir, entry);
+    } else {
+        res = snprintf(path, CACHE_PATH_SIZE, "%s/%s/%s", cache.dir, entry, name);
+    }
+
+    return res >= 0 && res < CACHE_PATH_SIZE;
+}
+
+/**
+ * @brief Sums the sizes of the files of a directory.
+ *
+ * @param dir Path of the directory.
+ * @return The total size in bytes, or -1 if the directory cannot be read.
+ */
+static long directory_size(const char *dir) {
+    DIR *handle = opendir(dir);
+    struct dirent *file; /* File of the directory */
+    struct stat info; /* Status of the file */
+    char path[CACHE_PATH_SIZE]; /* Path of the file */
+    long size = 0; /* Total size */
+
+    if (!handle) {
+        return -1;
+    }
+
+    while ((file = readdir(handle)) != NULL) {
+        if (file->d_name[0] != '.' &&
+            snprintf(path, sizeof(path), "%s/%s", dir, file->d_name) < (int)sizeof(path) &&
+            stat(path, &info) == 0) {
+            size += (long)info.st_size;
+        }
+    }
+
+    closedir(handle);
+    return size;
+}
+
+/**
+ * @brief Removes a directory and its files.
+ *
+ * @param dir Path of the directory.
+ */
+static void remove_directory(const char *dir) {
+    DIR *handle = opendir(dir);
+    struct dirent *file; /* File of the directory */
+    char path[CACHE_PATH_SIZE]; /* Path of the file */
+
+    if (handle) {
+        while ((file = readdir(handle)) != NULL) {
+            if (file->d_name[0] != '.' &&
+                snprintf(path, sizeof(path), "%s/%s", dir, file->d_name) < (int)sizeof(path)) {
+                remove(path);
+            }
+        }
+        closedir(handle);
+    }
+
+    rmdir(dir);
+}
+
+/**
+ * @brief Tells whether a name is a cache key.
+ *
+ * @param name The name.
+ * @return true if it is made of CACHE_KEY_SIZE - 1 hexadecimal digits.
+ */
+static bool is_key(const char *name) {
+    int i; /* Loop variable */
+
+    for (i = 0; i < CACHE_KEY_SIZE - 1; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f'))) {
+            return false;
+        }
+    }
+
+    return name[i] == '\0';
+}
+
+/**
+ * @brief Adds an entry to the in-memory index.
+ *
+ * @param key The key of the entry.
+ * @param size The size of the entry.
+ * @param used The last use of the entry.
+ */
+static void add_entry(const char *key, long size, time_t used) {
+    CacheEntry *entry = (CacheEntry *)malloc(sizeof(CacheEntry));
+
+    if (!entry) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(entry->key, key);
+    entry->size = size;
+    entry->used = used;
+    entry->next = cache.entries;
+    cache.entries = entry;
+    cache.total_bytes += size;
+}
+
+/**
+ * @brief Finds an entry of the in-memory index.
+ *
+ * @param key The key of the entry.
+ * @return The entry, or NULL if the key is not cached.
+ */
+static CacheEntry* find_entry(const char *key) {
+    CacheEntry *entry; /* Entry iterator */
+
+    for (entry = cache.entries; entry != NULL; entry = entry->next) {
+        if (!strcmp(entry->key, key)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Evicts the least recently used entries until the cache fits its bound.
+ */
+static void evict(void) {
+    CacheEntry **oldest; /* Link to the least recently used entry */
+    CacheEntry **walk; /* Link iterator */
+    CacheEntry *victim; /* Entry being evicted */
+    char path[CACHE_PATH_SIZE]; /* Directory of the entry */
+
+    while (cache.total_bytes > cache.max_bytes && cache.entries != NULL) {
+        oldest = &cache.entries;
+        for (walk = &cache.entries; *walk != NULL; walk = &(*walk)->next) {
+            if ((*walk)->used <= (*oldest)->used) {
+                oldest = walk; /* Ties go to the entry indexed first, i.e. the one stored earlier */
+            }
+        }
+
+        victim = *oldest;
+        *oldest = victim->next;
+        if (cache_path(path, victim->key, NULL)) {
+            remove_directory(path);
+        }
+
+        cache.total_bytes -= victim->size;
+        cache.evictions++;
+        free(victim);
+    }
+}
+
+/**
+ * @brief Copies a file.
+ *
+ * @param from The source file.
+ * @param to The destination file, replaced if it exists.
+ * @return true on success, false otherwise.
+ */
+static bool copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    FILE *out; /* The destination */
+    char buffer[4096]; /* Bytes being copied */
+    size_t read; /* Number of bytes read */
+    bool ok = true; /* Whether every byte was written */
+
+    if (!in) {
+        return false;
+    }
+
+    out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = ok && fwrite(buffer, 1, read, out) == read;
+    }
+
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+/**
+ * @brief Places a file at a path, as a hard link when possible, as a copy otherwise.
+ *
+ * The placed file is marked as modified now: a link would keep the time the
+ * entry was stored, older than the outputs it replaces.
+ *
+ * @param from The existing file.
+ * @param to The path to place it at, replaced if it exists.
+ * @return true on success, false otherwise.
+ */
+static bool place_file(const char *from, const char *to) {
+    remove(to);
+    return (link(from, to) == 0 || copy_file(from, to)) && utime(to, NULL) == 0;
+}
+
+/**
+ * @brief Restores a stored output, leaving an identical existing file untouched (--write-if-changed).
+ *
+ * @param from The stored output.
+ * @param to The path to restore it at.
+ * @param if_changed true to only replace the file when its contents differ.
+ * @return true on success, false otherwise.
+ */
+static bool restore_file(const char *from, const char *to, bool if_changed) {
+    FILE *file; /* The stored output */
+    char *buffer; /* Contents of the stored output */
+    size_t size; /* Size of `buffer` */
+    bool restored; /* Whether the output is in place */
+
+    if (!if_changed) {
+        return place_file(from, to);
+    }
+
+    file = fopen(from, "rb");
+    if (!file) {
+        return false;
+    }
+
+    buffer = read_stream(file, &size);
+    fclose(file);
+    if (!buffer) {
+        return false;
+    }
+
+    restored = replace_if_changed(to, buffer, size); /* Keeps the modification time of an identical file */
+    free(buffer);
+    return restored;
+}
+
+bool cache_open(const char *dir, long max_kib) {
+    DIR *handle; /* The cache directory */
+    struct dirent *file; /* Entry of the directory */
+    struct stat info; /* Status of an entry */
+    char path[CACHE_PATH_SIZE]; /* Directory of an entry */
+    long size; /* Size of an entry */
+
+    if (strlen(dir) + CACHE_KEY_SIZE + 32 >= CACHE_PATH_SIZE) {
+        fprintf(stderr, "Cache directory path is too long: %s\n", dir);
+        return false;
+    }
+
+    mkdir(dir, 0777); /* Fails harmlessly if it exists */
+    handle = opendir(dir);
+    if (!handle) {
+        fprintf(stderr, "Error opening cache directory: %s\n", dir);
+        return false;
+    }
+
+    memset(&cache, 0, sizeof(cache));
+    strcpy(cache.dir, dir);
+    cache.max_bytes = max_kib * 1024;
+
+    /* Index the entries stored by earlier runs */
+    while ((file = readdir(handle)) != NULL) {
+        if (is_key(file->d_name) && cache_path(path, file->d_name, NULL) &&
+            stat(path, &info) == 0 && S_ISDIR(info.st_mode) &&
+            (size = directory_size(path)) >= 0) {
+            add_entry(file->d_name, size, info.st_mtime);
+        }
+    }
+    closedir(handle);
+
+    cache.version = hash_version();
+    cache.active = true;
+    evict(); /* The bound may have shrunk since the last run */
+    return true;
+}
+
+bool cache_active(void) {
+    return cache.active;
+}
+
+bool cache_lookup(const char *source, size_t size, const char *base_name,
+                  const AssemblerOptions *options) {
+    uint64_t hash = cache.version; /* Key of the input */
+    char settings[96]; /* Options that change the outputs */
+    char from[CACHE_PATH_SIZE]; /* Output stored in the entry */
+    char to[CACHE_PATH_SIZE]; /* Output restored from the entry */
+    char extension[16]; /* Extension of a stored output */
+    CacheEntry *entry; /* The input's entry */
+    DIR *handle; /* Directory of the entry */
+    struct dirent *file; /* Output stored in the entry */
+    bool restored = true; /* Whether every output was restored */
+    bool entries = false; /* Whether the entry stores a .ent output */
+    bool externals = false; /* Whether the entry stores a .ext output */
+
+    if (!cache.active) {
+        return false;
+    }
+
+    sprintf(settings, "pool=%d relax=%d format=%d load=%u map=%d xref=%d encode=%d size=%d macros=%08lx",
+            options->pool_data, options->relax_branches,
+            (int)options->image_format, (unsigned)options->load_address, options->line_map,
+            options->xref, options->stream_encode, options->size_report,
+            (unsigned long)macro_snapshot_checksum()); /* Inputs may expand the snapshot's macros */
+    hash = hash_bytes(hash, settings, strlen(settings) + 1);
+    if (options->image_format != IMAGE_NONE) {
+        hash = hash_bytes(hash, base_name, strlen(base_name) + 1); /* S-records embed the name */
+    }
+    hash = hash_bytes(hash, source, size);
+    include_visit(source, size, hash_include, &hash); /* Every file it includes, directly or not */
+    sprintf(cache.key, "%08lx%08lx", (unsigned long)(hash >> 32), (unsigned long)(hash & 0xFFFFFFFFUL));
+
+    entry = find_entry(cache.key);
+    if (entry != NULL && cache_path(from, entry->key, NULL) && (handle = opendir(from)) != NULL) {
+        while ((file = readdir(handle)) != NULL) {
+            if (file->d_name[0] == '.' || strlen(file->d_name) >= sizeof(extension)) {
+                continue;
+            }
+
+            strcpy(extension, file->d_name);
+            entries = entries || !strcmp(extension, output_extension(OUTPUT_ENTRIES));
+            externals = externals || !strcmp(extension, output_extension(OUTPUT_EXTERNALS));
+            if (!cache_path(from, entry->key, extension) ||
+                snprintf(to, sizeof(to), "%s%s.%s", options->output_dir, base_name, extension) >= (int)sizeof(to) ||
+                !restore_file(from, to, options->write_if_changed)) {
+                restored = false;
+            }
+        }
+        closedir(handle);
+
+        if (restored) {
+            /* Outputs the input does not produce must not be left from an earlier assembly */
+            if (!entries) {
+                remove_output(base_name, OUTPUT_ENTRIES, options);
+            }
+            if (!externals) {
+                remove_output(base_name, OUTPUT_EXTERNALS, options);
+            }
+
+            cache_path(from, entry->key, NULL);
+            utime(from, NULL); /* Mark the entry as recently used, for later runs */
+            entry->used = time(NULL);
+            cache.hits++;
+            return true;
+        }
+    }
+
+    /* Miss: record the outputs of the assembly in a temporary directory */
+    cache.misses++;
+    sprintf(to, "tmp-%ld-%d", (long)getpid(), cache.staged_count++);
+    cache.recording = cache_path(cache.staging, to, NULL) && mkdir(cache.staging, 0777) == 0;
+    cache.succeeded = false;
+    cache.staged_bytes = 0;
+    return false;
+}
+
+void cache_record(const char *extension, const char *path, const char *buffer, size_t size) {
+    char stored[CACHE_PATH_SIZE]; /* The output, inside the temporary directory */
+    FILE *file; /* The stored output, when written from a buffer */
+    struct stat info; /* Status of the stored output */
+    int res; /* Result of formatting the path */
+
+    if (!cache.recording) {
+        return;
+    }
+
+    res = snprintf(stored, sizeof(stored), "%s/%s", cache.staging, extension);
+    if (res < 0 || res >= (int)sizeof(stored)) {
+        cache.recording = false; /* The entry would be incomplete */
+        return;
+    }
+
+    if (path != NULL) {
+        cache.recording = place_file(path, stored);
+    } else {
+        file = fopen(stored, "wb");
+        cache.recording = file != NULL && fwrite(buffer, 1, size, file) == size;
+        if (file && fclose(file) != 0) {
+            cache.recording = false;
+        }
+    }
+
+    if (cache.recording && stat(stored, &info) == 0) {
+        cache.staged_bytes += (long)info.st_size;
+    }
+
+    if (!strcmp(extension, output_extension(OUTPUT_OBJECT))) {
+        cache.succeeded = true;
+    }
+}
+
+void cache_commit(void) {
+    char path[CACHE_PATH_SIZE]; /* Directory of the new entry */
+
+    if (cache.staging[0] == '\0') {
+        return; /* Nothing was recorded */
+    }
+
+    if (cache.recording && cache.succeeded && find_entry(cache.key) == NULL &&
+        cache_path(path, cache.key, NULL) && rename(cache.staging, path) == 0) {
+        add_entry(cache.key, cache.staged_bytes, time(NULL));
+        cache.stores++;
+        evict();
+    } else {
+        remove_directory(cache.staging); /* Failed assembly, or stored meanwhile by another run */
+    }
+
+    cache.recording = false;
+    cache.staging[0] = '\0';
+}
+
+void cache_close(FILE *log) {
+    CacheEntry *entry; /* Entry being freed */
+
+    if (!cache.active) {
+        return;
+    }
+
+    fprintf(log, "Cache: %d hit(s), %d miss(es), %d stored, %d evicted, %ld of %ld KiB used\n",
+            cache.hits, cache.misses, cache.stores, cache.evictions,
+            (cache.total_bytes + 1023) / 1024, cache.max_bytes / 1024);
+
+    while (cache.entries != NULL) {
+        entry = cache.entries;
+        cache.entries = entry->next;
+        free(entry);
+    }
+
+    cache.active = false;
+}
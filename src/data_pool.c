@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/data_pool.h"
+#include "../header/validators.h"
+#include "../header/scanner.h"
+
+/**
+ * @brief Computes the FNV-1a hash of a block's values.
+ *
+ * @param values The block's values.
+ * @param length The number of values in the block.
+ * @return The 32-bit hash of the block.
+ */
+static uint32_t hash_block(const int16_t *values, int length) {
+    uint32_t hash = 2166136261u; /* FNV offset basis */
+    int i; /* Loop variable */
+
+    for (i = 0; i < length; i++) {
+        hash ^= (uint32_t)(values[i] & 0xFF);
+        hash *= 16777619u; /* FNV prime */
+        hash ^= (uint32_t)((values[i] >> 8) & 0xFF);
+        hash *= 16777619u;
+    }
+
+    return hash ^ (uint32_t)length;
+}
+
+DataPool* create_data_pool(void) {
+    DataPool *pool = (DataPool *)calloc(1, sizeof(DataPool));
+    if (!pool) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    return pool;
+}
+
+int parse_data_block(const char *directive, char *metadata, int16_t *values, int max_values) {
+    int length = 0; /* Number of values parsed */
+    char *current; /* Current position in the operands */
+    char *number_start; /* Start position of a numeric value */
+    char temp; /* Temporary character storage */
+
+    if (metadata == NULL) {
+        return 0;
+    }
+
+    if (!strcmp(directive, ".data")) {
+        /* Same splitting as second_pass: comma separated, leading spaces skipped */
+        current = metadata;
+        while (*current != '\0' && length < max_values) {
+            skip_leading_spaces(&current);
+            number_start = current;
+
+            current = scan_find(current, SCAN_COMMA);
+
+            temp = *current;
+            *current = '\0';
+            if (!is_valid_number(number_start)) {
+                *current = temp;
+                break; /* Reported by second_pass */
+            }
+
+            values[length++] = (int8_t)atoi(number_start);
+            *current = temp;
+            if (*current == ',') {
+                current++;
+            }
+        }
+    } else if (!strcmp(directive, ".string") && is_valid_string(metadata)) {
+        /* Characters up to the closing quote, followed by a null terminator */
+        metadata++;
+        while (*metadata != '"' && *metadata != '\0' && length < max_values - 1) {
+            values[length++] = (int8_t)(*metadata);
+            metadata++;
+        }
+
+        values[length++] = 0;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Gives the next data directive its ordinal, growing the merge decisions to cover it.
+ *
+ * @param pool The data pool.
+ * @return The ordinal of the directive.
+ */
+static int add_directive(DataPool *pool) {
+    int ordinal = pool->directives++; /* Index of this directive */
+    int capacity; /* Grown size of the merge decisions */
+    bool *merged; /* Grown merge decisions */
+
+    if (ordinal >= pool->capacity) {
+        capacity = pool->capacity ? pool->capacity * 2 : 32;
+        merged = (bool *)realloc(pool->merged, capacity * sizeof(bool));
+        if (!merged) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(merged + pool->capacity, 0, (capacity - pool->capacity) * sizeof(bool));
+        pool->merged = merged;
+        pool->capacity = capacity;
+    }
+
+    return ordinal;
+}
+
+/**
+ * @brief Opens a new region at the data counter.
+ *
+ * @param pool The data pool, whose open region was ended.
+ * @param dc The data counter at the region's first directive.
+ * @param labelled Whether the region starts with a label.
+ */
+static void open_region(DataPool *pool, int16_t dc, bool labelled) {
+    pool->region_open = true;
+    pool->region_labelled = labelled;
+    pool->region_opaque = false;
+    pool->region_dc = dc;
+    pool->region_length = 0;
+    pool->region_first = pool->directives;
+    pool->region_directives = 0;
+}
+
+void pool_add_block(DataPool *pool, const int16_t *values, int length,
+                    int16_t dc, bool labelled) {
+    int16_t *grown; /* Grown values of the region */
+    int capacity; /* Grown capacity of the region */
+
+    if (labelled || !pool->region_open) {
+        open_region(pool, dc, labelled);
+    }
+
+    if (pool->region_length + length > pool->region_capacity) {
+        capacity = pool->region_capacity ? pool->region_capacity : 64;
+        while (capacity < pool->region_length + length) {
+            capacity *= 2;
+        }
+
+        grown = (int16_t *)realloc(pool->region, capacity * sizeof(int16_t));
+        if (!grown) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        pool->region = grown;
+        pool->region_capacity = capacity;
+    }
+
+    memcpy(pool->region + pool->region_length, values, length * sizeof(int16_t));
+    pool->region_length += length;
+    pool->region_directives++;
+    add_directive(pool);
+}
+
+void pool_add_reservation(DataPool *pool, int16_t dc, bool labelled) {
+    if (labelled || !pool->region_open) {
+        open_region(pool, dc, labelled);
+    }
+
+    pool->region_opaque = true; /* Its words are not known to the pool */
+}
+
+bool pool_end_region(DataPool *pool, int16_t *offset, int *length) {
+    uint32_t hash; /* Hash of the region's values */
+    DataBlock **bucket; /* Bucket of the region */
+    DataBlock *block; /* Bucket iterator, or the newly stored block */
+    int i; /* Loop variable */
+
+    if (!pool->region_open) {
+        return false;
+    }
+
+    pool->region_open = false;
+    if (pool->region_opaque || pool->region_length == 0) {
+        return false; /* Nothing to share */
+    }
+
+    /* Look for an identical region stored earlier */
+    hash = hash_block(pool->region, pool->region_length);
+    bucket = &pool->buckets[hash % POOL_BUCKETS];
+    for (block = *bucket; block != NULL; block = block->next) {
+        if (block->hash == hash && block->length == pool->region_length &&
+            !memcmp(block->values, pool->region, pool->region_length * sizeof(int16_t))) {
+            if (!pool->region_labelled) {
+                return false; /* Unlabelled data stays in place */
+            }
+
+            for (i = 0; i < pool->region_directives; i++) {
+                pool->merged[pool->region_first + i] = true;
+            }
+            pool->merged_blocks++;
+            pool->merged_words += pool->region_length;
+            *offset = block->offset;
+            *length = pool->region_length;
+            return true;
+        }
+    }
+
+    /* First occurrence: store it as the shared copy */
+    block = (DataBlock *)malloc(sizeof(DataBlock));
+    if (!block) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    block->values = (int16_t *)malloc(pool->region_length * sizeof(int16_t));
+    if (!block->values) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(block->values, pool->region, pool->region_length * sizeof(int16_t));
+    block->hash = hash;
+    block->length = pool->region_length;
+    block->offset = pool->region_dc;
+    block->next = *bucket;
+    *bucket = block;
+    return false;
+}
+
+bool pool_is_merged(DataPool *pool, int ordinal) {
+    if (pool == NULL || ordinal >= pool->capacity) {
+        return false;
+    }
+
+    return pool->merged[ordinal];
+}
+
+void free_data_pool(DataPool *pool) {
+    DataBlock *block; /* Bucket iterator */
+    DataBlock *next; /* Next block to free */
+    int i; /* Loop variable */
+
+    if (pool == NULL) {
+        return;
+    }
+
+    for (i = 0; i < POOL_BUCKETS; i++) {
+        for (block = pool->buckets[i]; block != NULL; block = next) {
+            next = block->next;
+            free(block->values);
+            free(block);
+        }
+    }
+
+    free(pool->merged);
+    free(pool->region);
+    free(pool);
+}
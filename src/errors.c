@@ -43,11 +43,115 @@ char *errors_table[] = {
     "Extern and entry cannot have the same name",               /* CONFLICTING_ENTRY_AND_EXTERN */
     "Macro with that name already exists",                      /* MACRO_ALREADY_DEFINED */
     "Macro name conflicts with a command",                      /* MACRO_NAME_IS_COMMAND */
-    "Label name conflicts with a macro name"                    /* LABEL_IS_MACRO_NAME */
+    "Label name conflicts with a macro name",                   /* LABEL_IS_MACRO_NAME */
+
+    /* Include errors */
+    "Invalid .include, expected a quoted file name",            /* INVALID_INCLUDE */
+    "Included file cannot be read",                             /* INCLUDE_NOT_FOUND */
+
+    /* Reservation errors */
+    "Invalid size in .space declaration, expected 1 to 4096",   /* INVALID_SPACE_SIZE */
+    "Invalid .incbin, or its range is empty, too large or outside the file", /* INVALID_INCBIN */
+    "The image does not fit in the address space, its words go past address 32767", /* IMAGE_TOO_LARGE */
+    "Too many .incbin directives assembled at once, at most 65536" /* TOO_MANY_INCBINS */
 };
 
+FILE *error_stream = NULL; /* Stream error messages are printed to, stdout when NULL */
+__thread FILE *thread_error_stream = NULL; /* Stream of this thread's error messages, error_stream when NULL */
+__thread bool errors_muted = false; /* true while error messages of this thread are silenced */
+const char *json_file = NULL; /* Input named by JSON messages, plain messages when NULL (--check) */
+const SourceMap *json_sources = NULL; /* Origins of the preprocessed lines, for JSON messages */
+
+void mute_errors(bool muted) {
+    errors_muted = muted;
+}
+
+void set_error_stream(FILE *stream) {
+    error_stream = stream;
+}
+
+void set_thread_error_stream(FILE *stream) {
+    thread_error_stream = stream;
+}
+
+void set_error_json(const char *file, const SourceMap *sources) {
+    json_file = file;
+    json_sources = sources;
+}
+
+/**
+ * @brief Returns the stream error messages of the calling thread are printed to.
+ * 
+ * @return The stream.
+ */
+static FILE* current_error_stream(void) {
+    if (thread_error_stream) {
+        return thread_error_stream;
+    }
+
+    return error_stream ? error_stream : stdout;
+}
+
+/**
+ * @brief Writes a JSON string, or null.
+ * 
+ * @param stream The stream.
+ * @param text The string, or NULL.
+ */
+static void put_json_string(FILE *stream, const char *text) {
+    if (text == NULL) {
+        fputs("null", stream);
+        return;
+    }
 
-void error_with_code(int code, uint8_t line, uint8_t *errors_counter) {
+    fputc('"', stream);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', stream);
+            fputc(*text, stream);
+        } else if ((unsigned char)*text < 0x20) {
+            fprintf(stream, "\\u%04x", (unsigned char)*text); /* Control characters are escaped */
+        } else {
+            fputc(*text, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+/**
+ * @brief Prints an error message as a JSON line.
+ * 
+ * @param stream The stream.
+ * @param code The error code, within bounds.
+ * @param am_line Line of the preprocessed source, or 0 for a message without a line.
+ */
+static void print_json_error(FILE *stream, int code, uint32_t am_line) {
+    uint32_t source_line = 0; /* Line of the input */
+    const char *origin = NULL; /* Macro or included file of the line */
+
+    if (am_line > 0 && json_sources != NULL) {
+        source_map_lookup(json_sources, am_line, &source_line, &origin);
+    }
+    if (source_line == 0) {
+        source_line = am_line; /* Not recorded, the lines are the same */
+    }
+
+    fputs("{\"file\":", stream);
+    put_json_string(stream, json_file);
+    if (am_line > 0) {
+        fprintf(stream, ",\"line\":%lu,\"am_line\":%lu", (unsigned long)source_line, (unsigned long)am_line);
+    } else {
+        fputs(",\"line\":null,\"am_line\":null", stream);
+    }
+    fputs(",\"origin\":", stream);
+    put_json_string(stream, origin);
+    fprintf(stream, ",\"code\":%d,\"message\":", code);
+    put_json_string(stream, errors_table[code]);
+    fputs("}\n", stream);
+}
+
+
+void error_with_code(int code, uint32_t line, uint8_t *errors_counter) {
     int errors_table_size = sizeof(errors_table) / sizeof(errors_table[0]);
 
     /* Ensure the error code is within bounds */
@@ -59,7 +163,14 @@ void error_with_code(int code, uint8_t line, uint8_t *errors_counter) {
     (*errors_counter)++;
 
     /* Print the error message */
-    printf("Error at Line: %i: %s\n", line, errors_table[code]);
+    if (errors_muted) {
+        return;
+    }
+    if (json_file != NULL) {
+        print_json_error(current_error_stream(), code, line);
+        return;
+    }
+    fprintf(current_error_stream(), "Error at Line: %lu: %s\n", (unsigned long)line, errors_table[code]);
 }
 
 void error_with_code_only(int code) {
@@ -71,5 +182,12 @@ void error_with_code_only(int code) {
     }
 
     /* Print the error message */
-    printf("Error: %s\n", errors_table[code]);
+    if (errors_muted) {
+        return;
+    }
+    if (json_file != NULL) {
+        print_json_error(current_error_stream(), code, 0);
+        return;
+    }
+    fprintf(current_error_stream(), "Error: %s\n", errors_table[code]);
 }
\ No newline at end of file
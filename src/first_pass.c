@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 
 #include "../header/first_pass.h"
@@ -7,56 +8,88 @@
 #include "../header/errors.h"
 #include "../header/validators.h"
 #include "../header/opcode.h"
+#include "../header/data_pool.h"
+#include "../header/scanner.h"
+#include "../header/trace.h"
+#include "../header/include.h"
+#include "../header/macro_snapshot.h"
 
 /**
- * @brief Performs the first pass of the assembler.
+ * @brief Ends the open region of the data pool, pointing its label at an identical earlier copy.
+ *
+ * @param pool The data pool.
+ * @param label Label of the region, or NULL when it has none.
+ * @param dc The data counter, moved back when the region is merged.
+ */
+static void end_pool_region(DataPool* pool, SymbolList* label, uint16_t* dc) {
+    int16_t offset; /* Offset of the stored copy of the region */
+    int length; /* Number of words in the region */
+
+    if (pool_end_region(pool, &offset, &length)) {
+        label->value.number = offset;
+        *dc -= length; /* The region is not emitted */
+    }
+}
+
+/**
+ * @brief Collects the symbols of a file, without resolving their addresses.
  * 
- * This function processes the input file to extract labels, entries, and externs,
- * while validating the syntax of the input. It also records any errors encountered
- * during the first pass.
+ * Labels keep their offset within their section: instruction labels hold an
+ * instruction counter offset and data labels a data counter offset.
  * 
  * @param file The input file to process.
- * @param labels_ptr Pointer to the linked list of labels.
- * @param entries_ptr Pointer to the linked list of entry labels.
- * @param externs_ptr Pointer to the linked list of extern labels.
+ * @param symbols_ptr Pointer to the linked list of symbols.
  * @param errors Pointer to the error counter to track the number of errors.
+ * @param number_of_lines Pointer to the variable counting the lines of the input file.
+ * @param macros Pointer to the linked list of macros.
+ * @param pool Data pool for merging duplicate data blocks, or NULL when pooling is disabled.
+ * @param load_address Address of the first word, to check the image fits below MAX_ADDRESS.
+ * @param ic Output for the size of the instruction section.
+ * @param dc Output for the size of the data section.
  */
-void first_pass(FILE* file, SymbolList** symbols_ptr,
-                uint8_t* errors, uint8_t* number_of_lines,
-                SymbolList* macros) {    
-    /* Null check and initialization */
-    if (!symbols_ptr) {
-        fprintf(stderr, "Error: symbols_ptr is NULL.\n");
-        return;
-    }  
-    
+static void collect_symbols(FILE* file, SymbolList** symbols_ptr,
+                            uint8_t* errors, uint8_t* number_of_lines,
+                            SymbolList* macros, DataPool* pool, uint16_t load_address,
+                            uint8_t* ic_ptr, uint16_t* dc_ptr) {
     /* Line reading buffers */
     char buffer[BUFFER_SIZE];
 
     /* Initialize linked lists */
     SymbolList* symbols = *symbols_ptr;
-    uint8_t line = 0; /* Line counter */
+    SymbolIndex index; /* Labels of the symbol table, for the duplicate checks */
+    SymbolList* sym; /* Symbol already declared with a label */
+    uint32_t line = 0; /* Line counter */
     char *prefix; /* Pointer to the first token in the line */
     char *pos;    /* Pointer to the position of ':' in the label */
     char *arg;    /* Pointer to the argument after the command */
-    SymbolList* curr = NULL; /* Pointer to the current node in the linked list */
+    char *save;   /* scan_token state for the current line */
     int i; /* Loop variable */
     bool stay_in_line = false;
     SymbolList* line_label = NULL; /* Pointer to the line label, when staying in line */
     uint8_t ic = 0; /* Instruction counter */
-    uint8_t dc = 0; /* Data counter */
+    uint16_t dc = 0; /* Data counter */
+    SymbolList* data_label = NULL; /* Label of the current data directive, if any */
+    SymbolList* region_label = NULL; /* Label of the open region of the data pool */
+    int16_t values[BUFFER_SIZE]; /* Values of the current data block, when pooling */
+    int length; /* Number of values in the current data block */
+    const unsigned char *bytes; /* Bytes embedded by .incbin */
+    size_t size; /* Number of bytes embedded by .incbin */
+    int code; /* Error code of a rejected .incbin, reported by the second pass */
+    bool too_large = false; /* Whether the image was found past the end of the address space */
+
+    symbol_index_init(&index, symbols);
     while (1) {
         /* Read a line from the file */
         if (stay_in_line){
-            prefix = strtok(NULL, " ");
+            prefix = scan_token(NULL, SCAN_SPACE, &save);
             stay_in_line = false;
         } else {
             if (fgets(buffer, BUFFER_SIZE, file) == NULL){
                 break; /* EOF has been reached, or an error has occured. */
             }
             
-            buffer[strcspn(buffer, "\n")] = '\0'; /* Remove newline character automatically inserted by fgets */
-            prefix = strtok(buffer, " "); /* Tokenize the command (e.g, mov, add, stop) */
+            *scan_find(buffer, SCAN_NEWLINE) = '\0'; /* Remove newline character automatically inserted by fgets */
+            prefix = scan_token(buffer, SCAN_SPACE, &save); /* Tokenize the command (e.g, mov, add, stop) */
             line++;
         }
  
@@ -82,15 +115,15 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                 continue;
             }
 
-            if (is_symbol_exists(macros, prefix)) {
-                /* Check if the label is a macro */
+            if (is_symbol_exists(macros, prefix) || macro_snapshot_find(prefix, NULL)) {
+                /* Check if the label is a macro, of the input or of the snapshot */
                 error_with_code(LABEL_IS_MACRO_NAME, line, errors);
                 continue;
             }
 
-            if (is_symbol_exists(symbols, prefix)) {
+            sym = symbol_index_find(&index, prefix);
+            if (sym != NULL) {
                 /* Check for duplicate label declarations */
-                SymbolList* sym = get_symbol_by_label(symbols, prefix);
                 if (sym->symbol_type == SYMBOL_LABEL){
                     /* Check if the label is already defined */
                     error_with_code(LABEL_ALREADY_DEFINED, line, errors);
@@ -99,13 +132,21 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
             }
 
             line_label = add_symbol_number(&symbols, prefix, ic, SYMBOL_LABEL); /* Add the label to the linked list */
+            symbol_index_add(&index, line_label);
             continue;
         }
 
         if (prefix[0] == '.'){
             /* Handle directives */
-            if (!strcmp(prefix, ".data") || !strcmp(prefix, ".string")) {
+            if (!strcmp(prefix, ".data") || !strcmp(prefix, ".string") ||
+                !strcmp(prefix, ".space") || !strcmp(prefix, ".incbin")) {
                 /* Update line label with respect to the current line */
+                data_label = line_label;
+                if (pool != NULL && line_label) {
+                    /* A label ends the region of the previous one, before taking its data counter */
+                    end_pool_region(pool, region_label, &dc);
+                    region_label = line_label;
+                }
                 if (line_label){
                     line_label->symbol_type = SYMBOL_DATA; /* Set the type of the label to SYMBOL_DATA */
                     line_label->value.number = dc; /* Set the value of the label to the current data counter */
@@ -113,29 +154,58 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                 }
             }
 
-            if (!strcmp(prefix, ".data")){
+            if (pool != NULL && (!strcmp(prefix, ".data") || !strcmp(prefix, ".string"))) {
+                /* Add the block to the region of its label, which is merged once it ends */
+                length = parse_data_block(prefix, scan_token(NULL, 0, &save), values, BUFFER_SIZE);
+                pool_add_block(pool, values, length, dc, data_label != NULL);
+                dc += length;
+            }
+
+            if (pool != NULL && (!strcmp(prefix, ".space") || !strcmp(prefix, ".incbin"))) {
+                /* Reserved words are not known to the pool, so their region is kept */
+                pool_add_reservation(pool, dc, data_label != NULL);
+            }
+
+            if (pool == NULL && !strcmp(prefix, ".data")){
                 /* Count the data */
-                arg = strtok(NULL, " ");
+                arg = scan_token(NULL, SCAN_SPACE, &save);
 
                 while (arg != NULL){
                     dc++;
-                    arg = strtok(NULL, ",");
+                    arg = scan_token(NULL, SCAN_COMMA, &save);
                 }
             }
 
-            if (!strcmp(prefix, ".string")){
+            if (pool == NULL && !strcmp(prefix, ".string")){
                 /* Compute string length */
-                arg = strtok(NULL, " ");
+                arg = scan_token(NULL, SCAN_SPACE, &save);
                 dc += strlen(arg) - 2 + 1; /* Subtract 2 for the quotes, add 1 for null terminator */
             }
 
+            if (!strcmp(prefix, ".space")) {
+                /* Reserve the words without storing them (an invalid size is reported by the second pass) */
+                arg = scan_token(NULL, SCAN_BLANK, &save);
+                if (is_valid_space_size(arg)) {
+                    dc += atoi(arg);
+                }
+            }
+
+            if (!strcmp(prefix, ".incbin")) {
+                /* Count the words from the size of the file, which is read but not parsed */
+                arg = scan_token(NULL, 0, &save);
+                if (arg != NULL && include_binary(arg, &bytes, &size, &code)) {
+                    dc += (size + WORD_BYTES - 1) / WORD_BYTES;
+                }
+            }
+
 
             line_label = NULL; /* Reset the line label */
+            data_label = NULL; /* Reset the data label */
 
 
             if (!strcmp(prefix, ".extern")) {
                 /* Handle .extern declarations */
-                arg = strtok(NULL, " ");
+                arg = scan_token(NULL, SCAN_SPACE, &save);
                 if (arg == NULL) {
                     /* Check for missing argument */
                     error_with_code(EXTERN_MISSING_ARGUMENT, line, errors);
@@ -143,8 +213,8 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                 }
     
                 skip_leading_spaces(&arg);
-                if (is_symbol_exists(symbols, arg)) {
-                    SymbolList* sym = get_symbol_by_label(symbols, arg);
+                sym = symbol_index_find(&index, arg);
+                if (sym != NULL) {
                     if (sym->symbol_type == SYMBOL_EXTERN){
                         /* Check if the label is already defined */
                         error_with_code(EXTERN_NOT_UNIQUE, line, errors);
@@ -158,13 +228,13 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                     }
                 }
     
-                add_symbol_number(&symbols, arg, -1, SYMBOL_EXTERN); /* Add the extern label to the list */
+                symbol_index_add(&index, add_symbol_number(&symbols, arg, -1, SYMBOL_EXTERN)); /* Add the extern label to the list */
                 continue;
             }
     
             if (!strcmp(prefix, ".entry")) {
                 /* Handle .entry declarations */
-                arg = strtok(NULL, " ");
+                arg = scan_token(NULL, SCAN_SPACE, &save);
                 skip_leading_spaces(&arg);
     
                 if (arg == NULL) {
@@ -173,8 +243,8 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                     continue;
                 }
 
-                if (is_symbol_exists(symbols, arg)) {
-                    SymbolList* sym = get_symbol_by_label(symbols, arg);
+                sym = symbol_index_find(&index, arg);
+                if (sym != NULL) {
                     if (sym->symbol_type == SYMBOL_ENTRY){
                         /* Check if the label is already defined */
                         error_with_code(ENTRY_ALREADY_DEFINED, line, errors);
@@ -188,7 +258,7 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                     }
                 }
     
-                add_symbol_number(&symbols, arg, 0, SYMBOL_ENTRY); /* Add the entry label to the list*/
+                symbol_index_add(&index, add_symbol_number(&symbols, arg, 0, SYMBOL_ENTRY)); /* Add the entry label to the list*/
                 continue;
             }
         } else {
@@ -200,8 +270,8 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
                     ic++;
 
                     if (commands[i].operands_num > 0) {
-                        char *arg1 = strtok(NULL, ",");
-                        char *arg2 = commands[i].operands_num == 2 ? strtok(NULL, ",") : NULL;
+                        char *arg1 = scan_token(NULL, SCAN_COMMA, &save);
+                        char *arg2 = commands[i].operands_num == 2 ? scan_token(NULL, SCAN_COMMA, &save) : NULL;
                         
                         if (arg1) {
                             skip_leading_spaces(&arg1);
@@ -226,15 +296,43 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
             line_label = NULL; /* Reset the line label */
         }
 
+        if (!too_large && (unsigned long)load_address + ic + dc > MAX_ADDRESS + 1UL) {
+            /* Reported once, at the line whose words pass the end of the address space */
+            too_large = true;
+            error_with_code(IMAGE_TOO_LARGE, line, errors);
+        }
+    }
 
+    symbol_index_free(&index);
+    if (pool != NULL) {
+        end_pool_region(pool, region_label, &dc);
     }
 
+    /* Update the pointers to the linked lists and counters */
+    *symbols_ptr = symbols;
+    *ic_ptr = ic;
+    *dc_ptr = dc;
+}
+
+/**
+ * @brief Resolves collected symbols to their final memory addresses.
+ * 
+ * Instruction labels are moved to the load address, data labels after the
+ * instruction section, and entries take the address of their label.
+ * 
+ * @param symbols The linked list of symbols.
+ * @param ic The size of the instruction section.
+ * @param options Modes selected on the command line (load address).
+ */
+static void resolve_symbols(SymbolList* symbols, uint8_t ic, const AssemblerOptions* options) {
+    SymbolList* curr = NULL; /* Pointer to the current node in the linked list */
+
     /**
      * Memory Address Resolution Phase
      * -----------------------------
      * This phase adjusts all symbol addresses to their final memory locations.
      * Memory layout is organized as follows:
-     * 1. Instructions start at address 100 (START_LINE)
+     * 1. Instructions start at the load address (START_LINE, 100, by default)
      * 2. Data section follows immediately after instructions
      * 3. Entry symbols point to their target label's address
      */
@@ -245,17 +343,17 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
         if (curr->symbol_type != SYMBOL_ENTRY) {
             if (curr->symbol_type == SYMBOL_DATA) {
                 /* Data section comes after instructions, so add:
-                * - START_LINE (base address 100)
+                * - the load address (base address, 100 by default)
                 * - ic (size of instruction section)
                 * - curr->value.number (offset within data section)
                 */
-                curr->value.number = START_LINE + ic + curr->value.number;
+                curr->value.number = options->load_address + ic + curr->value.number;
             } else if (curr->symbol_type == SYMBOL_INSTRUCTION) {
-                /* Instructions start at START_LINE (100), so add:
-                * - START_LINE (base address 100)
+                /* Instructions start at the load address, so add:
+                * - the load address (base address, 100 by default)
                 * - curr->value.number (offset within instruction section)
                 */
-                curr->value.number = START_LINE + curr->value.number;
+                curr->value.number = options->load_address + curr->value.number;
             }
         }
         curr = curr->next;
@@ -289,7 +387,40 @@ void first_pass(FILE* file, SymbolList** symbols_ptr,
     
     /* DEBUG: Displays symbols list immediately after first-pass. */
     /* print_symbols(symbols) */
+}
 
-    /* Update the pointers to the linked lists */
-    *symbols_ptr = symbols;
+/**
+ * @brief Performs the first pass of the assembler.
+ * 
+ * This function processes the input file to extract labels, entries, and externs,
+ * while validating the syntax of the input. It also records any errors encountered
+ * during the first pass.
+ * 
+ * @param file The input file to process.
+ * @param symbols_ptr Pointer to the linked list of symbols.
+ * @param errors Pointer to the error counter to track the number of errors.
+ * @param number_of_lines Pointer to the variable to store the number of lines in the input file.
+ * @param macros Pointer to the linked list of macros.
+ * @param pool Data pool for merging duplicate data blocks, or NULL when pooling is disabled.
+ * @param options Modes selected on the command line (load address).
+ */
+void first_pass(FILE* file, SymbolList** symbols_ptr,
+                uint8_t* errors, uint8_t* number_of_lines,
+                SymbolList* macros, DataPool* pool,
+                const AssemblerOptions* options) {
+    uint8_t ic = 0; /* Instruction counter */
+    uint16_t dc = 0; /* Data counter */
+    TraceSpan span; /* Span of the pass (--trace) */
+
+    /* Null check and initialization */
+    if (!symbols_ptr) {
+        fprintf(stderr, "Error: symbols_ptr is NULL.\n");
+        return;
+    }
+
+    trace_begin(&span, "first_pass", NULL);
+    collect_symbols(file, symbols_ptr, errors, number_of_lines,
+                    macros, pool, options->load_address, &ic, &dc);
+    resolve_symbols(*symbols_ptr, ic, options);
+    trace_end(&span);
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../header/image.h"
+
+/**
+ * @brief Writes out the pending bytes of a buffered writer.
+ *
+ * @param writer The buffered writer.
+ */
+static void writer_flush(BufferedWriter *writer) {
+    if (writer->used > 0) {
+        fwrite(writer->buffer, 1, writer->used, writer->file);
+        writer->used = 0;
+    }
+}
+
+/**
+ * @brief Appends bytes to a buffered writer.
+ *
+ * @param writer The buffered writer.
+ * @param data The bytes to append.
+ * @param length The number of bytes to append.
+ */
+static void writer_put(BufferedWriter *writer, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t chunk; /* Bytes copied in one round */
+
+    while (length > 0) {
+        if (writer->used == IMAGE_BUFFER_SIZE) {
+            writer_flush(writer);
+        }
+
+        chunk = IMAGE_BUFFER_SIZE - writer->used;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        memcpy(writer->buffer + writer->used, bytes, chunk);
+        writer->used += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * @brief Writes an Intel HEX record.
+ *
+ * @param image The image being written.
+ * @param type The record type.
+ * @param offset The 16-bit address field.
+ * @param data The record's data bytes.
+ * @param length The number of data bytes.
+ */
+static void write_ihex_record(ImageWriter *image, int type, unsigned int offset,
+                              const unsigned char *data, int length) {
+    char line[2 * IMAGE_RECORD_SIZE + 16]; /* Formatted record */
+    unsigned int sum = length + (offset >> 8) + (offset & 0xFF) + type; /* Checksum accumulator */
+    int pos; /* Position in the line */
+    int i; /* Loop variable */
+
+    pos = sprintf(line, ":%02X%04X%02X", length, offset & 0xFFFF, type);
+    for (i = 0; i < length; i++) {
+        pos += sprintf(line + pos, "%02X", data[i]);
+        sum += data[i];
+    }
+
+    pos += sprintf(line + pos, "%02X\n", (0x100 - (sum & 0xFF)) & 0xFF);
+    writer_put(&image->writer, line, pos);
+}
+
+/**
+ * @brief Writes a Motorola S-record.
+ *
+ * @param image The image being written.
+ * @param type The record type (0-9).
+ * @param address The address field.
+ * @param address_bytes The width of the address field in bytes.
+ * @param data The record's data bytes.
+ * @param length The number of data bytes.
+ */
+static void write_srec_record(ImageWriter *image, int type, unsigned long address,
+                              int address_bytes, const unsigned char *data, int length) {
+    char line[2 * (IMAGE_RECORD_SIZE + 64) + 16]; /* Formatted record */
+    int count = address_bytes + length + 1; /* Address, data and checksum bytes */
+    unsigned int sum = count; /* Checksum accumulator */
+    int pos; /* Position in the line */
+    int i; /* Loop variable */
+
+    pos = sprintf(line, "S%d%02X", type, count);
+    for (i = address_bytes - 1; i >= 0; i--) {
+        unsigned int byte = (unsigned int)((address >> (8 * i)) & 0xFF);
+        pos += sprintf(line + pos, "%02X", byte);
+        sum += byte;
+    }
+
+    for (i = 0; i < length; i++) {
+        pos += sprintf(line + pos, "%02X", data[i]);
+        sum += data[i];
+    }
+
+    pos += sprintf(line + pos, "%02X\n", (~sum) & 0xFF);
+    writer_put(&image->writer, line, pos);
+}
+
+/**
+ * @brief Writes the pending data record, if any.
+ *
+ * @param image The image being written.
+ */
+static void flush_record(ImageWriter *image) {
+    unsigned char upper[2]; /* Extended linear address */
+
+    if (image->record_length == 0) {
+        return;
+    }
+
+    if (image->format == IMAGE_IHEX) {
+        if ((image->record_address >> 16) != image->upper) {
+            image->upper = image->record_address >> 16;
+            upper[0] = (unsigned char)(image->upper >> 8);
+            upper[1] = (unsigned char)(image->upper & 0xFF);
+            write_ihex_record(image, 4, 0, upper, 2);
+        }
+
+        write_ihex_record(image, 0, (unsigned int)(image->record_address & 0xFFFF),
+                          image->record, image->record_length);
+    } else if (image->format == IMAGE_SREC) {
+        write_srec_record(image, image->address_bytes - 1, image->record_address,
+                          image->address_bytes, image->record, image->record_length);
+        image->records++;
+    }
+
+    image->record_length = 0;
+}
+
+/**
+ * @brief Appends one byte to the image.
+ *
+ * @param image The image being written.
+ * @param byte The byte to append.
+ */
+static void put_byte(ImageWriter *image, unsigned char byte) {
+    if (image->format == IMAGE_BINARY) {
+        writer_put(&image->writer, &byte, 1);
+        image->address++;
+        return;
+    }
+
+    /* Records never cross a 64K boundary, so their 16-bit offset stays valid */
+    if (image->record_length > 0 && (image->address & 0xFFFF) == 0) {
+        flush_record(image);
+    }
+
+    if (image->record_length == 0) {
+        image->record_address = image->address;
+    }
+
+    image->record[image->record_length++] = byte;
+    image->address++;
+    if (image->record_length == IMAGE_RECORD_SIZE) {
+        flush_record(image);
+    }
+}
+
+ImageFormat parse_image_format(const char *name) {
+    if (!strcmp(name, "bin")) {
+        return IMAGE_BINARY;
+    }
+
+    if (!strcmp(name, "ihex")) {
+        return IMAGE_IHEX;
+    }
+
+    if (!strcmp(name, "srec")) {
+        return IMAGE_SREC;
+    }
+
+    return IMAGE_NONE;
+}
+
+void image_begin(ImageWriter *image, ImageFormat format, FILE *file,
+                 unsigned long load_address, unsigned long words, const char *name) {
+    unsigned long end = (load_address + words) * 3; /* Byte address past the image */
+
+    image->format = format;
+    image->writer.file = file;
+    image->writer.used = 0;
+    image->address = load_address * 3;
+    image->start = image->address;
+    image->record_length = 0;
+    image->record_address = image->address;
+    image->upper = 0;
+    image->records = 0;
+
+    /* Narrowest S-record address that covers the whole image */
+    if (end <= 0x10000UL) {
+        image->address_bytes = 2;
+    } else if (end <= 0x1000000UL) {
+        image->address_bytes = 3;
+    } else {
+        image->address_bytes = 4;
+    }
+
+    if (format == IMAGE_SREC) {
+        write_srec_record(image, 0, 0, 2, (const unsigned char *)name, (int)strlen(name) > 64 ? 64 : (int)strlen(name));
+    }
+}
+
+void image_put_word(ImageWriter *image, Word *inst) {
+    uint32_t value = word_to_hex(inst); /* The word's 24 bits */
+
+    put_byte(image, (unsigned char)((value >> 16) & 0xFF));
+    put_byte(image, (unsigned char)((value >> 8) & 0xFF));
+    put_byte(image, (unsigned char)(value & 0xFF));
+}
+
+void image_end(ImageWriter *image) {
+    flush_record(image);
+
+    if (image->format == IMAGE_IHEX) {
+        write_ihex_record(image, 1, 0, NULL, 0); /* End of file */
+    } else if (image->format == IMAGE_SREC) {
+        if (image->records <= 0xFFFF) {
+            write_srec_record(image, 5, image->records, 2, NULL, 0); /* Record count */
+        }
+
+        /* Terminator carrying the start address: S9, S8 or S7 */
+        write_srec_record(image, 11 - image->address_bytes, image->start, image->address_bytes, NULL, 0);
+    }
+
+    writer_flush(&image->writer);
+}
@@ -0,0 +1,388 @@
+#define _XOPEN_SOURCE 700 /* fstat, fileno, st_mtim, recursive mutexes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "../header/include.h"
+#include "../header/assembler.h"
+#include "../header/scanner.h"
+#include "../header/errors.h"
+
+static IncludeUnit *units = NULL; /* Included files of the run */
+static IncludeUnit *retired = NULL; /* Files replaced by `include_refresh`, which requests may still use */
+static pthread_mutex_t units_lock; /* Guards `units` and preprocessing of included files */
+static pthread_once_t units_lock_once = PTHREAD_ONCE_INIT; /* Initializes `units_lock` */
+
+/**
+ * @brief Initializes the lock as recursive, since preprocessing a file preprocesses its includes.
+ */
+static void init_units_lock(void) {
+    pthread_mutexattr_t attributes; /* Attributes of the lock */
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&units_lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+void include_lock(void) {
+    pthread_once(&units_lock_once, init_units_lock);
+    pthread_mutex_lock(&units_lock);
+}
+
+void include_unlock(void) {
+    pthread_mutex_unlock(&units_lock);
+}
+
+/**
+ * @brief Reads a file into memory.
+ *
+ * The file is copied rather than mapped: a file truncated while it is in use
+ * must not fault the reads of the (long-running) process.
+ *
+ * @param path The path of the file.
+ * @param size Output for the size of the file.
+ * @param status Output for the status of the file, when read.
+ * @return The null-terminated contents, or NULL if the file cannot be read.
+ */
+static char* read_file(const char *path, size_t *size, struct stat *status) {
+    FILE *file = fopen(path, "rb"); /* The file */
+    char *data; /* Its contents */
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fstat(fileno(file), status) != 0 || !S_ISREG(status->st_mode)) {
+        fclose(file);
+        return NULL;
+    }
+
+    data = read_stream(file, size);
+    fclose(file);
+    if (!data) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    return data;
+}
+
+/**
+ * @brief Formats the path of an included file.
+ *
+ * @param name The name given to `.include`.
+ * @param path Output for the path, 256 bytes.
+ * @return true if the path fits, false otherwise.
+ */
+static bool include_path(const char *name, char *path) {
+    int res = snprintf(path, 256, INCLUDE_PATH_FORMAT, name); /* Result of formatting the path */
+
+    return res >= 0 && res < 256;
+}
+
+IncludeUnit* include_load(const char *name) {
+    IncludeUnit *unit; /* File iterator, then the new file */
+    char path[256]; /* Path of the file */
+
+    include_lock();
+    for (unit = units; unit != NULL; unit = unit->next) {
+        if (!strcmp(unit->name, name)) {
+            include_unlock();
+            return unit;
+        }
+    }
+
+    unit = (IncludeUnit *)calloc(1, sizeof(IncludeUnit));
+    if (!unit) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    unit->name = strdup(name);
+    if (!unit->name) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    if (include_path(name, path)) {
+        unit->data = read_file(path, &unit->size, &unit->status);
+    }
+
+    unit->state = INCLUDE_NEW;
+    unit->next = units;
+    units = unit;
+    include_unlock();
+    return unit;
+}
+
+/**
+ * @brief Tells whether a file changed since it was read.
+ *
+ * @param unit The file.
+ * @return true if it changed, appeared or disappeared, false otherwise.
+ */
+static bool unit_changed(const IncludeUnit *unit) {
+    char path[256]; /* Path of the file */
+    struct stat status; /* Current status of the file */
+    bool readable; /* Whether the file can be read now */
+
+    readable = include_path(unit->name, path) && stat(path, &status) == 0 && S_ISREG(status.st_mode);
+    if (!readable || unit->data == NULL) {
+        return readable != (unit->data != NULL);
+    }
+
+    return status.st_dev != unit->status.st_dev || status.st_ino != unit->status.st_ino ||
+           status.st_size != unit->status.st_size ||
+           status.st_mtim.tv_sec != unit->status.st_mtim.tv_sec ||
+           status.st_mtim.tv_nsec != unit->status.st_mtim.tv_nsec;
+}
+
+void include_refresh(void) {
+    IncludeUnit *unit; /* File iterator */
+    IncludeUnit *last; /* Last file of the run */
+
+    include_lock();
+    for (unit = units; unit != NULL && !unit_changed(unit); unit = unit->next);
+
+    if (unit != NULL) {
+        /* Files are preprocessed with the files they include, so all of them are read again */
+        for (last = units; last->next != NULL; last = last->next);
+        last->next = retired;
+        retired = units;
+        units = NULL;
+    }
+    include_unlock();
+}
+
+/**
+ * @brief Parses a quoted file name.
+ *
+ * @param args The text starting with the name, possibly after blanks.
+ * @param name Output for the file name, INCLUDE_NAME_SIZE bytes.
+ * @return A pointer past the closing quote and its trailing blanks, or NULL if
+ *         there is no quoted name, or it is empty or too long.
+ */
+static const char* parse_quoted_name(const char *args, char *name) {
+    const char *end; /* Closing quote */
+
+    args = scan_skip(args, SCAN_BLANK);
+    if (*args != '"') {
+        return NULL;
+    }
+
+    end = strchr(args + 1, '"');
+    if (end == NULL || end == args + 1 || end - args > INCLUDE_NAME_SIZE) {
+        return NULL; /* Unterminated, empty or too long */
+    }
+
+    memcpy(name, args + 1, end - args - 1);
+    name[end - args - 1] = '\0';
+    return scan_skip(end + 1, SCAN_BLANK);
+}
+
+bool include_parse_name(const char *args, char *name) {
+    args = parse_quoted_name(args, name);
+    return args != NULL && *args == '\0'; /* No extraneous text after the name */
+}
+
+/**
+ * @brief Parses an unsigned decimal number, up to a comma or the end of the string.
+ *
+ * @param s The number, possibly surrounded by blanks.
+ * @param value Output for the number.
+ * @return A pointer past the number and its trailing blanks, or NULL if there is no valid number.
+ */
+static const char* parse_unsigned(const char *s, unsigned long *value) {
+    *value = 0;
+    s = scan_skip(s, SCAN_BLANK);
+    if (!isdigit((unsigned char)*s)) {
+        return NULL;
+    }
+
+    while (isdigit((unsigned char)*s)) {
+        if (*value > (ULONG_MAX - 9) / 10) {
+            return NULL; /* Would overflow */
+        }
+        *value = *value * 10 + (*s++ - '0');
+    }
+
+    return scan_skip(s, SCAN_BLANK);
+}
+
+bool include_binary(const char *args, const unsigned char **bytes, size_t *size, int *error) {
+    char name[INCLUDE_NAME_SIZE]; /* Name of the file */
+    unsigned long offset = 0; /* First byte of the range */
+    unsigned long length; /* Size of the range */
+    IncludeUnit *unit; /* The included file */
+
+    *error = INVALID_INCBIN;
+    args = parse_quoted_name(args, name);
+    if (args == NULL) {
+        return false;
+    }
+
+    unit = include_load(name);
+    if (unit->data == NULL) {
+        *error = INCLUDE_NOT_FOUND;
+        return false;
+    }
+
+    length = unit->size;
+    if (*args == ',') {
+        /* Explicit range: ", offset, length" */
+        args = parse_unsigned(args + 1, &offset);
+        if (args == NULL || *args != ',') {
+            return false;
+        }
+
+        args = parse_unsigned(args + 1, &length);
+        if (args == NULL) {
+            return false;
+        }
+    }
+
+    if (*args != '\0' || offset > unit->size || length > unit->size - offset ||
+        length == 0 || length > (unsigned long)MAX_INCBIN_SIZE) {
+        return false; /* Extraneous text, or a range that is outside the file, empty or too large */
+    }
+
+    *bytes = (const unsigned char *)unit->data + offset;
+    *size = length;
+    return true;
+}
+
+bool include_guard(IncludeList **list, IncludeUnit *unit) {
+    IncludeList *node; /* List iterator, then the new node */
+
+    for (node = *list; node != NULL; node = node->next) {
+        if (node->unit == unit) {
+            return false;
+        }
+    }
+
+    node = (IncludeList *)malloc(sizeof(IncludeList));
+    if (!node) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    node->unit = unit;
+    node->next = *list;
+    *list = node;
+    return true;
+}
+
+void include_free_list(IncludeList *list) {
+    IncludeList *next; /* Next node */
+
+    for (; list != NULL; list = next) {
+        next = list->next;
+        free(list);
+    }
+}
+
+/**
+ * @brief Visits the files included by a raw source, then the files they include.
+ *
+ * @param source The source (not necessarily null-terminated).
+ * @param size The size of the source.
+ * @param visited Files visited so far.
+ * @param visit The function called on each file.
+ * @param arg Argument passed to `visit`.
+ */
+static void visit_source(const char *source, size_t size, IncludeList **visited,
+                         void (*visit)(IncludeUnit *unit, void *arg), void *arg) {
+    char line[BUFFER_SIZE]; /* Current line, null-terminated */
+    char name[INCLUDE_NAME_SIZE]; /* Name of an included file */
+    const char *end = source + size; /* End of the source */
+    const char *next; /* End of the current line */
+    size_t length; /* Length of the copied line */
+    char *token; /* First token of the line */
+    char *directive; /* Directive of the line, after its label if any */
+    IncludeUnit *unit; /* Included file */
+
+    while (source < end) {
+        next = memchr(source, '\n', end - source);
+        next = next ? next + 1 : end;
+        length = next - source < BUFFER_SIZE ? (size_t)(next - source) : BUFFER_SIZE - 1;
+        memcpy(line, source, length);
+        line[length] = '\0';
+        *scan_find(line, SCAN_NEWLINE) = '\0';
+        source = next;
+
+        token = scan_skip(line, SCAN_BLANK);
+        directive = scan_find(token, SCAN_BLANK);
+        directive = (directive > token && directive[-1] == ':') ? scan_skip(directive, SCAN_BLANK) : token; /* After a label */
+        length = strlen(INCBIN_DIRECTIVE);
+        if (strncmp(directive, INCBIN_DIRECTIVE, length) == 0 &&
+            (directive[length] == ' ' || directive[length] == '\t')) {
+            /* Embedded bytes: the file is visited for its contents, but never includes anything */
+            if (parse_quoted_name(directive + length, name) != NULL) {
+                visit(include_load(name), arg);
+            }
+            continue;
+        }
+
+        length = strlen(INCLUDE_DIRECTIVE);
+        if (strncmp(token, INCLUDE_DIRECTIVE, length) != 0 ||
+            (token[length] != ' ' && token[length] != '\t') ||
+            !include_parse_name(token + length, name)) {
+            continue; /* Not an .include line */
+        }
+
+        unit = include_load(name);
+        if (include_guard(visited, unit)) {
+            visit(unit, arg);
+            if (unit->data != NULL) {
+                visit_source(unit->data, unit->size, visited, visit, arg);
+            }
+        }
+    }
+}
+
+void include_visit(const char *source, size_t size,
+                   void (*visit)(IncludeUnit *unit, void *arg), void *arg) {
+    IncludeList *visited = NULL; /* Files visited so far */
+
+    visit_source(source, size, &visited, visit, arg);
+    include_free_list(visited);
+}
+
+/**
+ * @brief Frees a list of included files.
+ *
+ * @param unit The first file of the list.
+ */
+static void free_units(IncludeUnit *unit) {
+    IncludeUnit *next; /* File after the one being freed */
+    IncludeSplice *splice; /* Splice being freed */
+
+    for (; unit != NULL; unit = next) {
+        next = unit->next;
+
+        while (unit->splices != NULL) {
+            splice = unit->splices;
+            unit->splices = splice->next;
+            free(splice);
+        }
+
+        if (unit->macros) free_symbol_list(unit->macros);
+        free(unit->data);
+        free(unit->text);
+        free(unit->name);
+        free(unit);
+    }
+}
+
+void include_free_all(void) {
+    free_units(units);
+    free_units(retired);
+    units = NULL;
+    retired = NULL;
+}
@@ -1,7 +1,9 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../header/lib.h"
+#include "../header/scanner.h"
 
 /**
  * @brief Skips leading spaces in a string.
@@ -17,9 +19,7 @@ void skip_leading_spaces(char **line) {
         return; /* Ensure valid pointer */
     }
 
-    while (**line == ' ' || **line == '\t') {
-        (*line)++; /* Advance for every space or tab character */
-    }
+    *line = scan_skip(*line, SCAN_BLANK); /* Advance past every space or tab character */
 }
 
 /**
@@ -40,4 +40,51 @@ char *strdup(const char *s) {
     }
 
     return memcpy(new_str, s, len); /* Copy the string into the newly allocated memory */
+}
+
+char *strdup_tracked(const char *s, MemCategory category) {
+    char *new_str = strdup(s); /* The copy */
+    if (new_str != NULL) {
+        mem_track_alloc(category, strlen(new_str) + 1);
+    }
+
+    return new_str;
+}
+
+/**
+ * @brief Reads the rest of a stream into memory.
+ * 
+ * The buffer grows geometrically, so the stream is read in O(n) time.
+ * 
+ * @param file The stream to read.
+ * @param size Output for the number of bytes read (excluding the terminator).
+ * @return A pointer to the null-terminated contents, or NULL if allocation fails.
+ */
+char *read_stream(FILE *file, size_t *size) {
+    size_t capacity = 4096; /* Allocated size of the buffer */
+    size_t length = 0; /* Number of bytes read so far */
+    size_t read; /* Number of bytes read in one call */
+    char *buffer = malloc(capacity); /* Contents read so far */
+    char *grown; /* Reallocated buffer */
+
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    while ((read = fread(buffer + length, 1, capacity - length - 1, file)) > 0) {
+        length += read;
+        if (capacity - length - 1 == 0) {
+            grown = realloc(buffer, capacity * 2); /* Double the buffer when full */
+            if (grown == NULL) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+
+    buffer[length] = '\0';
+    *size = length;
+    return buffer;
 }
\ No newline at end of file
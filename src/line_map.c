@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../header/line_map.h"
+
+void source_map_init(SourceMap *map) {
+    map->segments = NULL;
+    map->count = 0;
+    map->capacity = 0;
+    map->am_lines = 0;
+}
+
+void source_map_add(SourceMap *map, uint32_t source_line, const char *origin, uint32_t am_lines) {
+    SourceSegment *last = map->count > 0 ? &map->segments[map->count - 1] : NULL; /* Segment being extended */
+    SourceSegment *grown; /* Reallocated segments */
+
+    if (am_lines == 0) {
+        return; /* Nothing was written for the line */
+    }
+
+    if (last != NULL && last->origin == origin &&
+        (origin == NULL ? last->source_line + (map->am_lines + 1 - last->am_line) == source_line
+                        : last->source_line == source_line)) {
+        map->am_lines += am_lines; /* The next plain line, or more of the same expansion */
+        return;
+    }
+
+    if (map->count == map->capacity) {
+        map->capacity = map->capacity ? map->capacity * 2 : 16;
+        grown = (SourceSegment *)realloc(map->segments, map->capacity * sizeof(SourceSegment));
+        if (!grown) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        map->segments = grown;
+    }
+
+    map->segments[map->count].am_line = map->am_lines + 1;
+    map->segments[map->count].source_line = source_line;
+    map->segments[map->count].origin = origin;
+    map->count++;
+    map->am_lines += am_lines;
+}
+
+void source_map_lookup(const SourceMap *map, uint32_t am_line,
+                       uint32_t *source_line, const char **origin) {
+    size_t low = 0; /* First segment that may hold the line */
+    size_t high = map->count; /* End of the segments that may hold it */
+    size_t middle; /* Segment compared with the line */
+    const SourceSegment *segment; /* Segment holding the line */
+
+    *source_line = 0;
+    *origin = NULL;
+    if (am_line == 0 || am_line > map->am_lines) {
+        return;
+    }
+
+    /* Last segment starting at or before the line */
+    while (high - low > 1) {
+        middle = low + (high - low) / 2;
+        if (map->segments[middle].am_line <= am_line) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low >= map->count || map->segments[low].am_line > am_line) {
+        return;
+    }
+
+    segment = &map->segments[low];
+    *origin = segment->origin;
+    *source_line = segment->origin == NULL ? segment->source_line + (am_line - segment->am_line)
+                                           : segment->source_line;
+}
+
+void source_map_free(SourceMap *map) {
+    free(map->segments);
+    source_map_init(map);
+}
+
+void line_map_begin(LineMapWriter *writer, FILE *stream, const SourceMap *sources) {
+    writer->stream = stream;
+    writer->sources = sources;
+    writer->line = 0;
+    writer->row_line = 0;
+}
+
+void line_map_set_line(LineMapWriter *writer, uint32_t line) {
+    writer->line = line;
+}
+
+void line_map_put(LineMapWriter *writer, uint16_t address) {
+    uint32_t source_line; /* Source line of the words */
+    const char *origin; /* Macro or included file of the words */
+
+    if (writer->line == writer->row_line) {
+        return; /* Same run as the previous word */
+    }
+
+    source_map_lookup(writer->sources, writer->line, &source_line, &origin);
+    fprintf(writer->stream, "%07d %lu %lu %s\n", address, (unsigned long)writer->line,
+            (unsigned long)source_line, origin != NULL ? origin : "-");
+    writer->row_line = writer->line;
+}
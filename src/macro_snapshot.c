@@ -0,0 +1,313 @@
+#define _XOPEN_SOURCE 700 /* mmap, open, fstat */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../header/macro_snapshot.h"
+
+#define HEADER_WORDS 5 /* Magic, macros, slots, strings size, checksum */
+#define MACRO_WORDS 4  /* Name, body, body size, lines */
+#define SLOT_WORDS 2   /* Hash, macro */
+#define MIN_SLOTS 16   /* Fewest slots of a snapshot */
+
+static const unsigned char *snapshot = NULL; /* The mapped snapshot, NULL when none is loaded */
+static size_t snapshot_size = 0; /* Size of the mapping */
+static uint32_t macros_count = 0; /* Number of macros */
+static uint32_t slots_count = 0; /* Number of slots, a power of two */
+static const unsigned char *records = NULL; /* Macro records */
+static const unsigned char *slots = NULL; /* Slots of the name index */
+static const char *strings = NULL; /* Names and bodies */
+static uint32_t strings_size = 0; /* Size of `strings` */
+static uint32_t checksum = 0; /* Checksum of the snapshot */
+
+/**
+ * @brief Reads a little-endian 32-bit word.
+ *
+ * @param bytes The word's bytes.
+ * @return The word.
+ */
+static uint32_t get_word(const unsigned char *bytes) {
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 |
+           (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+/**
+ * @brief Writes a little-endian 32-bit word.
+ *
+ * @param bytes Output for the word's bytes.
+ * @param word The word.
+ */
+static void put_word(unsigned char *bytes, uint32_t word) {
+    bytes[0] = (unsigned char)(word & 0xFF);
+    bytes[1] = (unsigned char)(word >> 8 & 0xFF);
+    bytes[2] = (unsigned char)(word >> 16 & 0xFF);
+    bytes[3] = (unsigned char)(word >> 24 & 0xFF);
+}
+
+/**
+ * @brief Computes the checksum of bytes (32-bit FNV-1a).
+ *
+ * @param bytes The bytes.
+ * @param size Number of bytes.
+ * @return The checksum.
+ */
+static uint32_t compute_checksum(const unsigned char *bytes, size_t size) {
+    uint32_t hash = 2166136261UL; /* FNV offset basis */
+    size_t i; /* Loop variable */
+
+    for (i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619UL; /* FNV prime */
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Counts the lines of a macro body.
+ *
+ * @param body The body.
+ * @return The number of newline characters in the body.
+ */
+static uint32_t count_body_lines(const char *body) {
+    uint32_t lines = 0; /* Lines counted so far */
+
+    while ((body = strchr(body, '\n')) != NULL) {
+        lines++;
+        body++;
+    }
+
+    return lines;
+}
+
+bool macro_snapshot_write(const char *path, SymbolList *macros) {
+    SymbolList *node; /* Macro iterator */
+    uint32_t count = 0; /* Number of macros */
+    uint32_t slot_count = MIN_SLOTS; /* Number of slots */
+    size_t text_size = 0; /* Size of the strings */
+    size_t size; /* Size of the snapshot */
+    unsigned char *data; /* The snapshot */
+    unsigned char *record; /* Record of the current macro */
+    unsigned char *slot_base; /* First slot */
+    char *text; /* Strings of the snapshot */
+    size_t offset = 0; /* Offset of the next string */
+    uint32_t hash; /* Hash of a name */
+    uint32_t slot; /* Slot probed */
+    uint32_t i; /* Macro index */
+    FILE *out; /* The snapshot file */
+    bool written; /* Whether the whole snapshot was written */
+
+    for (node = macros; node != NULL; node = node->next) {
+        count++;
+        text_size += strlen(node->label) + strlen(node->value.buffer) + 2;
+    }
+
+    while (slot_count < 2 * count) {
+        slot_count *= 2; /* At most half full */
+    }
+
+    size = (HEADER_WORDS + MACRO_WORDS * count + SLOT_WORDS * slot_count) * 4 + text_size;
+    data = (unsigned char *)malloc(size);
+    if (!data) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    record = data + HEADER_WORDS * 4;
+    slot_base = record + MACRO_WORDS * 4 * count;
+    text = (char *)(slot_base + SLOT_WORDS * 4 * slot_count);
+    for (slot = 0; slot < slot_count; slot++) {
+        put_word(slot_base + slot * SLOT_WORDS * 4, 0);
+        put_word(slot_base + slot * SLOT_WORDS * 4 + 4, MACRO_SNAPSHOT_EMPTY);
+    }
+
+    for (node = macros, i = 0; node != NULL; node = node->next, i++, record += MACRO_WORDS * 4) {
+        put_word(record, (uint32_t)offset);
+        strcpy(text + offset, node->label);
+        offset += strlen(node->label) + 1;
+
+        put_word(record + 4, (uint32_t)offset);
+        put_word(record + 8, (uint32_t)strlen(node->value.buffer));
+        put_word(record + 12, count_body_lines(node->value.buffer));
+        strcpy(text + offset, node->value.buffer);
+        offset += strlen(node->value.buffer) + 1;
+
+        hash = hash_label(node->label);
+        slot = hash & (slot_count - 1);
+        while (get_word(slot_base + slot * SLOT_WORDS * 4 + 4) != MACRO_SNAPSHOT_EMPTY) {
+            slot = (slot + 1) & (slot_count - 1); /* Linear probing */
+        }
+        put_word(slot_base + slot * SLOT_WORDS * 4, hash);
+        put_word(slot_base + slot * SLOT_WORDS * 4 + 4, i);
+    }
+
+    memcpy(data, MACRO_SNAPSHOT_MAGIC, 4);
+    put_word(data + 4, count);
+    put_word(data + 8, slot_count);
+    put_word(data + 12, (uint32_t)text_size);
+    put_word(data + 16, compute_checksum(data + HEADER_WORDS * 4, size - HEADER_WORDS * 4));
+
+    out = fopen(path, "wb");
+    if (!out) {
+        perror("Error opening macro snapshot for writing");
+        free(data);
+        return false;
+    }
+
+    written = fwrite(data, 1, size, out) == size;
+    written = fclose(out) == 0 && written;
+    if (!written) {
+        perror("Error writing macro snapshot");
+        remove(path);
+    }
+
+    free(data);
+    return written;
+}
+
+/**
+ * @brief Checks that every record of the mapped snapshot stays within its strings.
+ *
+ * @return true if the records are valid.
+ */
+static bool check_records(void) {
+    const unsigned char *record = records; /* Record of the current macro */
+    uint32_t name; /* Offset of the name */
+    uint32_t body; /* Offset of the body */
+    uint32_t size; /* Size of the body */
+    uint32_t used = 0; /* Number of slots in use */
+    uint32_t i; /* Loop variable */
+
+    for (i = 0; i < macros_count; i++, record += MACRO_WORDS * 4) {
+        name = get_word(record);
+        body = get_word(record + 4);
+        size = get_word(record + 8);
+        if (name >= strings_size || memchr(strings + name, '\0', strings_size - name) == NULL ||
+            body >= strings_size || size >= strings_size - body || strings[body + size] != '\0') {
+            return false;
+        }
+    }
+
+    for (i = 0; i < slots_count; i++) {
+        body = get_word(slots + i * SLOT_WORDS * 4 + 4);
+        if (body != MACRO_SNAPSHOT_EMPTY && (body >= macros_count || ++used > macros_count)) {
+            return false; /* A free slot must remain, so that probing ends */
+        }
+    }
+
+    return true;
+}
+
+bool macro_snapshot_load(const char *path) {
+    struct stat info; /* Status of the file */
+    void *data; /* Mapped contents */
+    size_t tables; /* Size of the header, records and slots */
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        perror("Error opening macro snapshot");
+        return false;
+    }
+
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < HEADER_WORDS * 4) {
+        fprintf(stderr, "Invalid macro snapshot: %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid */
+    if (data == MAP_FAILED) {
+        perror("Error mapping macro snapshot");
+        return false;
+    }
+
+    macro_snapshot_unload();
+    snapshot = (const unsigned char *)data;
+    snapshot_size = (size_t)info.st_size;
+    macros_count = get_word(snapshot + 4);
+    slots_count = get_word(snapshot + 8);
+    strings_size = get_word(snapshot + 12);
+    checksum = get_word(snapshot + 16);
+
+    /* Sizes are checked one by one, so that they cannot overflow */
+    tables = HEADER_WORDS * 4;
+    if (memcmp(snapshot, MACRO_SNAPSHOT_MAGIC, 4) != 0 ||
+        macros_count > (snapshot_size - tables) / (MACRO_WORDS * 4) ||
+        (tables += (size_t)macros_count * MACRO_WORDS * 4, slots_count > (snapshot_size - tables) / (SLOT_WORDS * 4)) ||
+        slots_count == 0 || (slots_count & (slots_count - 1)) != 0 || (size_t)slots_count < 2 * (size_t)macros_count ||
+        (tables += (size_t)slots_count * SLOT_WORDS * 4, strings_size != snapshot_size - tables) ||
+        checksum != compute_checksum(snapshot + HEADER_WORDS * 4, snapshot_size - HEADER_WORDS * 4)) {
+        fprintf(stderr, "Invalid macro snapshot: %s\n", path);
+        macro_snapshot_unload();
+        return false;
+    }
+
+    records = snapshot + HEADER_WORDS * 4;
+    slots = records + (size_t)macros_count * MACRO_WORDS * 4;
+    strings = (const char *)(slots + (size_t)slots_count * SLOT_WORDS * 4);
+    if (!check_records()) {
+        fprintf(stderr, "Invalid macro snapshot: %s\n", path);
+        macro_snapshot_unload();
+        return false;
+    }
+
+    return true;
+}
+
+bool macro_snapshot_find(const char *name, SnapshotMacro *macro) {
+    uint32_t hash; /* Hash of the name */
+    uint32_t slot; /* Slot probed */
+    uint32_t index; /* Macro of the slot */
+    const unsigned char *record; /* Record of the macro */
+
+    if (snapshot == NULL || macros_count == 0) {
+        return false;
+    }
+
+    hash = hash_label(name);
+    for (slot = hash & (slots_count - 1); ; slot = (slot + 1) & (slots_count - 1)) {
+        index = get_word(slots + slot * SLOT_WORDS * 4 + 4);
+        if (index == MACRO_SNAPSHOT_EMPTY) {
+            return false; /* Slots are at most half full, so probing ends */
+        }
+
+        record = records + (size_t)index * MACRO_WORDS * 4;
+        if (get_word(slots + slot * SLOT_WORDS * 4) == hash && !strcmp(strings + get_word(record), name)) {
+            break;
+        }
+    }
+
+    if (macro) {
+        macro->name = strings + get_word(record);
+        macro->body = strings + get_word(record + 4);
+        macro->size = get_word(record + 8);
+        macro->lines = get_word(record + 12);
+    }
+    return true;
+}
+
+uint32_t macro_snapshot_checksum(void) {
+    return snapshot ? checksum : 0;
+}
+
+void macro_snapshot_unload(void) {
+    if (snapshot) {
+        munmap((void *)snapshot, snapshot_size);
+    }
+
+    snapshot = NULL;
+    snapshot_size = 0;
+    macros_count = 0;
+    slots_count = 0;
+    records = NULL;
+    slots = NULL;
+    strings = NULL;
+    strings_size = 0;
+    checksum = 0;
+}
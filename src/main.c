@@ -1,42 +1,262 @@
+#define _POSIX_C_SOURCE 200809L /* open_memstream */
+
 /* Local includes */
 #include "../header/assembler.h"
+#include "../header/options.h"
+#include "../header/errors.h"
+#include "../header/batch_io.h"
+#include "../header/mem_stats.h"
+#include "../header/trace.h"
+#include "../header/cache.h"
+#include "../header/output.h"
+#include "../header/include.h"
+#include "../header/server.h"
+#include "../header/archive.h"
+#include "../header/preprocessing.h"
+#include "../header/macro_snapshot.h"
+#include "../header/workers.h"
 
 /* Standard includes */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define STREAM_INPUT "-" /* Input name selecting streaming mode (stdin to stdout) */
+#define INPUT_PATH_FORMAT "../inputs/%s.as" /* Path of an input file, from its name */
+
+/**
+ * @brief Starts batched I/O, prefetching the input files in order.
+ *
+ * @param inputs The input file names.
+ * @param inputs_count The number of input files.
+ * @param options Modes selected on the command line.
+ * @return The input paths, to be freed after `batch_io_finish`, or NULL if batched I/O is off.
+ */
+static char** start_batch_io(char **inputs, int inputs_count, const AssemblerOptions *options) {
+    char **paths; /* Input paths, NULL for names too long for a path */
+    size_t size; /* Size of a path */
+    int i; /* Loop variable */
+
+    if (options->io_threads == 0 || options->stream) {
+        return NULL;
+    }
+
+    paths = (char **)calloc(inputs_count + 1, sizeof(char *));
+    if (!paths) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < inputs_count; i++) {
+        size = strlen(INPUT_PATH_FORMAT) + strlen(inputs[i]);
+        if (size < 256) {
+            paths[i] = (char *)malloc(size);
+            if (!paths[i]) {
+                perror("Failed to allocate memory");
+                exit(EXIT_FAILURE);
+            }
+            sprintf(paths[i], INPUT_PATH_FORMAT, inputs[i]);
+        }
+    }
+
+    if (!batch_io_start(options->io_threads, paths, inputs_count, options->write_if_changed)) {
+        for (i = 0; i < inputs_count; i++) {
+            free(paths[i]);
+        }
+        free(paths);
+        return NULL; /* Fall back to synchronous I/O */
+    }
+
+    return paths;
+}
+
+/**
+ * @brief Compiles the macros of the inputs into a snapshot (--compile-macros).
+ *
+ * Each input is preprocessed on its own and its output dropped, keeping only
+ * its macros. A macro may be defined by several inputs, with the same body.
+ * The snapshot is only written if every input preprocessed without errors;
+ * otherwise, a snapshot left at its path by an earlier run is removed.
+ *
+ * @param inputs The input file names.
+ * @param inputs_count The number of input files.
+ * @param options Modes selected on the command line.
+ * @return true if the snapshot was written, false otherwise.
+ */
+static bool compile_macros(char **inputs, int inputs_count, const AssemblerOptions *options) {
+    SymbolList *library = NULL; /* Macros of every input */
+    SymbolList *macros; /* Macros of the current input */
+    SymbolList *node; /* Macro iterator */
+    SymbolList *existing; /* Macro of the library with the same name */
+    SymbolIndex index; /* Index of the library, by name */
+    FILE *file; /* The current input */
+    FILE *sink; /* Preprocessed output, dropped */
+    FILE *diagnostics; /* Error messages of the current input */
+    char *messages = NULL; /* Contents of diagnostics */
+    size_t messages_size = 0; /* Size of messages */
+    char input_path[256]; /* Path of the current input */
+    unsigned long count = 0; /* Number of macros in the library */
+    bool valid = true; /* Whether every input preprocessed without errors */
+    int res; /* Result of formatting a path */
+    int i; /* Loop variable */
+
+    symbol_index_init(&index, NULL);
+    for (i = 0; i < inputs_count; i++) {
+        res = snprintf(input_path, sizeof(input_path), INPUT_PATH_FORMAT, inputs[i]);
+        file = res < 0 || res >= (int)sizeof(input_path) ? NULL : fopen(input_path, "r");
+        sink = fopen("/dev/null", "w");
+        diagnostics = open_memstream(&messages, &messages_size);
+        if (!file || !sink || !diagnostics) {
+            perror("Error opening input file");
+            valid = false;
+            if (file) fclose(file);
+            if (sink) fclose(sink);
+            if (diagnostics) fclose(diagnostics);
+            free(messages);
+            messages = NULL;
+            continue;
+        }
+
+        /* Errors are counted by their messages, since preprocessing does not count them */
+        fprintf(options->log, "Processing file: %s\n", inputs[i]);
+        macros = NULL;
+        set_error_stream(diagnostics);
+        preprocess(file, sink, &macros, NULL);
+        set_error_stream(NULL);
+        fclose(diagnostics);
+        fclose(sink);
+        fclose(file);
+
+        if (messages_size > 0) {
+            fputs(messages, stdout);
+            valid = false;
+        }
+        free(messages);
+        messages = NULL;
+
+        for (node = macros; node != NULL; node = node->next) {
+            existing = symbol_index_find(&index, node->label);
+            if (existing == NULL) {
+                symbol_index_add(&index, add_symbol_string(&library, node->label, node->value.buffer, SYMBOL_MACRO));
+                count++;
+            } else if (strcmp(existing->value.buffer, node->value.buffer) != 0) {
+                /* Two different macros with the same name */
+                error_with_code_only(MACRO_ALREADY_DEFINED);
+                valid = false;
+            }
+        }
+        if (macros) free_symbol_list(macros);
+    }
+
+    if (valid && macro_snapshot_write(options->compile_macros, library)) {
+        fprintf(options->log, "Macro snapshot %s: %lu macro(s)\n", options->compile_macros, count);
+    } else {
+        fprintf(stderr, "Macro snapshot %s not written\n", options->compile_macros);
+        remove(options->compile_macros); /* A snapshot of an earlier library must not pass for this one */
+        valid = false;
+    }
+
+    symbol_index_free(&index);
+    if (library) free_symbol_list(library);
+    return valid;
+}
+
+/**
+ * @brief Looks an input up in the output cache, restoring its outputs on a hit.
+ *
+ * @param file The input, rewound afterwards.
+ * @param base_name Base name of the input.
+ * @param options Modes selected on the command line.
+ * @return true if the outputs were restored, false if the input must be assembled.
+ */
+static bool restore_from_cache(FILE *file, const char *base_name, const AssemblerOptions *options) {
+    char *source; /* Contents of the input */
+    size_t size; /* Size of source */
+    bool hit; /* Whether the outputs were restored */
+
+    if (!cache_active()) {
+        return false;
+    }
+
+    source = read_stream(file, &size);
+    if (!source) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    hit = cache_lookup(source, size, base_name, options);
+    free(source);
+    rewind(file);
+    return hit;
+}
+
 /**
  * @brief Processes a single input file and generates the corresponding output files.
  * 
  * This function handles opening the input file, creating the necessary output files,
  * and invoking the assembler to process the input.
  * 
- * @param input_file The path to the input file.
- * @return EXIT_SUCCESS on success, or EXIT_FAILURE on failure.
+ * @param input_file The path to the input file, or "-" to read stdin.
+ * @param options Modes selected on the command line.
+ * @return true if the outputs were written (or restored from the cache), false otherwise.
  */
-void process_file(const char *input_file) {
+bool process_file(const char *input_file, const AssemblerOptions *options) {
     FILE *file = NULL;
     FILE *am = NULL;
+    bool assembled = false; /* Whether the outputs were written */
+
+    if (!strcmp(input_file, STREAM_INPUT)) {
+        /* Streaming: no .am file, outputs are routed to stdout and descriptors */
+        return assemble(stdin, NULL, "stdin", options);
+    }
+
+    if (batch_io_active()) {
+        /* Batched I/O: the input was prefetched, and the outputs (.am included) are written in the background */
+        file = batch_io_next_input();
+        if (!file) {
+            perror("Error opening input file");
+            return false;
+        }
+
+        assembled = restore_from_cache(file, input_file, options);
+        if (!assembled) {
+            assembled = assemble(file, NULL, (char *)input_file, options);
+            cache_commit(); /* Store the outputs if the assembly succeeded */
+        }
+        batch_io_close_input(file);
+        return assembled;
+    }
 
     /* Construct the full path to the input file in the inputs/ directory */
     char input_path[256];
-    int res = snprintf(input_path, sizeof(input_path), "../inputs/%s.as", input_file);
+    int res = snprintf(input_path, sizeof(input_path), INPUT_PATH_FORMAT, input_file);
     if (res < 0 || res >= sizeof(input_path)) {
         fprintf(stderr, "Error creating input file path\n");
-        return;
+        return false;
     }
 
     /* Open the input file */
     file = fopen(input_path, "r");
     if (!file) {
         perror("Error opening input file");
-        return;
+        return false;
     }
 
     /* Extract the base name of the input file (without path and extension) */
     const char *base_name = input_file; /* Use the input_file name directly as the base name */
 
+    if (restore_from_cache(file, base_name, options)) {
+        assembled = true;
+        goto cleanup; /* Unchanged input, its outputs were restored */
+    }
+
+    if (options->check || options->write_if_changed) {
+        /* The preprocessed source stays in memory: nothing is written (syntax check), or the
+           .am output is compared with the existing file like the others */
+        assembled = assemble(file, NULL, (char *)base_name, options);
+        goto cleanup;
+    }
+
     /* Create output directory path and file paths */
     char path[256];
 
@@ -46,6 +266,7 @@ void process_file(const char *input_file) {
         goto cleanup;
     }
 
+    remove(path); /* Replace the file, which may be a hard link into the cache */
     am = fopen(path, "w+");
     if (!am) {
         fprintf(stderr, "Error opening .am file for writing: %s\n", path);
@@ -53,7 +274,7 @@ void process_file(const char *input_file) {
     }
 
     /* Assemble the input file */
-    assemble(file, am, base_name);
+    assembled = assemble(file, am, base_name, options);
 
     /* Cleanup wrapper to close files after execution */
     cleanup:
@@ -63,9 +284,11 @@ void process_file(const char *input_file) {
 
         if (am) {
             fclose(am);
+            cache_record(output_extension(OUTPUT_PREPROCESSED), path, NULL, 0);
         }
 
-        return;
+        cache_commit(); /* Store the outputs if the assembly succeeded */
+        return assembled;
 }
 
 /**
@@ -76,20 +299,177 @@ void process_file(const char *input_file) {
  * 
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line arguments.
- * @return EXIT_SUCCESS on success, or EXIT_FAILURE on failure.
+ * @return EXIT_SUCCESS if every input was assembled, EXIT_FAILURE otherwise.
  */
-void main(int argc, char *argv[]) {
+int main(int argc, char *argv[]) {
     int i; /* Loop variable */
+    int inputs_count = 0; /* Number of input files */
+    char **inputs; /* Input files, in command-line order */
+    char **paths; /* Input paths, when batched I/O is on */
+    int failed = 0; /* Number of inputs whose outputs were not written */
+    AssemblerOptions options; /* Modes selected on the command line */
+    TraceSpan span; /* Span of the file being processed */
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input_file1.as> [<input_file2.as> ...]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [options] <input_file1.as> [<input_file2.as> ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    inputs = (char **)malloc(argc * sizeof(char *));
+    if (!inputs) {
+        perror("Failed to allocate memory");
         return EXIT_FAILURE;
     }
 
-    /* Process each input file */
+    /* Parse the options, which may appear anywhere on the command line */
+    init_options(&options);
     for (i = 1; i < argc; i++) {
-        printf("Processing file: %s\n", argv[i]);
-        process_file(argv[i]);
+        if (is_option(argv[i])) {
+            if (!parse_option(argc, argv, &i, &options)) {
+                free(inputs);
+                return EXIT_FAILURE;
+            }
+        } else {
+            if (!strcmp(argv[i], STREAM_INPUT)) {
+                options.stream = true;
+            }
+            inputs[inputs_count++] = argv[i];
+        }
+    }
+
+    if (options.stream) {
+        if (inputs_count != 1) {
+            fprintf(stderr, "Streaming input \"-\" cannot be combined with other input files\n");
+            free(inputs);
+            return EXIT_FAILURE;
+        }
+
+        /* stdout carries the object image, so everything else goes to stderr */
+        options.log = stderr;
+        set_error_stream(stderr);
+    }
+
+    if (options.server_address) {
+        if (inputs_count > 0 || options.cache_dir || options.io_threads > 0) {
+            fprintf(stderr, "--server takes its inputs from requests, and cannot be combined with --cache or --io-threads\n");
+            free(inputs);
+            return EXIT_FAILURE;
+        }
+
+        /* Requests may be answered on stdout, so nothing else goes there */
+        options.log = stderr;
+        set_error_stream(stderr);
+    }
+
+    if (options.archive_name && (options.stream || options.server_address)) {
+        fprintf(stderr, "--archive packs the outputs of input files, and cannot be combined with streaming or --server\n");
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.stream_encode && (options.stream || options.image_format != IMAGE_NONE)) {
+        fprintf(stderr, "--stream-encode patches the .ob file in place, and cannot be combined with streaming input or --image-format\n");
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.check && (options.server_address || options.archive_name || options.stream_encode ||
+                          options.framed || options.image_format != IMAGE_NONE ||
+                          options.line_map || options.xref || options.size_report)) {
+        fprintf(stderr, "--check writes no output, and cannot be combined with --server or the options of an output\n");
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.compile_macros && (options.stream || options.server_address || options.check ||
+                                   options.archive_name || options.macros_path)) {
+        fprintf(stderr, "--compile-macros writes a snapshot instead of assembling, and cannot be combined with streaming, --server, --check, --archive or --macros\n");
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.compile_macros) {
+        i = compile_macros(inputs, inputs_count, &options);
+        include_free_all(); /* Files included by the library */
+        free(inputs);
+        return i ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.workers > 0 && (options.stream || options.server_address || options.io_threads > 0 ||
+                                options.cache_dir || options.trace_path)) {
+        fprintf(stderr, "--workers assembles every input in a worker process, and cannot be combined with streaming, --server, --io-threads, --cache or --trace\n");
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.macros_path && !macro_snapshot_load(options.macros_path)) {
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (options.check) {
+        /* stdout carries the diagnostics only */
+        options.log = stderr;
+        set_error_stream(stdout);
+    }
+
+    if (options.mem_stats) {
+        mem_stats_enable();
+    }
+
+    if (options.trace_path) {
+        trace_enable();
+    }
+
+    if (options.cache_dir && !options.stream && !options.check) {
+        cache_open(options.cache_dir, options.cache_size); /* Runs uncached if the directory is unusable */
+    }
+
+    if (options.server_address && !run_server(options.server_address, &options)) {
+        free(inputs);
+        return EXIT_FAILURE;
+    }
+
+    paths = start_batch_io(inputs, inputs_count, &options);
+
+    /* Process each input file, in worker processes or here if none could be started */
+    if (options.workers == 0 || !run_workers(inputs, inputs_count, process_file, &options, &failed)) {
+        for (i = 0; i < inputs_count; i++) {
+            fprintf(options.log, "Processing file: %s\n", inputs[i]);
+            trace_begin(&span, "process_file", inputs[i]);
+            failed += !process_file(inputs[i], &options);
+            trace_end(&span);
+        }
+    }
+
+    if (paths) {
+        if (!batch_io_finish()) { /* Write the remaining outputs */
+            failed++; /* An output written in the background is missing */
+        }
+        for (i = 0; i < inputs_count; i++) {
+            free(paths[i]);
+        }
+        free(paths);
+    }
+
+    if (options.archive_name) {
+        /* Every output is on disk now, including the ones written in the background */
+        if (failed > 0) {
+            fprintf(stderr, "Archive %s not written: %d input(s) failed to assemble\n", options.archive_name, failed);
+        } else if (write_archive(options.archive_name, inputs, inputs_count, &options)) {
+            fprintf(options.log, "Archive %s: %d module(s)\n", options.archive_name, inputs_count);
+        } else {
+            failed++; /* The archive is an output of the run */
+        }
+    }
+
+    cache_close(options.log); /* Report the cache counters */
+    include_free_all(); /* Included files are shared by every input */
+    macro_snapshot_unload();
+
+    if (options.trace_path) {
+        trace_write(options.trace_path); /* Every thread has finished recording */
     }
 
-    return EXIT_SUCCESS;
+    free(inputs);
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#include "../header/mem_stats.h"
+
+static int enabled = 0; /* Whether memory accounting is on */
+static MemCounter counters[MEM_CATEGORIES + 1]; /* Per category, then the total */
+
+static const char *category_names[MEM_CATEGORIES] = {
+    "words",          /* MEM_WORDS */
+    "list nodes",     /* MEM_LIST_NODES */
+    "symbol nodes",   /* MEM_SYMBOL_NODES */
+    "label strings",  /* MEM_LABELS */
+    "macro bodies"    /* MEM_MACRO_BODIES */
+};
+
+/**
+ * @brief Adds to the live bytes of a counter, raising its peak if needed.
+ *
+ * @param counter The counter.
+ * @param delta The change in live bytes.
+ */
+static void add_live(MemCounter *counter, long delta) {
+    long live = __atomic_add_fetch(&counter->live_bytes, delta, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&counter->peak_bytes, __ATOMIC_RELAXED);
+
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&counter->peak_bytes, &peak, live, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* Another thread moved the peak, retry against its value */
+    }
+}
+
+void mem_stats_enable(void) {
+    enabled = 1;
+}
+
+void mem_track_alloc(MemCategory category, size_t size) {
+    if (!enabled) {
+        return;
+    }
+
+    __atomic_add_fetch(&counters[category].allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters[MEM_CATEGORIES].allocations, 1, __ATOMIC_RELAXED);
+    add_live(&counters[category], (long)size);
+    add_live(&counters[MEM_CATEGORIES], (long)size);
+}
+
+void mem_track_free(MemCategory category, size_t size) {
+    if (!enabled) {
+        return;
+    }
+
+    add_live(&counters[category], -(long)size);
+    add_live(&counters[MEM_CATEGORIES], -(long)size);
+}
+
+void mem_stats_begin_phase(void) {
+    int i; /* Loop variable */
+
+    for (i = 0; i <= MEM_CATEGORIES; i++) {
+        __atomic_store_n(&counters[i].allocations, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&counters[i].peak_bytes,
+                         __atomic_load_n(&counters[i].live_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+void mem_stats_report(FILE *log, const char *phase) {
+    int i; /* Loop variable */
+
+    if (!enabled) {
+        return;
+    }
+
+    fprintf(log, "  %-24s %-14s %8s %12s %12s\n", phase, "category", "allocs", "live bytes", "peak bytes");
+    for (i = 0; i <= MEM_CATEGORIES; i++) {
+        fprintf(log, "  %-24s %-14s %8ld %12ld %12ld\n", "",
+                i < MEM_CATEGORIES ? category_names[i] : "total",
+                counters[i].allocations, counters[i].live_bytes, counters[i].peak_bytes);
+    }
+
+    mem_stats_begin_phase();
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/options.h"
+#include "../header/assembler.h"
+#include "../header/output.h"
+
+void init_options(AssemblerOptions *options) {
+    options->pool_data = false;
+    options->relax_branches = false;
+    options->stream = false;
+    options->framed = false;
+    options->ent_fd = -1;
+    options->ext_fd = -1;
+    options->log = stdout;
+    options->image_format = IMAGE_NONE;
+    options->load_address = START_LINE;
+    options->pipeline = false;
+    options->io_threads = 0;
+    options->mem_stats = false;
+    options->trace_path = NULL;
+    options->cache_dir = NULL;
+    options->cache_size = CACHE_DEFAULT_SIZE;
+    options->server_address = NULL;
+    options->server_threads = DEFAULT_SERVER_THREADS;
+    options->output_dir = OUTPUT_DIR;
+    options->line_map = false;
+    options->xref = false;
+    options->archive_name = NULL;
+    options->stream_encode = false;
+    options->size_report = false;
+    options->check = false;
+    options->write_if_changed = false;
+    options->compile_macros = NULL;
+    options->macros_path = NULL;
+    options->workers = 0;
+}
+
+/**
+ * @brief Parses the value of an option that takes a non-negative number.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @param index Pointer to the index of the option, advanced past its value.
+ * @param value Output for the parsed number.
+ * @return true if a valid number followed the option, false otherwise.
+ */
+static bool parse_number_value(int argc, char *argv[], int *index, long *value) {
+    char *end; /* End of the parsed number */
+
+    if (*index + 1 >= argc) {
+        fprintf(stderr, "Missing value for option: %s\n", argv[*index]);
+        return false;
+    }
+
+    *value = strtol(argv[*index + 1], &end, 0);
+    if (*end != '\0' || *value < 0) {
+        fprintf(stderr, "Invalid value for option %s: %s\n", argv[*index], argv[*index + 1]);
+        return false;
+    }
+
+    (*index)++; /* Consume the value */
+    return true;
+}
+
+bool is_option(const char *arg) {
+    return arg != NULL && arg[0] == '-' && arg[1] == '-';
+}
+
+bool parse_option(int argc, char *argv[], int *index, AssemblerOptions *options) {
+    char *arg = argv[*index]; /* The option currently parsed */
+    long value; /* Value of an option that takes a number */
+
+    if (!strcmp(arg, "--pool-data")) {
+        options->pool_data = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--relax-branches")) {
+        options->relax_branches = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--mem-stats")) {
+        options->mem_stats = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--line-map")) {
+        options->line_map = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--xref")) {
+        options->xref = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--stream-encode")) {
+        options->stream_encode = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--size-report")) {
+        options->size_report = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--check")) {
+        options->check = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--write-if-changed")) {
+        options->write_if_changed = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--pipeline")) {
+        options->pipeline = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--framed")) {
+        options->framed = true;
+        return true;
+    }
+
+    if (!strcmp(arg, "--format")) {
+        if (*index + 1 >= argc || parse_image_format(argv[*index + 1]) == IMAGE_NONE) {
+            fprintf(stderr, "Expected bin, ihex or srec after --format\n");
+            return false;
+        }
+
+        options->image_format = parse_image_format(argv[++(*index)]);
+        return true;
+    }
+
+    if (!strcmp(arg, "--trace")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected a file name after --trace\n");
+            return false;
+        }
+
+        options->trace_path = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--cache")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected a directory after --cache\n");
+            return false;
+        }
+
+        options->cache_dir = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--archive")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected an archive name after --archive\n");
+            return false;
+        }
+
+        options->archive_name = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--compile-macros")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected a snapshot file after --compile-macros\n");
+            return false;
+        }
+
+        options->compile_macros = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--macros")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected a snapshot file after --macros\n");
+            return false;
+        }
+
+        options->macros_path = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--server")) {
+        if (*index + 1 >= argc) {
+            fprintf(stderr, "Expected a socket path or \"-\" after --server\n");
+            return false;
+        }
+
+        options->server_address = argv[++(*index)];
+        return true;
+    }
+
+    if (!strcmp(arg, "--server-threads")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (value < 1 || value > MAX_JOBS) {
+            fprintf(stderr, "Number of server threads must be between 1 and %d\n", MAX_JOBS);
+            return false;
+        }
+
+        options->server_threads = (int)value;
+        return true;
+    }
+
+    if (!strcmp(arg, "--workers")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (value < 1 || value > MAX_JOBS) {
+            fprintf(stderr, "Number of workers must be between 1 and %d\n", MAX_JOBS);
+            return false;
+        }
+
+        options->workers = (int)value;
+        return true;
+    }
+
+    if (!strcmp(arg, "--cache-size")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (value > MAX_CACHE_SIZE) {
+            fprintf(stderr, "Cache size must not exceed %ld KiB\n", MAX_CACHE_SIZE);
+            return false;
+        }
+
+        options->cache_size = value;
+        return true;
+    }
+
+    if (!strcmp(arg, "--load-address")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (value > MAX_LOAD_ADDRESS) {
+            fprintf(stderr, "Load address must not exceed %d\n", MAX_LOAD_ADDRESS);
+            return false;
+        }
+
+        options->load_address = (uint16_t)value;
+        return true;
+    }
+
+    if (!strcmp(arg, "--io-threads")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (value > MAX_JOBS) {
+            fprintf(stderr, "Number of I/O threads must be at most %d\n", MAX_JOBS);
+            return false;
+        }
+
+        options->io_threads = (int)value;
+        return true;
+    }
+
+    if (!strcmp(arg, "--ent-fd") || !strcmp(arg, "--ext-fd")) {
+        if (!parse_number_value(argc, argv, index, &value)) {
+            return false;
+        }
+
+        if (!strcmp(arg, "--ent-fd")) {
+            options->ent_fd = (int)value;
+        } else {
+            options->ext_fd = (int)value;
+        }
+        return true;
+    }
+
+    fprintf(stderr, "Unknown option: %s\n", arg);
+    return false;
+}
@@ -0,0 +1,310 @@
+#define _POSIX_C_SOURCE 200809L /* open_memstream, fdopen, strdup, open, getpid */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../header/output.h"
+#include "../header/batch_io.h"
+#include "../header/cache.h"
+
+const char* output_extension(OutputKind kind) {
+    switch (kind) {
+        case OUTPUT_PREPROCESSED: return "am";
+        case OUTPUT_OBJECT:    return "ob";
+        case OUTPUT_ENTRIES:   return "ent";
+        case OUTPUT_EXTERNALS: return "ext";
+        case OUTPUT_BINARY:    return "bin";
+        case OUTPUT_IHEX:      return "hex";
+        case OUTPUT_SREC:      return "srec";
+        case OUTPUT_LINE_MAP:  return "map";
+        case OUTPUT_XREF:      return "xref";
+        case OUTPUT_ARCHIVE:   return "lib";
+        case OUTPUT_SIZE_REPORT: return "size";
+        case OUTPUT_SIZE_CSV:  return "size.csv";
+        default:               return "";
+    }
+}
+
+bool open_output(Output *output, const char *base_name, OutputKind kind,
+                 const AssemblerOptions *options) {
+    char path[256]; /* Path of the output file */
+    int fd; /* File descriptor requested for the output, when streaming */
+    int res; /* Result of formatting the path */
+
+    output->stream = NULL;
+    output->kind = kind;
+    output->owns_stream = true;
+    output->framed = false;
+    output->buffer = NULL;
+    output->size = 0;
+    output->path = NULL;
+    output->deferred = false;
+    output->if_changed = false;
+    trace_begin(&output->span, "write_output", output_extension(kind));
+
+    if (options->stream && kind == OUTPUT_PREPROCESSED) {
+        return false; /* Streaming keeps the preprocessed source in memory only */
+    }
+
+    if (options->stream && options->framed) {
+        /* Buffer the output in memory, so its size is known when framing it */
+        output->stream = open_memstream(&output->buffer, &output->size);
+        output->framed = true;
+        if (!output->stream) {
+            perror("Error buffering output");
+            return false;
+        }
+
+        return true;
+    }
+
+    if (options->stream) {
+        if (kind == OUTPUT_OBJECT) {
+            output->stream = stdout; /* The object image is the stream's payload */
+            output->owns_stream = false;
+            return true;
+        }
+
+        fd = (kind == OUTPUT_ENTRIES) ? options->ent_fd :
+             (kind == OUTPUT_EXTERNALS) ? options->ext_fd : -1;
+        if (fd < 0) {
+            return false; /* No descriptor requested, drop the output */
+        }
+
+        output->stream = fdopen(fd, "w");
+        if (!output->stream) {
+            fprintf(stderr, "Error opening file descriptor %d for .%s output\n", fd, output_extension(kind));
+            return false;
+        }
+
+        return true;
+    }
+
+    res = snprintf(path, sizeof(path), "%s%s.%s", options->output_dir, base_name, output_extension(kind));
+    if (res < 0 || res >= (int)sizeof(path)) {
+        fprintf(stderr, "Error creating .%s file path\n", output_extension(kind));
+        return false;
+    }
+
+    if (batch_io_active()) {
+        /* Build the output in memory, the writer thread creates the file */
+        output->stream = open_memstream(&output->buffer, &output->size);
+        output->path = strdup(path);
+        output->deferred = true;
+        if (!output->stream || !output->path) {
+            perror("Error buffering output");
+            if (output->stream) fclose(output->stream);
+            free(output->buffer);
+            free(output->path);
+            output->stream = NULL;
+            output->buffer = NULL;
+            output->path = NULL;
+            output->deferred = false;
+            return false;
+        }
+
+        return true;
+    }
+
+    if (options->write_if_changed) {
+        /* Build the output in memory, the file is only replaced if it differs */
+        output->stream = open_memstream(&output->buffer, &output->size);
+        if (!output->stream) {
+            perror("Error buffering output");
+            return false;
+        }
+
+        output->if_changed = true;
+        output->path = strdup(path);
+        if (!output->path) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        return true;
+    }
+
+    remove(path); /* Replace the file, which may be a hard link into the cache */
+    output->stream = fopen(path, "w+"); /* Open the path with writing+ perms */
+    if (!output->stream) {
+        fprintf(stderr, "Error opening .%s file for writing: %s\n", output_extension(kind), path);
+        return false;
+    }
+
+    output->path = strdup(path);
+    if (!output->path) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+bool close_output(Output *output) {
+    bool written = true; /* Whether the file was written */
+
+    if (output->stream == NULL) {
+        return true; /* Never opened */
+    }
+
+    if (output->owns_stream) {
+        fclose(output->stream);
+    } else {
+        fflush(output->stream);
+    }
+
+    if (output->framed) {
+        /* Frame header, then the exact bytes of the output */
+        fprintf(stdout, "%s %lu\n", output_extension(output->kind), (unsigned long)output->size);
+        fwrite(output->buffer, 1, output->size, stdout);
+        fflush(stdout);
+        free(output->buffer);
+    }
+
+    if (output->deferred) {
+        cache_record(output_extension(output->kind), NULL, output->buffer, output->size);
+        batch_io_write(output->path, output->buffer, output->size); /* The writer thread takes both */
+    } else if (output->path) {
+        if (output->if_changed) {
+            written = replace_if_changed(output->path, output->buffer, output->size); /* Removes its temporary file on failure */
+            /* Recorded from memory: linking the file into the cache would touch it */
+            cache_record(output_extension(output->kind), NULL, output->buffer, output->size);
+            free(output->buffer);
+        } else {
+            cache_record(output_extension(output->kind), output->path, NULL, 0);
+        }
+        free(output->path);
+    }
+
+    output->stream = NULL;
+    output->path = NULL;
+    output->buffer = NULL;
+    trace_end(&output->span);
+    return written;
+}
+
+void discard_output(Output *output) {
+    if (output->stream == NULL) {
+        return; /* Never opened */
+    }
+
+    if (output->owns_stream) {
+        fclose(output->stream);
+    }
+
+    if (output->framed || output->deferred || output->if_changed) {
+        free(output->buffer); /* Never framed, queued nor compared, the existing file is kept */
+    } else if (output->path) {
+        remove(output->path);
+    }
+
+    free(output->path);
+    output->stream = NULL;
+    output->path = NULL;
+    output->buffer = NULL;
+    trace_end(&output->span);
+}
+
+void remove_output(const char *base_name, OutputKind kind, const AssemblerOptions *options) {
+    char path[256]; /* Path of the output file */
+    char *queued; /* Copy of the path, taken by the writer thread */
+    int res; /* Result of formatting the path */
+
+    if (options->stream) {
+        return; /* Nothing was written to a file */
+    }
+
+    res = snprintf(path, sizeof(path), "%s%s.%s", options->output_dir, base_name, output_extension(kind));
+    if (res < 0 || res >= (int)sizeof(path)) {
+        return;
+    }
+
+    if (batch_io_active()) {
+        queued = strdup(path);
+        if (!queued) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        batch_io_remove(queued); /* After the writes already queued for this path */
+    } else {
+        remove(path); /* Fails harmlessly if there is no such file */
+    }
+}
+
+/**
+ * @brief Tells whether a file holds exactly the given contents.
+ *
+ * @param path Path of the file.
+ * @param buffer The contents.
+ * @param size Size of `buffer`.
+ * @return true if the file exists and holds the contents.
+ */
+static bool file_matches(const char *path, const char *buffer, size_t size) {
+    struct stat info; /* Size and type of the file */
+    char chunk[4096]; /* Bytes of the file being compared */
+    size_t offset = 0; /* Bytes compared so far */
+    size_t count; /* Bytes read into chunk */
+    bool same = true; /* Whether the bytes compared so far match */
+    FILE *file; /* The file */
+
+    /* The size is compared first, without reading the file */
+    if (stat(path, &info) != 0 || !S_ISREG(info.st_mode) || (size_t)info.st_size != size) {
+        return false;
+    }
+
+    file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    while (same && (count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        same = offset + count <= size && !memcmp(chunk, buffer + offset, count);
+        offset += count;
+    }
+
+    fclose(file);
+    return same && offset == size;
+}
+
+bool replace_if_changed(const char *path, const char *buffer, size_t size) {
+    char temp[300]; /* Path of the temporary file */
+    FILE *file; /* The temporary file */
+    bool written; /* Whether the temporary file was written */
+    int fd; /* Descriptor of the temporary file */
+    int res; /* Result of formatting the path */
+
+    if (file_matches(path, buffer, size)) {
+        return true; /* Unchanged, keep the file and its modification time */
+    }
+
+    res = snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long)getpid());
+    if (res < 0 || res >= (int)sizeof(temp)) {
+        fprintf(stderr, "Error creating temporary file path for %s\n", path);
+        return false;
+    }
+
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666); /* The usual permissions, under the umask */
+    file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!file) {
+        fprintf(stderr, "Error opening file for writing: %s\n", temp);
+        if (fd >= 0) {
+            close(fd);
+            remove(temp);
+        }
+        return false;
+    }
+
+    written = fwrite(buffer, 1, size, file) == size;
+    written = (fclose(file) == 0) && written;
+    if (!written || rename(temp, path) != 0) {
+        fprintf(stderr, "Error replacing file: %s\n", path);
+        remove(temp);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE /* fopencookie */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "../header/pipeline.h"
+#include "../header/preprocessing.h"
+#include "../header/first_pass.h"
+#include "../header/errors.h"
+#include "../header/macro_snapshot.h"
+
+/**
+ * @brief Stages and rings of a running pipeline.
+ */
+typedef struct {
+    FILE *file;            /* Source file, read by the reader */
+    LineRing source_ring;  /* Reader -> macro expander */
+    LineRing am_ring;      /* Macro expander -> first pass */
+    FILE *expander_in;     /* Macro expander's view of `source_ring` */
+    FILE *expander_out;    /* Macro expander's view of `am_ring` */
+    SymbolList *macros;    /* Macros found by the expander */
+    SourceMap *map;        /* Origins of the .am lines, filled by the expander, or NULL */
+} Pipeline;
+
+/**
+ * @brief Returns the head record of a ring.
+ *
+ * @param ring The ring.
+ * @param wait Whether to wait for a record while the ring is empty and open.
+ * @return The head record, or NULL if there is none (yet).
+ */
+static LineRecord* ring_front(LineRing *ring, bool wait) {
+    unsigned long head = ring->head; /* Only the consumer writes the head */
+
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+        if (!wait || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+            /* Records written before closing are visible once `closed` is */
+            if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+                return NULL;
+            }
+            break;
+        }
+        sched_yield();
+    }
+
+    return &ring->records[head & (PIPELINE_RING_SIZE - 1)];
+}
+
+/**
+ * @brief Releases the head record of a ring to the producer.
+ *
+ * @param ring The ring.
+ */
+static void ring_pop(LineRing *ring) {
+    ring->offset = 0;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Publishes the pending record of a ring, waiting while the ring is full.
+ *
+ * @param ring The ring.
+ */
+static void ring_push(LineRing *ring) {
+    unsigned long tail = ring->tail; /* Only the producer writes the tail */
+
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == PIPELINE_RING_SIZE) {
+        sched_yield(); /* Full: let the consumer catch up */
+    }
+
+    ring->records[tail & (PIPELINE_RING_SIZE - 1)] = ring->pending;
+    ring->pending.length = 0;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Writes bytes to a ring, cutting them into line records.
+ *
+ * @param cookie The ring.
+ * @param data The bytes to write.
+ * @param size The number of bytes.
+ * @return The number of bytes written.
+ */
+static ssize_t ring_write(void *cookie, const char *data, size_t size) {
+    LineRing *ring = (LineRing *)cookie;
+    size_t i; /* Loop variable */
+
+    for (i = 0; i < size; i++) {
+        ring->pending.data[ring->pending.length++] = data[i];
+        if (data[i] == '\n' || ring->pending.length == PIPELINE_RECORD_SIZE) {
+            ring_push(ring);
+        }
+    }
+
+    return (ssize_t)size;
+}
+
+/**
+ * @brief Closes the producer side of a ring.
+ *
+ * @param cookie The ring.
+ * @return 0.
+ */
+static int ring_close(void *cookie) {
+    LineRing *ring = (LineRing *)cookie;
+
+    if (ring->pending.length > 0) {
+        ring_push(ring); /* Last line without a newline */
+    }
+
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Reads bytes from a ring, waiting only while nothing was read.
+ *
+ * @param cookie The ring.
+ * @param buffer Output for the bytes.
+ * @param size The maximum number of bytes to read.
+ * @return The number of bytes read, 0 at the end of the ring.
+ */
+static ssize_t ring_read(void *cookie, char *buffer, size_t size) {
+    LineRing *ring = (LineRing *)cookie;
+    LineRecord *record; /* Record being read */
+    size_t copied = 0; /* Bytes read so far */
+    size_t length; /* Bytes taken from the record */
+
+    while (copied < size && (record = ring_front(ring, copied == 0)) != NULL) {
+        length = record->length - ring->offset;
+        if (length > size - copied) {
+            length = size - copied;
+        }
+
+        memcpy(buffer + copied, record->data + ring->offset, length);
+        ring->offset += length;
+        copied += length;
+        if (ring->offset == record->length) {
+            ring_pop(ring);
+        }
+    }
+
+    if (ring->tee != NULL && copied > 0) {
+        fwrite(buffer, 1, copied, ring->tee); /* Keep the .am file for the second pass */
+    }
+
+    return (ssize_t)copied;
+}
+
+/**
+ * @brief Closes the consumer side of a ring.
+ *
+ * @param cookie The ring.
+ * @return 0.
+ */
+static int ring_release(void *cookie) {
+    (void)cookie;
+    return 0;
+}
+
+/**
+ * @brief Opens a stream over a ring.
+ *
+ * @param ring The ring.
+ * @param mode "r" for the consumer side, "w" for the producer side.
+ * @return The stream, or NULL on failure.
+ */
+static FILE* ring_open(LineRing *ring, const char *mode) {
+    cookie_io_functions_t functions; /* Stream callbacks */
+    FILE *stream; /* Stream over the ring */
+
+    memset(&functions, 0, sizeof(functions));
+    if (mode[0] == 'r') {
+        functions.read = ring_read;
+        functions.close = ring_release;
+    } else {
+        functions.write = ring_write;
+        functions.close = ring_close;
+    }
+
+    stream = fopencookie(ring, mode, functions);
+    if (stream != NULL && mode[0] == 'w') {
+        setvbuf(stream, NULL, _IOLBF, 0); /* Hand every line to the next stage right away */
+    }
+
+    return stream;
+}
+
+/**
+ * @brief Reader stage: copies the source file into the source ring.
+ *
+ * @param arg The pipeline.
+ * @return NULL.
+ */
+static void* read_stage(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+    char chunk[PIPELINE_READ_SIZE]; /* Bytes read at once */
+    size_t length; /* Number of bytes read */
+
+    while ((length = fread(chunk, 1, sizeof(chunk), pipeline->file)) > 0) {
+        ring_write(&pipeline->source_ring, chunk, length);
+    }
+
+    ring_close(&pipeline->source_ring);
+    return NULL;
+}
+
+/**
+ * @brief Macro expander stage: preprocesses the source ring into the .am ring.
+ *
+ * @param arg The pipeline.
+ * @return NULL.
+ */
+static void* expand_stage(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+
+    preprocess(pipeline->expander_in, pipeline->expander_out, &pipeline->macros, pipeline->map);
+    fclose(pipeline->expander_out); /* Flushes, then closes the .am ring */
+    return NULL;
+}
+
+/**
+ * @brief Checks whether a label of the symbol table is also a macro name.
+ *
+ * @param symbols The symbol table.
+ * @param macros The linked list of macros.
+ * @return true if some label is a macro name.
+ */
+static bool labels_shadow_macros(SymbolList *symbols, SymbolList *macros) {
+    for (; symbols != NULL; symbols = symbols->next) {
+        if (is_symbol_exists(macros, symbols->label) || macro_snapshot_find(symbols->label, NULL)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool pipeline_first_pass(FILE *file, FILE *am, SymbolList **macros_ptr,
+                         SymbolList **symbols_ptr, uint8_t *errors,
+                         uint8_t *number_of_lines, DataPool *pool,
+                         SourceMap *map, const AssemblerOptions *options) {
+    Pipeline *pipeline; /* Pipeline state, shared by the stages */
+    FILE *first_pass_in = NULL; /* First pass's view of the .am ring */
+    pthread_t reader; /* Reader thread */
+    pthread_t expander; /* Macro expander thread */
+    char drain[PIPELINE_READ_SIZE]; /* Lines the first pass left unread */
+    bool collected; /* Whether the symbol table can be kept */
+
+    pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+    if (!pipeline) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    pipeline->file = file;
+    pipeline->map = map;
+    pipeline->am_ring.tee = am;
+    pipeline->expander_in = ring_open(&pipeline->source_ring, "r");
+    pipeline->expander_out = ring_open(&pipeline->am_ring, "w");
+    first_pass_in = ring_open(&pipeline->am_ring, "r");
+
+    if (!pipeline->expander_in || !pipeline->expander_out || !first_pass_in ||
+        pthread_create(&reader, NULL, read_stage, pipeline) != 0) {
+        /* Nothing was read yet: preprocess serially */
+        if (pipeline->expander_in) fclose(pipeline->expander_in);
+        if (pipeline->expander_out) fclose(pipeline->expander_out);
+        if (first_pass_in) fclose(first_pass_in);
+        free(pipeline);
+        preprocess(file, am, macros_ptr, map);
+        return false;
+    }
+
+    if (pthread_create(&expander, NULL, expand_stage, pipeline) != 0) {
+        /* Expand macros on this thread, straight into the .am file */
+        preprocess(pipeline->expander_in, am, macros_ptr, map);
+        pthread_join(reader, NULL);
+        fclose(pipeline->expander_in);
+        fclose(pipeline->expander_out);
+        fclose(first_pass_in);
+        free(pipeline);
+        return false;
+    }
+
+    /* Symbol collection runs without macros, which are only known at the end */
+    mute_errors(true);
+    first_pass(first_pass_in, symbols_ptr, errors, number_of_lines, NULL, pool, options);
+    mute_errors(false);
+
+    while (fread(drain, 1, sizeof(drain), first_pass_in) > 0) {
+        /* Copy whatever the first pass did not read to the .am file */
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(expander, NULL);
+    fclose(first_pass_in);
+    fclose(pipeline->expander_in);
+
+    *macros_ptr = pipeline->macros;
+    collected = *errors == 0 && !labels_shadow_macros(*symbols_ptr, pipeline->macros);
+    if (!collected) {
+        /* Discard the result: the serial first pass reports the diagnostics */
+        free_symbol_list(*symbols_ptr);
+        *symbols_ptr = NULL;
+        *errors = 0;
+        *number_of_lines = 0;
+    }
+
+    free(pipeline);
+    return collected;
+}
@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L /* open_memstream, fmemopen */
+
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../header/preprocessing.h"
 #include "../header/assembler.h"
@@ -7,6 +10,191 @@
 #include "../header/lib.h"
 #include "../header/errors.h"
 #include "../header/opcode.h"
+#include "../header/scanner.h"
+#include "../header/trace.h"
+#include "../header/include.h"
+#include "../header/macro_snapshot.h"
+
+static void preprocess_source(FILE* file, FILE* temp, SymbolList** macros_ptr,
+                              IncludeList** included, IncludeUnit* recording, SourceMap* map);
+
+/**
+ * @brief Counts the lines of a text.
+ * 
+ * @param text The text.
+ * @param size The size of the text.
+ * @return The number of newline characters in the text.
+ */
+static uint32_t count_lines(const char* text, size_t size) {
+    const char* end = text + size; /* End of the text */
+    uint32_t lines = 0; /* Lines counted so far */
+
+    while ((text = memchr(text, '\n', end - text)) != NULL) {
+        lines++;
+        text++;
+    }
+
+    return lines;
+}
+
+/**
+ * @brief Adds macros to a macros list, skipping those it already defines identically.
+ * 
+ * @param macros_ptr Pointer to the macros list to add to.
+ * @param added The macros to add.
+ */
+static void merge_macros(SymbolList** macros_ptr, SymbolList* added) {
+    SymbolList* existing; /* Macro of the list with the same name */
+    SnapshotMacro shared; /* Macro of the snapshot with the same name (--macros) */
+
+    for (; added != NULL; added = added->next) {
+        existing = get_symbol_by_label(*macros_ptr, added->label);
+        if (existing == NULL && macro_snapshot_find(added->label, &shared)) {
+            if (strcmp(shared.body, added->value.buffer) != 0) {
+                error_with_code_only(MACRO_ALREADY_DEFINED);
+            }
+        } else if (existing == NULL) {
+            add_symbol_string(macros_ptr, added->label, added->value.buffer, SYMBOL_MACRO);
+        } else if (strcmp(existing->value.buffer, added->value.buffer) != 0) {
+            /* Two different macros with the same name */
+            error_with_code_only(MACRO_ALREADY_DEFINED);
+        }
+    }
+}
+
+/**
+ * @brief Preprocesses an included file, once per run.
+ * 
+ * The file is expanded on its own, into its `text`. Its `.include` lines are
+ * kept as splice points rather than expanded.
+ * 
+ * @param unit The included file.
+ */
+static void parse_unit(IncludeUnit* unit) {
+    FILE* in; /* Stream over the included file */
+    FILE* out; /* Stream building the expanded text */
+    SymbolList* macros = NULL; /* Macros of the file */
+    TraceSpan span; /* Span of the preprocessing (--trace) */
+
+    trace_begin(&span, "preprocess", unit->name);
+    unit->state = INCLUDE_PARSING;
+    out = open_memstream(&unit->text, &unit->text_size);
+    if (!out) {
+        perror("Error buffering included file");
+        exit(EXIT_FAILURE);
+    }
+
+    if (unit->size > 0) {
+        in = fmemopen(unit->data, unit->size, "r");
+        if (!in) {
+            perror("Error reading included file");
+            exit(EXIT_FAILURE);
+        }
+
+        preprocess_source(in, out, &macros, NULL, unit, NULL);
+        fclose(in);
+    }
+
+    fclose(out);
+    unit->macros = macros;
+    __atomic_store_n(&unit->state, INCLUDE_PARSED, __ATOMIC_RELEASE); /* Publish the text, splices and macros */
+    trace_end(&span);
+}
+
+/**
+ * @brief Splices an included file into the preprocessed output, unless it was already included.
+ * 
+ * @param unit The included file.
+ * @param temp The preprocessed output.
+ * @param macros_ptr Pointer to the macros list, receiving the file's macros.
+ * @param included Files already spliced into the output (include guards).
+ * @param lines Incremented by the number of lines written, or NULL when not needed.
+ */
+static void splice_unit(IncludeUnit* unit, FILE* temp, SymbolList** macros_ptr, IncludeList** included,
+                        uint32_t* lines) {
+    IncludeSplice* splice; /* Nested include */
+    size_t offset = 0; /* Offset of the text not written yet */
+
+    if (__atomic_load_n(&unit->state, __ATOMIC_ACQUIRE) != INCLUDE_PARSED || !include_guard(included, unit)) {
+        return; /* Already included */
+    }
+
+    merge_macros(macros_ptr, unit->macros);
+    for (splice = unit->splices; splice != NULL; splice = splice->next) {
+        fwrite(unit->text + offset, 1, splice->offset - offset, temp);
+        if (lines) *lines += count_lines(unit->text + offset, splice->offset - offset);
+        splice_unit(splice->unit, temp, macros_ptr, included, lines);
+        offset = splice->offset;
+    }
+
+    fwrite(unit->text + offset, 1, unit->text_size - offset, temp);
+    if (lines) *lines += count_lines(unit->text + offset, unit->text_size - offset);
+}
+
+/**
+ * @brief Handles an `.include` line.
+ * 
+ * @param args The rest of the line, after the directive.
+ * @param temp The preprocessed output.
+ * @param macros_ptr Pointer to the macros list.
+ * @param included Files already spliced into the output (include guards).
+ * @param recording The included file being preprocessed, or NULL for an input.
+ * @param lines Incremented by the number of lines spliced into an input, or NULL when not needed.
+ * @return The included file, or NULL if the directive is invalid.
+ */
+static IncludeUnit* include_directive(const char* args, FILE* temp, SymbolList** macros_ptr,
+                                      IncludeList** included, IncludeUnit* recording, uint32_t* lines) {
+    char name[INCLUDE_NAME_SIZE]; /* Name of the included file */
+    IncludeUnit* unit; /* The included file */
+    IncludeSplice* splice; /* Splice point, when preprocessing an included file */
+
+    if (!include_parse_name(args, name)) {
+        error_with_code_only(INVALID_INCLUDE);
+        return NULL;
+    }
+
+    unit = include_load(name);
+    if (unit->data == NULL) {
+        error_with_code_only(INCLUDE_NOT_FOUND);
+        return NULL;
+    }
+
+    if (__atomic_load_n(&unit->state, __ATOMIC_ACQUIRE) != INCLUDE_PARSED) {
+        include_lock(); /* Another thread may be preprocessing it */
+        if (unit->state == INCLUDE_NEW) {
+            parse_unit(unit); /* First inclusion in the run */
+        }
+        include_unlock();
+    }
+
+    if (recording == NULL) {
+        splice_unit(unit, temp, macros_ptr, included, lines);
+        return unit;
+    }
+
+    /* Inside an included file: keep a splice point, so guards apply when it is spliced */
+    splice = (IncludeSplice *)malloc(sizeof(IncludeSplice));
+    if (!splice) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    fflush(temp);
+    splice->offset = (size_t)ftell(temp);
+    splice->unit = unit;
+    splice->next = NULL;
+    if (recording->last_splice) {
+        recording->last_splice->next = splice;
+    } else {
+        recording->splices = splice;
+    }
+    recording->last_splice = splice;
+
+    if (unit->state == INCLUDE_PARSED) {
+        merge_macros(macros_ptr, unit->macros); /* Not yet parsed when reached through a cycle */
+    }
+    return unit;
+}
 
 /**
  * @brief Preprocesses the input file for the assembler.
@@ -16,18 +204,49 @@
  * 
  * @param file The input file to preprocess.
  * @param temp The temporary file to write the preprocessed content to.
+ * @param map Receives the origin of every preprocessed line (--line-map), or NULL.
+ */
+void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr, SourceMap* map) {
+    SymbolList* macros = NULL;           /* Linked list to store macros */
+    IncludeList* included = NULL;        /* Files included by the input */
+    TraceSpan span;                      /* Span of the preprocessing (--trace) */
+
+    trace_begin(&span, "preprocess", NULL);
+    preprocess_source(file, temp, &macros, &included, NULL, map);
+    include_free_list(included);
+
+    *macros_ptr = macros;
+    trace_end(&span);
+}
+
+/**
+ * @brief Preprocesses a source: expands its macros and its `.include` lines.
+ * 
+ * @param file The source to preprocess.
+ * @param temp The stream to write the preprocessed content to.
+ * @param macros_ptr Pointer to the macros list, extended with the source's macros.
+ * @param included Files already spliced into the output, or NULL when `recording`.
+ * @param recording The included file being preprocessed, or NULL for an input.
+ * @param map Receives the origin of every line written, or NULL (always NULL when `recording`).
  */
-void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
+static void preprocess_source(FILE* file, FILE* temp, SymbolList** macros_ptr,
+                              IncludeList** included, IncludeUnit* recording, SourceMap* map) {
     /* Line reading buffers */
     char buffer[BUFFER_SIZE];
     char buffer_copy[BUFFER_SIZE];
 
     /* Macro buffers */
-    char macro_buffer[BUFFER_SIZE * 10]; /* Buffer to store macro content */
+    char macro_buffer[BUFFER_SIZE * 10] = ""; /* Buffer to store macro content */
     char macro_name[10];                 /* Buffer to store macro name */
 
-    SymbolList* macros = NULL;           /* Linked list to store macros */
+    SymbolList* macros = *macros_ptr;    /* Linked list to store macros */
     bool is_reading_macro = false;       /* Flag to indicate if we're reading a macro */
+    char *save;                          /* scan_token state, so preprocessing can run beside the passes */
+    uint32_t source_line = 0;            /* Line of the source being read (--line-map) */
+    bool line_start = true;              /* Whether the next read starts a line (long lines take several reads) */
+    uint32_t spliced;                    /* Lines spliced by an .include (--line-map) */
+    IncludeUnit* unit;                   /* File spliced by an .include */
+    SnapshotMacro shared;                /* Macro of the snapshot (--macros) */
 
     while (1) {
         /* Read a line from the input file */
@@ -35,12 +254,15 @@ void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
             break; /* EOF has been reached, or an error has occurred */
         }
 
+        source_line += line_start;
+        line_start = (*scan_find(buffer, SCAN_NEWLINE) == '\n');
+
         /* Remove the newline character from the end of the string */
-        buffer[strcspn(buffer, "\n")] = '\0';
+        *scan_find(buffer, SCAN_NEWLINE) = '\0';
 
         /* Create a copy of the buffer for processing */
         strcpy(buffer_copy, buffer);
-        char *prefix = strtok(buffer, " "); /* Extract the first token as the command */
+        char *prefix = scan_token(buffer, SCAN_SPACE, &save); /* Extract the first token as the command */
 
         if (prefix == NULL) {
             continue; /* Skip empty lines */
@@ -53,7 +275,7 @@ void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
 
         if (!strcmp(prefix, "mcro")) {
             /* Start of a macro declaration */
-            char *arg = strtok(NULL, " "); /* Extract the macro name */
+            char *arg = scan_token(NULL, SCAN_SPACE, &save); /* Extract the macro name */
             if (arg == NULL) {
                 /* If there is no name provided */
                 fprintf(stderr, "Error: Missing macro name.\n");
@@ -68,8 +290,8 @@ void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
                 continue;
             }
 
-            if (is_symbol_exists(macros, macro_name)) {
-                /* If the macro name is already defined as anotehr macro */
+            if (is_symbol_exists(macros, macro_name) || macro_snapshot_find(macro_name, NULL)) {
+                /* If the macro name is already defined as anotehr macro, here or in the snapshot */
                 error_with_code_only(MACRO_ALREADY_DEFINED);
                 continue;
             }
@@ -95,11 +317,28 @@ void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
             continue;
         }
 
+        if (!strcmp(prefix, INCLUDE_DIRECTIVE)) {
+            /* Splice an included file */
+            spliced = 0;
+            unit = include_directive(save, temp, &macros, included, recording, map ? &spliced : NULL);
+            if (map && unit) source_map_add(map, source_line, unit->name, spliced);
+            continue;
+        }
+
         /* Check if the current line matches a macro name */
         SymbolList* macro_ptr = get_symbol_by_label(macros, prefix);
         if (macro_ptr != NULL) {
             /* If the macro exists, write its content to the .am file */
             fputs(macro_ptr->value.buffer, temp);
+            if (map) source_map_add(map, source_line, macro_ptr->label,
+                                    count_lines(macro_ptr->value.buffer, strlen(macro_ptr->value.buffer)));
+            continue;
+        }
+
+        if (macro_snapshot_find(prefix, &shared)) {
+            /* A macro of the snapshot (--macros), expanded straight from the mapped file */
+            fwrite(shared.body, 1, shared.size, temp);
+            if (map) source_map_add(map, source_line, shared.name, shared.lines);
             continue;
         }
 
@@ -108,6 +347,7 @@ void preprocess(FILE* file, FILE* temp, SymbolList** macros_ptr) {
         skip_leading_spaces(&buffer_copy_ptr); /* Skip leading spaces of macro (as macros usually have indentations!) */
         fputs(buffer_copy_ptr, temp); /* Write the macro copy buffer into the 'temp' file (.am!) */
         fputc('\n', temp); /* Add new line which is removed at the beginning. */
+        if (map) source_map_add(map, source_line, NULL, 1);
     }
 
     /* Free the memory allocated for the macros linked list */
@@ -0,0 +1,216 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../header/scanner.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCANNER_X86 1
+#include <immintrin.h>
+#else
+#define SCANNER_X86 0
+#endif
+
+/**
+ * @brief Scanning routine: finds the first byte in (or, when skipping, not in) the classes.
+ */
+typedef char* (*ScanFunction)(const char *s, unsigned classes, int skip);
+
+static const char class_bytes[SCAN_CLASSES] = {' ', '\t', ',', ':', ';', '"', '\n'}; /* Byte of each class, by bit */
+
+/**
+ * @brief Returns the classes of a byte.
+ *
+ * @param c The byte.
+ * @return Its class bit, or 0 if it belongs to no class.
+ */
+static unsigned byte_class(char c) {
+    int i; /* Loop variable */
+
+    for (i = 0; i < SCAN_CLASSES; i++) {
+        if (c == class_bytes[i]) {
+            return 1u << i;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Scalar scanning routine, one byte at a time.
+ */
+static char* scalar_scan(const char *s, unsigned classes, int skip) {
+    if (skip) {
+        while (*s != '\0' && (byte_class(*s) & classes)) {
+            s++;
+        }
+    } else {
+        while (*s != '\0' && !(byte_class(*s) & classes)) {
+            s++;
+        }
+    }
+
+    return (char *)s;
+}
+
+#if SCANNER_X86
+/**
+ * @brief SSE2 scanning routine, 16 bytes at a time.
+ */
+__attribute__((target("sse2"), no_sanitize_address))
+static char* sse2_scan(const char *s, unsigned classes, int skip) {
+    const char *block = (const char *)((uintptr_t)s & ~(uintptr_t)15); /* Aligned block holding s */
+    unsigned valid = 0xFFFFu << (s - block); /* Bytes of the block at or after s */
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes; /* Current block */
+    __m128i hits; /* Bytes in the classes */
+    unsigned stop; /* Bytes where the scan stops */
+    int i; /* Loop variable */
+
+    while (1) {
+        bytes = _mm_load_si128((const __m128i *)block);
+        hits = zero;
+        for (i = 0; i < SCAN_CLASSES; i++) {
+            if (classes & (1u << i)) {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(class_bytes[i])));
+            }
+        }
+
+        stop = (unsigned)_mm_movemask_epi8(hits);
+        if (skip) {
+            stop = ~stop & 0xFFFFu; /* The terminator is in no class */
+        } else {
+            stop |= (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+        }
+
+        stop &= valid;
+        if (stop != 0) {
+            return (char *)block + __builtin_ctz(stop);
+        }
+
+        block += 16;
+        valid = 0xFFFFu;
+    }
+}
+
+/**
+ * @brief AVX2 scanning routine, 32 bytes at a time.
+ */
+__attribute__((target("avx2"), no_sanitize_address))
+static char* avx2_scan(const char *s, unsigned classes, int skip) {
+    const char *block = (const char *)((uintptr_t)s & ~(uintptr_t)31); /* Aligned block holding s */
+    unsigned valid = 0xFFFFFFFFu << (s - block); /* Bytes of the block at or after s */
+    __m256i zero = _mm256_setzero_si256();
+    __m256i bytes; /* Current block */
+    __m256i hits; /* Bytes in the classes */
+    unsigned stop; /* Bytes where the scan stops */
+    int i; /* Loop variable */
+
+    while (1) {
+        bytes = _mm256_load_si256((const __m256i *)block);
+        hits = zero;
+        for (i = 0; i < SCAN_CLASSES; i++) {
+            if (classes & (1u << i)) {
+                hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(class_bytes[i])));
+            }
+        }
+
+        stop = (unsigned)_mm256_movemask_epi8(hits);
+        if (skip) {
+            stop = ~stop; /* The terminator is in no class */
+        } else {
+            stop |= (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero));
+        }
+
+        stop &= valid;
+        if (stop != 0) {
+            return (char *)block + __builtin_ctz(stop);
+        }
+
+        block += 32;
+        valid = 0xFFFFFFFFu;
+    }
+}
+#endif
+
+/**
+ * @brief Returns the fastest scanning routine the CPU supports.
+ *
+ * @param name Output for the routine's name.
+ * @return The routine.
+ */
+static ScanFunction select_scan(const char **name) {
+#if SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return avx2_scan;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return sse2_scan;
+    }
+#endif
+
+    *name = "scalar";
+    return scalar_scan;
+}
+
+static ScanFunction scan_function = NULL; /* Routine in use, chosen on first use */
+static const char *scan_name = NULL; /* Name of the routine in use */
+
+/**
+ * @brief Returns the routine in use, choosing it on first use.
+ *
+ * @return The routine.
+ */
+static ScanFunction get_scan(void) {
+    ScanFunction scan = __atomic_load_n(&scan_function, __ATOMIC_ACQUIRE);
+    const char *name; /* Name of the chosen routine */
+
+    if (scan == NULL) {
+        /* Every thread picks the same routine, so racing here is harmless */
+        scan = select_scan(&name);
+        __atomic_store_n(&scan_name, name, __ATOMIC_RELAXED);
+        __atomic_store_n(&scan_function, scan, __ATOMIC_RELEASE);
+    }
+
+    return scan;
+}
+
+char* scan_find(const char *s, unsigned classes) {
+    return get_scan()(s, classes, 0);
+}
+
+char* scan_skip(const char *s, unsigned classes) {
+    return get_scan()(s, classes, 1);
+}
+
+char* scan_token(char *s, unsigned delimiters, char **save) {
+    char *end; /* End of the token */
+
+    if (s == NULL) {
+        s = *save;
+    }
+
+    s = scan_skip(s, delimiters); /* Leading delimiters */
+    if (*s == '\0') {
+        *save = s;
+        return NULL;
+    }
+
+    end = scan_find(s, delimiters);
+    if (*end == '\0') {
+        *save = end;
+    } else {
+        *end = '\0';
+        *save = end + 1;
+    }
+
+    return s;
+}
+
+const char* scanner_implementation(void) {
+    get_scan();
+    return __atomic_load_n(&scan_name, __ATOMIC_RELAXED);
+}
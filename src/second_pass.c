@@ -13,6 +13,10 @@
 #include "../header/preprocessing.h"
 #include "../header/errors.h"
 #include "../header/validators.h"
+#include "../header/scanner.h"
+#include "../header/trace.h"
+#include "../header/include.h"
+#include "../header/xref.h"
 #include "../header/second_pass.h" /* Already includes word_list.h */
 
 /**
@@ -95,19 +99,22 @@ int8_t extract_number(char *arg) {
  * @param mode The addressing mode of the operand (e.g., IMMEDIATE_ADRS, DIRECT_ADRS, etc.).
  * @param arg The operand argument as a string (e.g., "#5", "LABEL", "&LABEL").
  * @param labels A linked list of labels defined in the program.
+ * @param index Index of the labels, kept up to date with the external uses added.
  * @param externs A linked list of external labels.
  * @param line The current line number being processed in the source file.
- * @param memory_line The current memory line number in the instruction list.
+ * @param ic The instruction counter, locating the word being generated.
  * @param errors A pointer to the error counter, incremented if an error occurs.
+ * @param load_address The address of the first instruction word.
+ * @param word Output for the extra instruction, or NULL to only validate the operand (--check).
  * 
- * @return A pointer to a `Word` structure representing the extra instruction, or NULL if no extra instruction is needed.
+ * @return true if the operand takes an extra instruction word, false otherwise.
  */
-Word* process_operand(int8_t mode, char *arg, 
-                      SymbolList **symbols_ptr, uint8_t line, 
-                      uint8_t *ic, uint8_t *errors) {
-    Word *extra_instruction = NULL;
+bool process_operand(int8_t mode, char *arg, 
+                     SymbolList **symbols_ptr, SymbolIndex *index, uint32_t line, 
+                     uint8_t *ic, uint8_t *errors, uint16_t load_address, Word **word) {
+    bool extra_instruction = false;
     SymbolList* symbols = *symbols_ptr;
-    SymbolList *ptr = get_symbol_by_label(symbols, arg);
+    SymbolList *ptr = symbol_index_find(index, arg);
 
     switch (mode) {
         case IMMEDIATE_ADRS:
@@ -116,12 +123,15 @@ Word* process_operand(int8_t mode, char *arg,
                 error_with_code(INVALID_IMMEDIATE_VALUE, line, errors);
                 break;
             }
-            extra_instruction = create_word_from_number(extract_number(arg), 1, 0, 0);
+            extra_instruction = true;
+            if (word) {
+                *word = create_word_from_number(extract_number(arg), 1, 0, 0);
+            }
             break;
 
         case DIRECT_ADRS: {
             /* Direct addressing creates a word with the label's memory address */
-            ptr = get_symbol_by_label(symbols, arg);
+            ptr = symbol_index_find(index, arg);
             if (ptr != NULL) {
                 /*
                 printf("%s %i %i\n", arg, ptr->symbol_type, ptr->value.number);
@@ -130,12 +140,19 @@ Word* process_operand(int8_t mode, char *arg,
                     ptr->symbol_type == SYMBOL_INSTRUCTION ||
                     ptr->symbol_type == SYMBOL_ENTRY) {
                     /* Create word with the label's actual memory address */
-                    extra_instruction = create_word_from_number(ptr->value.number, 0, 1, 0);
+                    extra_instruction = true;
+                    if (word) {
+                        *word = create_word_from_number(ptr->value.number, 0, 1, 0);
+                    }
                 }
 
                 if (ptr->symbol_type == SYMBOL_EXTERN){
-                    extra_instruction = create_word_from_number(ptr->value.number, 0, 0, 1); /* External word */
-                    add_symbol_number(&symbols, arg, START_LINE + *ic, SYMBOL_EXTERN);
+                    extra_instruction = true;
+                    if (word) {
+                        *word = create_word_from_number(ptr->value.number, 0, 0, 1); /* External word */
+                        /* The use is only recorded for the .ext file */
+                        symbol_index_add(index, add_symbol_number(&symbols, arg, load_address + *ic, SYMBOL_EXTERN));
+                    }
                 }
             }
             break;
@@ -144,13 +161,16 @@ Word* process_operand(int8_t mode, char *arg,
         case RELATIVE_ADRS: {
             /* Relative addressing creates a word with the relative distance */
             arg++; /* Skip the '&' character */
-            ptr = get_symbol_by_label(symbols, arg);
+            ptr = symbol_index_find(index, arg);
             if (ptr != NULL) {
                 int16_t target_address = ptr->value.number;
-                int16_t current_address = START_LINE + *ic;
+                int16_t current_address = load_address + *ic;
                 int16_t relative_distance = target_address - current_address;
                 
-                extra_instruction = create_word_from_number(relative_distance, 1, 0, 0);
+                extra_instruction = true;
+                if (word) {
+                    *word = create_word_from_number(relative_distance, 1, 0, 0);
+                }
             } else {
                 error_with_code(LABEL_NOT_FOUND, line, errors);
             }
@@ -174,16 +194,23 @@ Word* process_operand(int8_t mode, char *arg,
 
 void second_pass(FILE *preprocessed, SymbolList **symbols_ptr, 
                 WordList **inst_list_ptr, WordList **data_list_ptr, 
-                uint8_t *ic, uint8_t *dc, uint8_t *errors) {
+                uint8_t *ic, uint16_t *dc, uint8_t *errors, DataPool *pool,
+                const AssemblerOptions *options, int *relaxed, XrefEvent **xref,
+                WordSink *sink) {
     /* File-level variables and data structures */
     int i; /* Loop counter for command table traversal */
     SymbolList *symbols = *symbols_ptr; /* Local symbol table reference */
     WordList *inst_list = *inst_list_ptr; /* Local instruction list reference */
     WordList *data_list = *data_list_ptr; /* Local data list reference */
     char buffer[BUFFER_SIZE]; /* Line reading buffer */
+    char *save; /* scan_token state for the current line */
     bool stay_in_line = false; /* Flag to continue processing current line */
-    uint8_t line = 0; /* Current source file line number */
+    uint32_t line = 0; /* Current source file line number */
+    uint32_t map_line = 0; /* Current line, counting long lines once unlike `line` (--line-map) */
+    bool line_start = true; /* Whether the next read starts a line (long lines take several reads) */
     bool is_command = false; /* Flag indicating if current token is a valid command */
+    bool encode = !options->check; /* Whether words are built, or only counted (--check) */
+    SymbolIndex index; /* Labels of the symbol table, for the operands */
 
     /* String processing variables */
     char *current; /* Current position in processing buffer */
@@ -207,6 +234,9 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
     /* Error tracking */
     uint8_t before_errors; /* Error count before processing current command */
 
+    /* Tracing */
+    TraceSpan span; /* Span of the pass (--trace) */
+
     /* Word generation */
     Word* extra_instruction_one; /* Additional word for source operand */
     Word* extra_instruction_two; /* Additional word for destination operand */
@@ -216,23 +246,43 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
     char *metadata; /* Directive data (for .data and .string) */
     Command cmd; /* Current command being processed */
 
+    /* Embedded files */
+    const unsigned char *bytes; /* Bytes embedded by .incbin */
+    size_t size; /* Number of bytes embedded by .incbin */
+    int code; /* Error code of a rejected .incbin */
+
     /* Mode tracking */
     bool src_mode_defined; /* Flag indicating source mode was set */
     bool dest_mode_defined; /* Flag indicating destination mode was set */
 
-    
+    /* Branch relaxation */
+    char relaxed_arg[BUFFER_SIZE + 1]; /* Destination rewritten as "&label" */
+    bool is_relaxed; /* Flag indicating the destination was rewritten */
+    SymbolList *target; /* Symbol of the destination label, when relaxing branches */
+
+    /* Data pooling */
+    int data_directive = 0; /* Index of the current data directive */
+
+    trace_begin(&span, "second_pass", NULL);
+    symbol_index_init(&index, symbols);
     while (1){
         char *command; /* The first token separated by a comma is our actual command. */
         if (stay_in_line){
-            command = strtok(NULL, " ");
+            command = scan_token(NULL, SCAN_SPACE, &save);
             stay_in_line = false;
         } else {
+            if (sink != NULL) {
+                word_sink_flush(sink, &inst_list, &data_list); /* The previous line is encoded */
+            }
+
             if (fgets(buffer, BUFFER_SIZE, preprocessed) == NULL){
                 break; /* EOF has been reached, or an error has occured. */
             }
             
-            buffer[strcspn(buffer, "\n")] = '\0'; /* Remove newline character automatically inserted by fgets */
-            command = strtok(buffer, " "); /* Tokenize the command (e.g, mov, add, stop) */
+            map_line += line_start;
+            line_start = (*scan_find(buffer, SCAN_NEWLINE) == '\n');
+            *scan_find(buffer, SCAN_NEWLINE) = '\0'; /* Remove newline character automatically inserted by fgets */
+            command = scan_token(buffer, SCAN_SPACE, &save); /* Tokenize the command (e.g, mov, add, stop) */
             skip_leading_spaces(&command); /* Skip leading spaces for command */
             line++;
         }
@@ -244,6 +294,10 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
 
         /* If the current token ends in a ':', it means this is a label declaration */
         if (command[strlen(command) - 1] == ':'){
+            if (xref != NULL) {
+                command[strlen(command) - 1] = '\0'; /* The name, without the colon */
+                xref_add(xref, command, map_line, true);
+            }
             stay_in_line = true; /* Skip to the afterwards contents of the current line */
             continue;
         }
@@ -252,11 +306,23 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
             /* Handle directives (e.g., .data, .string) */
             command++; /* Skip the '.' character */
 
+            if ((!strcmp(command, "data") || !strcmp(command, "string")) &&
+                pool_is_merged(pool, data_directive++)) {
+                /* The block was merged into an identical earlier copy by the first pass */
+                continue;
+            }
+
+            if (encode && (options->line_map || options->size_report)) {
+                add_line(&data_list, map_line); /* The data words that follow come from this line */
+            }
+
             if (!strcmp(command, "data")) {
                 /* Handle .data directive */
-                metadata = strtok(NULL, "");
+                metadata = scan_token(NULL, 0, &save);
                 if (metadata == NULL) {
                     error_with_code(MISSING_DATA, line, errors);
+                    symbol_index_free(&index);
+                    trace_end(&span);
                     return;
                 }
 
@@ -267,9 +333,7 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                     number_start = current; /* Mark the start of the number */
 
                     /* Find the end of the current number */
-                    while (*current != ',' && *current != '\0') {
-                        current++;
-                    }
+                    current = scan_find(current, SCAN_COMMA);
 
                     /* Null-terminate the current number */
                     temp = *current;
@@ -281,8 +345,10 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                         break;
                     }
 
-                    instruction = create_word_from_only_number((int8_t)atoi(number_start));
-                    add_word(&data_list, instruction); /* Add the instruction to the data list */
+                    if (encode) {
+                        instruction = create_word_from_only_number((int8_t)atoi(number_start));
+                        add_word(&data_list, instruction); /* Add the instruction to the data list */
+                    }
                     (*dc)++;
 
                     /* Restore the character and move to the next number */
@@ -293,9 +359,11 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                 }
             } else if (!strcmp(command, "string")) {
                 /* Handle .string directive */
-                metadata = strtok(NULL, "");
+                metadata = scan_token(NULL, 0, &save);
                 if (metadata == NULL) {
                     error_with_code(MISSING_DATA, line, errors);
+                    symbol_index_free(&index);
+                    trace_end(&span);
                     return;
                 }
 
@@ -305,27 +373,59 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                 } else {
                     metadata++; /* Skip the opening double quote */
                     while (*metadata != '"' && *metadata != '\0') {
-                        instruction = create_word_from_only_number((int8_t)(*metadata));
-                        add_word(&data_list, instruction); /* Add the instruction to the data list */
+                        if (encode) {
+                            instruction = create_word_from_only_number((int8_t)(*metadata));
+                            add_word(&data_list, instruction); /* Add the instruction to the data list */
+                        }
                         metadata++;
                         (*dc)++;
                     }
 
                     /* Add null terminator */
-                    instruction = create_word_from_only_number(0);
-                    add_word(&data_list, instruction); /* Add the null terminator to the data list */
+                    if (encode) {
+                        instruction = create_word_from_only_number(0);
+                        add_word(&data_list, instruction); /* Add the null terminator to the data list */
+                    }
                     (*dc)++;
                 }
+            } else if (!strcmp(command, "space")) {
+                /* Handle .space directive, stored as a single run of zero words */
+                metadata = scan_token(NULL, SCAN_BLANK, &save);
+                if (!is_valid_space_size(metadata) || scan_token(NULL, SCAN_BLANK, &save) != NULL) {
+                    error_with_code(INVALID_SPACE_SIZE, line, errors);
+                } else {
+                    if (encode) {
+                        add_fill(&data_list, (uint16_t)atoi(metadata)); /* Zero-filled when the list is written */
+                    }
+                    *dc += atoi(metadata);
+                }
+            } else if (!strcmp(command, "incbin")) {
+                /* Handle .incbin directive, the bytes stay in the included file until written */
+                metadata = scan_token(NULL, 0, &save);
+                if (metadata == NULL || !include_binary(metadata, &bytes, &size, &code)) {
+                    error_with_code(metadata == NULL ? INVALID_INCBIN : code, line, errors);
+                } else {
+                    if (encode && !add_binary(&data_list, bytes, size)) {
+                        error_with_code(TOO_MANY_INCBINS, line, errors);
+                    }
+                    *dc += (size + WORD_BYTES - 1) / WORD_BYTES;
+                }
+            } else if (xref != NULL && (!strcmp(command, "extern") || !strcmp(command, "entry"))) {
+                /* An .extern declares the symbol, an .entry refers to it */
+                metadata = scan_token(NULL, SCAN_BLANK, &save);
+                if (metadata != NULL) {
+                    xref_add(xref, metadata, map_line, !strcmp(command, "extern"));
+                }
             }
 
             continue;
         }
 
-        arg1 = strtok(NULL, ","); /* Tokenize 1st argument */
+        arg1 = scan_token(NULL, SCAN_COMMA, &save); /* Tokenize 1st argument */
         skip_leading_spaces(&arg1); /* Skip leading spaces of the arg1 argument (e.g, from __r0 -> r0 ) */
-        arg2 = strtok(NULL, ","); /* Tokenize 2nd argument */
+        arg2 = scan_token(NULL, SCAN_COMMA, &save); /* Tokenize 2nd argument */
         skip_leading_spaces(&arg2); /* Skip leading spaces of the arg2 argument (e.g, from ___#5 -> #5 ) */
-        arg3 = strtok(NULL, ","); /* Extraneous tokenized argument, mainly for extraneous text checking */
+        arg3 = scan_token(NULL, SCAN_COMMA, &save); /* Extraneous tokenized argument, mainly for extraneous text checking */
 
         /* printf("%s %s %s\n", command, arg1, arg2); */
 
@@ -420,6 +520,8 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                         break;
                     default:
                         printf("Command %s contains too many operands.", cmd.name);
+                        symbol_index_free(&index);
+                        trace_end(&span);
                         return;
                 }
 
@@ -450,14 +552,42 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                 if (src_mode == -1){ src_mode = 0; }
                 if (dest_mode == -1){ dest_mode = 0; }
 
-                instruction = create_word(
-                    opcode, src_mode, src_reg, 
-                    dest_mode, dest_reg,
-                    funct, 1, 0, 0
-                ); /* Create instruction (absolute, for main instructions) */
+                /* Record the labels used by the operands (--xref) */
+                if (xref != NULL && src_mode_defined &&
+                    (src_mode == DIRECT_ADRS || src_mode == RELATIVE_ADRS)) {
+                    xref_add(xref, arg1 + (src_mode == RELATIVE_ADRS), map_line, false);
+                }
+                if (xref != NULL && dest_mode_defined &&
+                    (dest_mode == DIRECT_ADRS || dest_mode == RELATIVE_ADRS)) {
+                    arg = (cmd.operands_num == 2) ? arg2 : arg1; /* The destination argument */
+                    xref_add(xref, arg + (dest_mode == RELATIVE_ADRS), map_line, false);
+                }
+
+                /* Relax a direct branch to a local code label into its relative form */
+                arg = (cmd.operands_num == 2) ? arg2 : arg1; /* The destination argument */
+                target = options->relax_branches ? symbol_index_find(&index, arg) : NULL;
+                is_relaxed = target != NULL && target->symbol_type == SYMBOL_INSTRUCTION &&
+                             dest_mode == DIRECT_ADRS && cmd.addressing_dest[RELATIVE_ADRS];
+                if (is_relaxed) {
+                    relaxed_arg[0] = '&';
+                    strcpy(relaxed_arg + 1, arg);
+                    dest_mode = RELATIVE_ADRS; /* Absolute displacement, no relocation needed */
+                    (*relaxed)++;
+                }
+
+                if (encode && (options->line_map || options->size_report)) {
+                    add_line(&inst_list, map_line); /* The instruction words that follow come from this line */
+                }
 
                 (*ic)++;
-                add_word(&inst_list, instruction); /* Add the instruction to the instruction list */
+                if (encode) {
+                    instruction = create_word(
+                        opcode, src_mode, src_reg, 
+                        dest_mode, dest_reg,
+                        funct, 1, 0, 0
+                    ); /* Create instruction (absolute, for main instructions) */
+                    add_word(&inst_list, instruction); /* Add the instruction to the instruction list */
+                }
 
                 if (cmd.operands_num == 2) {
                     /*
@@ -467,25 +597,28 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
                 
                     /* Process the source operand */
                     arg = arg1; /* The source argument */
-                    extra_instruction_one = process_operand(src_mode_defined ? src_mode : -1, arg, 
-                                                            &symbols, line, ic, errors);
-                }
-                
-                if (extra_instruction_one != NULL){
-                    /* If there is an extra instruction, we will output it to .ob file */
-                    (*ic)++;
-                    add_word(&inst_list, extra_instruction_one); /* Add the instruction to the instruction list */
+                    if (process_operand(src_mode_defined ? src_mode : -1, arg, 
+                                        &symbols, &index, line, ic, errors,
+                                        options->load_address, encode ? &extra_instruction_one : NULL)) {
+                        /* If there is an extra instruction, we will output it to .ob file */
+                        (*ic)++;
+                        if (encode) {
+                            add_word(&inst_list, extra_instruction_one); /* Add the instruction to the instruction list */
+                        }
+                    }
                 }
 
                 
                 /* Process the destination operand */
-                arg = (cmd.operands_num == 2) ? arg2 : arg1; /* The destination argument */
-                extra_instruction_two = process_operand(dest_mode_defined ? dest_mode : -1, arg,
-                                                        &symbols, line, ic, errors);
-                if (extra_instruction_two != NULL){
+                arg = is_relaxed ? relaxed_arg : ((cmd.operands_num == 2) ? arg2 : arg1); /* The destination argument */
+                if (process_operand(dest_mode_defined ? dest_mode : -1, arg,
+                                    &symbols, &index, line, ic, errors,
+                                    options->load_address, encode ? &extra_instruction_two : NULL)) {
                     /* If there is an extra instruction, we will output it to .ob file */
                     (*ic)++;
-                    add_word(&inst_list, extra_instruction_two); /* Add the instruction to the instruction list */
+                    if (encode) {
+                        add_word(&inst_list, extra_instruction_two); /* Add the instruction to the instruction list */
+                    }
                 }
 
                 break;
@@ -499,8 +632,11 @@ void second_pass(FILE *preprocessed, SymbolList **symbols_ptr,
         }
     }
 
+    symbol_index_free(&index);
+
     /* Update the pointers to the linked lists */
     *symbols_ptr = symbols;
     *inst_list_ptr = inst_list;
     *data_list_ptr = data_list;
+    trace_end(&span);
 }
\ No newline at end of file
@@ -0,0 +1,412 @@
+#define _POSIX_C_SOURCE 200809L /* getline, open_memstream, fmemopen, fdopen, sockets */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../header/server.h"
+#include "../header/assembler.h"
+#include "../header/errors.h"
+#include "../header/output.h"
+#include "../header/scanner.h"
+#include "../header/trace.h"
+#include "../header/include.h"
+
+/**
+ * @brief State shared by the clients and the workers.
+ */
+static struct {
+    pthread_mutex_t lock;              /* Guards every field below */
+    pthread_cond_t changed;            /* Signaled whenever a field below changes */
+    ServerRequest *head;               /* Oldest queued request */
+    ServerRequest *tail;               /* Newest queued request */
+    bool stopping;                     /* Set once no request will be queued anymore */
+    pthread_t workers[MAX_JOBS];       /* Worker threads */
+    int count;                         /* Number of worker threads */
+    const AssemblerOptions *options;   /* Modes selected on the command line */
+} server = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, false, {0}, 0, NULL};
+
+/**
+ * @brief Sends an answer to a client, as one frame.
+ *
+ * @param client The client.
+ * @param id The ID of the request.
+ * @param status "ok", "failed" or "invalid".
+ * @param text The diagnostics and reports of the request.
+ * @param size The size of `text`.
+ */
+static void answer(ServerClient *client, const char *id, const char *status,
+                   const char *text, size_t size) {
+    pthread_mutex_lock(&client->lock);
+    fprintf(client->out, "%s %s %lu\n", id, status, (unsigned long)size);
+    fwrite(text, 1, size, client->out);
+    fflush(client->out);
+    pthread_mutex_unlock(&client->lock);
+}
+
+/**
+ * @brief Answers a request that could not be understood.
+ *
+ * @param client The client.
+ * @param id The ID of the request, or "-" if it has none.
+ * @param message The reason, ending with a newline.
+ */
+static void reject(ServerClient *client, const char *id, const char *message) {
+    answer(client, id, "invalid", message, strlen(message));
+}
+
+/**
+ * @brief Assembles a request and answers it.
+ *
+ * @param request The request.
+ */
+static void assemble_request(ServerRequest *request) {
+    AssemblerOptions options = *server.options; /* Modes of the request */
+    char *log_buffer = NULL; /* Diagnostics and reports of the request */
+    size_t log_size = 0; /* Size of log_buffer */
+    FILE *log = open_memstream(&log_buffer, &log_size);
+    FILE *file; /* The source */
+    bool ok = false; /* Whether the outputs were written */
+    TraceSpan span; /* Span of the request (--trace) */
+
+    if (!log) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    trace_begin(&span, "request", request->name);
+    options.log = log;
+    options.output_dir = request->output_dir;
+    options.pipeline = false; /* The workers already overlap requests */
+    set_thread_error_stream(log);
+    include_refresh(); /* Included files may have changed since the last request */
+
+    if (request->source != NULL) {
+        /* fmemopen rejects empty buffers, the terminator stands for an empty source */
+        file = fmemopen(request->source, request->size > 0 ? request->size : 1, "r");
+    } else {
+        file = fopen(request->path, "r");
+    }
+
+    if (!file) {
+        fprintf(log, "Error opening input file: %s\n", request->source ? request->name : request->path);
+    } else {
+        ok = assemble(file, NULL, request->name, &options);
+        fclose(file);
+    }
+
+    set_thread_error_stream(NULL);
+    fclose(log);
+    answer(request->client, request->id, ok ? "ok" : "failed", log_buffer, log_size);
+    free(log_buffer);
+    trace_end(&span);
+}
+
+/**
+ * @brief Worker thread: assembles queued requests until the server stops.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void* run_worker(void *arg) {
+    ServerRequest *request; /* Request taken from the queue */
+    ServerClient *client; /* Client of the request */
+
+    (void)arg;
+    pthread_mutex_lock(&server.lock);
+    while (1) {
+        while (server.head == NULL && !server.stopping) {
+            pthread_cond_wait(&server.changed, &server.lock);
+        }
+
+        if (server.head == NULL) {
+            break; /* Stopping, and nothing left to assemble */
+        }
+
+        request = server.head;
+        server.head = request->next;
+        if (server.head == NULL) {
+            server.tail = NULL;
+        }
+        pthread_mutex_unlock(&server.lock);
+
+        assemble_request(request);
+        client = request->client;
+        free(request->source);
+        free(request);
+
+        pthread_mutex_lock(&client->lock);
+        if (--client->pending == 0) {
+            pthread_cond_broadcast(&client->idle);
+        }
+        pthread_mutex_unlock(&client->lock);
+
+        pthread_mutex_lock(&server.lock);
+    }
+
+    pthread_mutex_unlock(&server.lock);
+    return NULL;
+}
+
+/**
+ * @brief Queues a request for the workers.
+ *
+ * @param request The request.
+ */
+static void queue_request(ServerRequest *request) {
+    pthread_mutex_lock(&request->client->lock);
+    request->client->pending++;
+    pthread_mutex_unlock(&request->client->lock);
+
+    pthread_mutex_lock(&server.lock);
+    request->next = NULL;
+    if (server.tail) {
+        server.tail->next = request;
+    } else {
+        server.head = request;
+    }
+    server.tail = request;
+    pthread_cond_signal(&server.changed);
+    pthread_mutex_unlock(&server.lock);
+}
+
+/**
+ * @brief Reads a request line (and its source, if sent) and queues it.
+ *
+ * @param client The client.
+ * @param line The request line, without its newline.
+ * @return false if the client's stream cannot be read any further, true otherwise.
+ */
+static bool read_request(ServerClient *client, const char *line) {
+    char fields[6][SERVER_FIELD_SIZE]; /* ID, kind, name, path or size, directory, extraneous field */
+    ServerRequest *request; /* The request */
+    size_t length; /* Length of the output directory */
+    char *end; /* End of the parsed size */
+    long size; /* Size of a sent source */
+    int count; /* Number of fields */
+
+    count = sscanf(line, "%255s %255s %255s %255s %255s %255s",
+                   fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+    if (count < 4 || count > 5) {
+        reject(client, count >= 1 ? fields[0] : "-", "Expected: ID FILE NAME PATH [DIR], or ID SOURCE NAME SIZE [DIR]\n");
+        return true;
+    }
+
+    request = (ServerRequest *)calloc(1, sizeof(ServerRequest));
+    if (!request) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    request->client = client;
+    strcpy(request->id, fields[0]);
+    strcpy(request->name, fields[2]);
+    strcpy(request->output_dir, count == 5 ? fields[4] : OUTPUT_DIR);
+    length = strlen(request->output_dir);
+    if (request->output_dir[length - 1] != '/') {
+        strcpy(request->output_dir + length, "/");
+    }
+
+    if (!strcmp(fields[1], "FILE")) {
+        strcpy(request->path, fields[3]);
+    } else if (!strcmp(fields[1], "SOURCE")) {
+        size = strtol(fields[3], &end, 10);
+        if (*end != '\0' || size < 0 || size > SERVER_MAX_SOURCE) {
+            reject(client, request->id, "Invalid source size\n");
+            free(request);
+            return false; /* The source that follows cannot be skipped */
+        }
+
+        request->size = (size_t)size;
+        request->source = (char *)malloc(request->size + 1);
+        if (!request->source) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        if (fread(request->source, 1, request->size, client->in) != request->size) {
+            reject(client, request->id, "Source ended early\n");
+            free(request->source);
+            free(request);
+            return false;
+        }
+        request->source[request->size] = '\0';
+    } else {
+        reject(client, request->id, "Unknown request kind, expected FILE or SOURCE\n");
+        free(request);
+        return true;
+    }
+
+    queue_request(request);
+    return true;
+}
+
+/**
+ * @brief Reads the requests of a client until its stream ends, then waits for their answers.
+ *
+ * @param client The client.
+ */
+static void serve_client(ServerClient *client) {
+    char *line = NULL; /* Current request line */
+    size_t capacity = 0; /* Allocated size of line */
+
+    while (getline(&line, &capacity, client->in) > 0) {
+        *scan_find(line, SCAN_NEWLINE) = '\0';
+        if (line[0] != '\0' && !read_request(client, line)) {
+            break;
+        }
+    }
+    free(line);
+
+    pthread_mutex_lock(&client->lock);
+    while (client->pending > 0) {
+        pthread_cond_wait(&client->idle, &client->lock);
+    }
+    pthread_mutex_unlock(&client->lock);
+}
+
+/**
+ * @brief Initializes a client.
+ *
+ * @param client The client.
+ * @param in Stream of its requests.
+ * @param out Stream of its answers.
+ */
+static void init_client(ServerClient *client, FILE *in, FILE *out) {
+    client->in = in;
+    client->out = out;
+    client->pending = 0;
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_cond_init(&client->idle, NULL);
+}
+
+/**
+ * @brief Client thread of a socket connection.
+ *
+ * @param arg The client, freed when its connection ends.
+ * @return NULL.
+ */
+static void* run_client(void *arg) {
+    ServerClient *client = (ServerClient *)arg;
+
+    serve_client(client);
+    fclose(client->in);
+    fclose(client->out);
+    pthread_mutex_destroy(&client->lock);
+    pthread_cond_destroy(&client->idle);
+    free(client);
+    return NULL;
+}
+
+/**
+ * @brief Accepts connections on a Unix socket, each served by its own client thread.
+ *
+ * @param path The path of the socket.
+ * @return false if the socket could not be opened, true once it stops accepting.
+ */
+static bool serve_socket(const char *path) {
+    struct sockaddr_un address; /* Address of the socket */
+    ServerClient *client; /* Client of a connection */
+    pthread_t thread; /* Thread of a connection */
+    FILE *in; /* Requests of a connection */
+    FILE *out; /* Answers of a connection */
+    int listener; /* Listening socket */
+    int fd; /* Accepted connection */
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Server socket path is too long: %s\n", path);
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path); /* Socket left by an earlier server */
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        perror("Error listening on server socket");
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    signal(SIGPIPE, SIG_IGN); /* A client leaving early must not stop the server */
+    fprintf(stderr, "Serving requests on %s\n", path);
+
+    while (1) {
+        fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error accepting connection");
+            break;
+        }
+
+        in = fdopen(fd, "r");
+        out = in ? fdopen(dup(fd), "w") : NULL;
+        client = out ? (ServerClient *)malloc(sizeof(ServerClient)) : NULL;
+        if (!client) {
+            if (out) fclose(out);
+            if (in) fclose(in); else close(fd);
+            continue;
+        }
+
+        init_client(client, in, out);
+        if (pthread_create(&thread, NULL, run_client, client) != 0) {
+            run_client(client); /* Serve it here rather than drop it */
+        } else {
+            pthread_detach(thread);
+        }
+    }
+
+    close(listener);
+    unlink(path);
+    return true;
+}
+
+bool run_server(const char *address, const AssemblerOptions *options) {
+    ServerClient client; /* stdin/stdout, when serving it */
+    bool served; /* Whether the server ran */
+    int k; /* Loop variable */
+
+    server.options = options;
+    for (k = 0; k < options->server_threads; k++) {
+        if (pthread_create(&server.workers[server.count], NULL, run_worker, NULL) == 0) {
+            server.count++;
+        }
+    }
+
+    if (server.count == 0) {
+        fprintf(stderr, "Error starting server threads\n");
+        return false;
+    }
+
+    if (!strcmp(address, SERVER_STDIO)) {
+        init_client(&client, stdin, stdout);
+        serve_client(&client);
+        pthread_mutex_destroy(&client.lock);
+        pthread_cond_destroy(&client.idle);
+        served = true;
+    } else {
+        served = serve_socket(address);
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.changed);
+    pthread_mutex_unlock(&server.lock);
+
+    for (k = 0; k < server.count; k++) {
+        pthread_join(server.workers[k], NULL);
+    }
+
+    return served;
+}
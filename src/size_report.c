@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/size_report.h"
+#include "../header/data_pool.h" /* WORD_BYTES */
+
+#define NO_ORIGIN ((size_t)-1) /* Origin of a line not looked up yet */
+
+static const char *section_names[SIZE_SECTIONS] = { "code", "data" };
+
+/**
+ * @brief A row of the report, before sorting.
+ */
+typedef struct {
+    const char *name;          /* Label or origin */
+    SizeSection section;       /* Section of the words */
+    unsigned long words;       /* Number of words */
+} SizeEntry;
+
+/**
+ * @brief Writes a CSV field, quoted if it holds a comma or a quote.
+ *
+ * @param csv The CSV output.
+ * @param field The field.
+ */
+static void put_csv_field(FILE *csv, const char *field) {
+    if (strpbrk(field, ",\"\n") == NULL) {
+        fputs(field, csv);
+        return;
+    }
+
+    fputc('"', csv);
+    for (; *field != '\0'; field++) {
+        if (*field == '"') {
+            fputc('"', csv); /* Quotes are doubled */
+        }
+        fputc(*field, csv);
+    }
+    fputc('"', csv);
+}
+
+/**
+ * @brief Orders regions by address, then by name.
+ */
+static int compare_regions(const void *a, const void *b) {
+    const SizeRegion *x = (const SizeRegion *)a;
+    const SizeRegion *y = (const SizeRegion *)b;
+
+    if (x->address != y->address) return x->address < y->address ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * @brief Orders rows by words (largest first), then by section and name.
+ */
+static int compare_entries(const void *a, const void *b) {
+    const SizeEntry *x = (const SizeEntry *)a;
+    const SizeEntry *y = (const SizeEntry *)b;
+
+    if (x->words != y->words) return x->words > y->words ? -1 : 1;
+    if (x->section != y->section) return x->section < y->section ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+void size_report_begin(SizeReport *report, SymbolList *symbols, const SourceMap *sources) {
+    SymbolList *node; /* Symbol iterator */
+    SizeSection section; /* Section of a label */
+    int s; /* Section loop variable */
+
+    report->sources = sources;
+    report->origins = NULL;
+    report->origins_count = 0;
+    report->origins_capacity = 0;
+
+    for (s = 0; s < SIZE_SECTIONS; s++) {
+        report->regions_count[s] = 1; /* "(none)", before the first label */
+        report->totals[s] = 0;
+        report->line[s] = 0;
+        report->origin[s] = NO_ORIGIN;
+    }
+
+    for (node = symbols; node != NULL; node = node->next) {
+        if (node->symbol_type == SYMBOL_INSTRUCTION) report->regions_count[SIZE_CODE]++;
+        if (node->symbol_type == SYMBOL_DATA) report->regions_count[SIZE_DATA]++;
+    }
+
+    for (s = 0; s < SIZE_SECTIONS; s++) {
+        report->regions[s] = (SizeRegion *)malloc(report->regions_count[s] * sizeof(SizeRegion));
+        if (!report->regions[s]) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        report->regions[s][0].name = "(none)";
+        report->regions[s][0].address = 0;
+        report->regions[s][0].words = 0;
+        report->regions_count[s] = 1;
+    }
+
+    for (node = symbols; node != NULL; node = node->next) {
+        if (node->symbol_type != SYMBOL_INSTRUCTION && node->symbol_type != SYMBOL_DATA) {
+            continue;
+        }
+
+        section = node->symbol_type == SYMBOL_INSTRUCTION ? SIZE_CODE : SIZE_DATA;
+        report->regions[section][report->regions_count[section]].name = node->label;
+        report->regions[section][report->regions_count[section]].address = (uint16_t)node->value.number;
+        report->regions[section][report->regions_count[section]].words = 0;
+        report->regions_count[section]++;
+    }
+
+    for (s = 0; s < SIZE_SECTIONS; s++) {
+        qsort(report->regions[s] + 1, report->regions_count[s] - 1, sizeof(SizeRegion), compare_regions);
+    }
+}
+
+/**
+ * @brief Finds the origin of the current line of a section, adding it if it was not seen yet.
+ *
+ * @param report The report.
+ * @param section The section.
+ * @return Index of the origin.
+ */
+static size_t find_origin(SizeReport *report, SizeSection section) {
+    uint32_t source_line; /* Source line of the .am line, unused */
+    const char *origin; /* Macro or included file of the line */
+    SizeOrigin *grown; /* Reallocated origins */
+    size_t i; /* Loop variable */
+
+    source_map_lookup(report->sources, report->line[section], &source_line, &origin);
+    for (i = 0; i < report->origins_count; i++) {
+        if (report->origins[i].origin == origin) {
+            return i;
+        }
+    }
+
+    if (report->origins_count == report->origins_capacity) {
+        report->origins_capacity = report->origins_capacity ? report->origins_capacity * 2 : 16;
+        grown = (SizeOrigin *)realloc(report->origins, report->origins_capacity * sizeof(SizeOrigin));
+        if (!grown) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        report->origins = grown;
+    }
+
+    report->origins[i].origin = origin;
+    report->origins[i].words[SIZE_CODE] = 0;
+    report->origins[i].words[SIZE_DATA] = 0;
+    report->origins_count++;
+    return i;
+}
+
+void size_report_add(SizeReport *report, const WordList *node, uint16_t address, SizeSection section) {
+    SizeRegion *regions = report->regions[section]; /* Regions of the section */
+    size_t low = 0; /* Last region known to start at or before the address */
+    size_t high = report->regions_count[section]; /* First region known to start after it */
+    size_t middle; /* Region compared with the address */
+    unsigned long words; /* Words of the node */
+
+    if (node->kind == LINE_NODE) {
+        report->line[section] = node->data.line;
+        report->origin[section] = NO_ORIGIN; /* Looked up with the line's first word */
+        return;
+    }
+
+    words = node->kind == FILL_NODE ? node->data.fill :
+            node->kind == BINARY_NODE ? (get_binary(node)->size + WORD_BYTES - 1) / WORD_BYTES : 1;
+
+    /* Last region starting at or before the address, "(none)" starts at 0 */
+    while (high - low > 1) {
+        middle = low + (high - low) / 2;
+        if (regions[middle].address <= address) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    regions[low].words += words;
+
+    if (report->origin[section] == NO_ORIGIN) {
+        report->origin[section] = find_origin(report, section);
+    }
+    report->origins[report->origin[section]].words[section] += words;
+    report->totals[section] += words;
+}
+
+void size_report_write(const SizeReport *report, const char *name, FILE *text, FILE *csv) {
+    SizeEntry *labels; /* Label regions holding words */
+    SizeEntry *origins; /* Origins holding words */
+    size_t labels_count = 0; /* Number of label rows */
+    size_t origins_count = 0; /* Number of origin rows */
+    size_t i; /* Loop variable */
+    int s; /* Section loop variable */
+
+    labels = (SizeEntry *)malloc((report->regions_count[SIZE_CODE] + report->regions_count[SIZE_DATA]) * sizeof(SizeEntry));
+    origins = (SizeEntry *)malloc((report->origins_count * SIZE_SECTIONS + 1) * sizeof(SizeEntry));
+    if (!labels || !origins) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (s = 0; s < SIZE_SECTIONS; s++) {
+        for (i = 0; i < report->regions_count[s]; i++) {
+            if (report->regions[s][i].words > 0) {
+                labels[labels_count].name = report->regions[s][i].name;
+                labels[labels_count].section = (SizeSection)s;
+                labels[labels_count++].words = report->regions[s][i].words;
+            }
+        }
+
+        for (i = 0; i < report->origins_count; i++) {
+            if (report->origins[i].words[s] > 0) {
+                origins[origins_count].name = report->origins[i].origin ? report->origins[i].origin : "-";
+                origins[origins_count].section = (SizeSection)s;
+                origins[origins_count++].words = report->origins[i].words[s];
+            }
+        }
+    }
+
+    qsort(labels, labels_count, sizeof(SizeEntry), compare_entries);
+    qsort(origins, origins_count, sizeof(SizeEntry), compare_entries);
+
+    if (text) {
+        fprintf(text, "Size report for %s (%d bytes per word)\n\n", name, WORD_BYTES);
+        fprintf(text, "%-31s %-7s %8s %8s\n", "Section", "", "Words", "Bytes");
+        for (s = 0; s < SIZE_SECTIONS; s++) {
+            fprintf(text, "%-31s %-7s %8lu %8lu\n", section_names[s], "",
+                    report->totals[s], report->totals[s] * WORD_BYTES);
+        }
+        fprintf(text, "%-31s %-7s %8lu %8lu\n", "total", "",
+                report->totals[SIZE_CODE] + report->totals[SIZE_DATA],
+                (report->totals[SIZE_CODE] + report->totals[SIZE_DATA]) * WORD_BYTES);
+
+        fprintf(text, "\n%-31s %-7s %8s %8s\n", "Top labels", "Section", "Words", "Bytes");
+        for (i = 0; i < labels_count && i < SIZE_REPORT_TOP; i++) {
+            fprintf(text, "%-31s %-7s %8lu %8lu\n", labels[i].name, section_names[labels[i].section],
+                    labels[i].words, labels[i].words * WORD_BYTES);
+        }
+
+        fprintf(text, "\n%-31s %-7s %8s %8s\n", "Top macros and included files", "Section", "Words", "Bytes");
+        for (i = 0; i < origins_count && i < SIZE_REPORT_TOP; i++) {
+            fprintf(text, "%-31s %-7s %8lu %8lu\n", origins[i].name, section_names[origins[i].section],
+                    origins[i].words, origins[i].words * WORD_BYTES);
+        }
+    }
+
+    if (csv) {
+        fprintf(csv, "kind,section,name,words,bytes\n");
+        for (s = 0; s < SIZE_SECTIONS; s++) {
+            fprintf(csv, "total,%s,,%lu,%lu\n", section_names[s],
+                    report->totals[s], report->totals[s] * WORD_BYTES);
+        }
+        for (i = 0; i < labels_count; i++) {
+            fprintf(csv, "label,%s,", section_names[labels[i].section]);
+            put_csv_field(csv, labels[i].name);
+            fprintf(csv, ",%lu,%lu\n", labels[i].words, labels[i].words * WORD_BYTES);
+        }
+        for (i = 0; i < origins_count; i++) {
+            fprintf(csv, "origin,%s,", section_names[origins[i].section]);
+            put_csv_field(csv, origins[i].name);
+            fprintf(csv, ",%lu,%lu\n", origins[i].words, origins[i].words * WORD_BYTES);
+        }
+    }
+
+    free(labels);
+    free(origins);
+}
+
+void size_report_free(SizeReport *report) {
+    int s; /* Section loop variable */
+
+    for (s = 0; s < SIZE_SECTIONS; s++) {
+        free(report->regions[s]);
+        report->regions[s] = NULL;
+    }
+
+    free(report->origins);
+    report->origins = NULL;
+}
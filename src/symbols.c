@@ -14,8 +14,9 @@ SymbolList* add_symbol_number(SymbolList **head, const char *label, int16_t numb
         perror("Failed to allocate memory");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_SYMBOL_NODES, sizeof(SymbolList));
 
-    new_node->label = strdup(label);
+    new_node->label = strdup_tracked(label, MEM_LABELS);
     if (!new_node->label) {
         perror("Failed to allocate memory for label");
         free(new_node);
@@ -38,8 +39,9 @@ SymbolList* add_symbol_string(SymbolList **head, const char *label, const char *
         perror("Failed to allocate memory");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_SYMBOL_NODES, sizeof(SymbolList));
 
-    new_node->label = strdup(label);
+    new_node->label = strdup_tracked(label, MEM_LABELS);
     if (!new_node->label) {
         perror("Failed to allocate memory for label");
         free(new_node);
@@ -48,7 +50,7 @@ SymbolList* add_symbol_string(SymbolList **head, const char *label, const char *
 
     new_node->type = STRING_VALUE;
     new_node->symbol_type = symbol_type;  /* Add symbol type */
-    new_node->value.buffer = strdup(buffer);
+    new_node->value.buffer = strdup_tracked(buffer, MEM_MACRO_BODIES);
     if (!new_node->value.buffer) {
         perror("Failed to allocate memory for buffer");
         free(new_node->label);
@@ -123,6 +125,124 @@ bool is_symbol_exists(SymbolList *head, const char *label) {
     return false;
 }
 
+uint32_t hash_label(const char *label) {
+    uint32_t hash = 2166136261UL; /* FNV offset basis */
+
+    for (; *label != '\0'; label++) {
+        hash ^= (unsigned char)*label;
+        hash *= 16777619UL; /* FNV prime */
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Finds the slot of a label, or the free slot it would take.
+ *
+ * @param index The index, with at least one free slot.
+ * @param label The label.
+ * @return The slot.
+ */
+static SymbolList** find_slot(const SymbolIndex *index, const char *label) {
+    size_t mask = index->capacity - 1; /* Slot of a hash */
+    size_t slot = hash_label(label) & mask; /* Slot probed */
+
+    while (index->slots[slot] != NULL && strcmp(index->slots[slot]->label, label)) {
+        slot = (slot + 1) & mask; /* Linear probing */
+    }
+
+    return &index->slots[slot];
+}
+
+/**
+ * @brief Sizes the slots of an index for a number of labels, at most half full.
+ *
+ * @param index The index, whose slots are replaced.
+ * @param labels Number of labels to hold.
+ */
+static void resize_index(SymbolIndex *index, size_t labels) {
+    SymbolList **old_slots = index->slots; /* Slots to move */
+    size_t old_capacity = index->capacity; /* Number of slots to move */
+    size_t i; /* Loop variable */
+
+    index->capacity = 64;
+    while (index->capacity < labels * 2) {
+        index->capacity *= 2;
+    }
+
+    index->slots = (SymbolList **)calloc(index->capacity, sizeof(SymbolList *));
+    if (!index->slots) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            *find_slot(index, old_slots[i]->label) = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+void symbol_index_init(SymbolIndex *index, SymbolList *head) {
+    SymbolList *curr; /* Symbol iterator */
+    SymbolList **slot; /* Slot of the symbol's label */
+    size_t count = 0; /* Number of symbols */
+
+    for (curr = head; curr != NULL; curr = curr->next) {
+        count++;
+    }
+
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    resize_index(index, count);
+
+    /* The head is the newest symbol, so the first one seen of a label is kept */
+    for (curr = head; curr != NULL; curr = curr->next) {
+        if (curr->label == NULL) {
+            continue;
+        }
+
+        slot = find_slot(index, curr->label);
+        if (*slot == NULL) {
+            *slot = curr;
+            index->count++;
+        } else if ((*slot)->symbol_type == SYMBOL_ENTRY && curr->symbol_type != SYMBOL_ENTRY) {
+            *slot = curr; /* The label's definition, whose address its resolved .entry shares */
+        }
+    }
+}
+
+void symbol_index_add(SymbolIndex *index, SymbolList *symbol) {
+    SymbolList **slot; /* Slot of the symbol's label */
+
+    if ((index->count + 1) * 2 > index->capacity) {
+        resize_index(index, index->count + 1);
+    }
+
+    slot = find_slot(index, symbol->label);
+    if (*slot == NULL) {
+        index->count++;
+    }
+    *slot = symbol;
+}
+
+SymbolList* symbol_index_find(const SymbolIndex *index, const char *label) {
+    if (label == NULL) {
+        return NULL;
+    }
+
+    return *find_slot(index, label);
+}
+
+void symbol_index_free(SymbolIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
 /* Add function to count symbols of a specific type */
 int count_symbols_by_type(SymbolList *head, SymbolType symbol_type) {
     int count = 0;
@@ -179,15 +299,18 @@ void free_symbol_list(SymbolList *head) {
         
         /* Free the label string */
         if (current->label != NULL) {
+            mem_track_free(MEM_LABELS, strlen(current->label) + 1);
             free(current->label);
         }
         
         /* If it's a string value, free the buffer */
         if (current->type == STRING_VALUE && current->value.buffer != NULL) {
+            mem_track_free(MEM_MACRO_BODIES, strlen(current->value.buffer) + 1);
             free(current->value.buffer);
         }
         
         /* Free the node itself */
+        mem_track_free(MEM_SYMBOL_NODES, sizeof(SymbolList));
         free(current);
         
         current = next;  /* Move to next node */
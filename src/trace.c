@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../header/trace.h"
+
+static int enabled = 0; /* Whether tracing is on */
+static TraceBuffer *buffers = NULL; /* Registered buffers of all threads */
+static int threads = 0; /* Number of registered buffers */
+static __thread TraceBuffer *own_buffer = NULL; /* Buffer of the calling thread */
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return The time, in microseconds.
+ */
+static double trace_now(void) {
+    struct timespec now; /* Current time */
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Returns the calling thread's buffer, registering it on first use.
+ *
+ * @return The buffer.
+ */
+static TraceBuffer* thread_buffer(void) {
+    TraceBuffer *buffer = own_buffer;
+
+    if (buffer == NULL) {
+        buffer = (TraceBuffer *)calloc(1, sizeof(TraceBuffer));
+        if (!buffer) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        buffer->thread_id = __atomic_add_fetch(&threads, 1, __ATOMIC_RELAXED);
+        buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            /* Another thread registered first, retry on top of it */
+        }
+
+        own_buffer = buffer;
+    }
+
+    return buffer;
+}
+
+void trace_enable(void) {
+    enabled = 1;
+}
+
+void trace_begin(TraceSpan *span, const char *name, const char *detail) {
+    span->name = NULL;
+    if (!enabled) {
+        return;
+    }
+
+    span->name = name;
+    span->detail[0] = '\0';
+    if (detail != NULL) {
+        strncat(span->detail, detail, TRACE_DETAIL_SIZE - 1);
+    }
+    span->start = trace_now();
+}
+
+void trace_end(TraceSpan *span) {
+    TraceBuffer *buffer; /* Buffer of the calling thread */
+    TraceBlock *block; /* Block receiving the event */
+    TraceEvent *event; /* The recorded event */
+
+    if (span->name == NULL) {
+        return; /* Tracing is off, or was off when the span began */
+    }
+
+    buffer = thread_buffer();
+    block = buffer->blocks;
+    if (block == NULL || block->count == TRACE_BLOCK_EVENTS) {
+        block = (TraceBlock *)malloc(sizeof(TraceBlock));
+        if (!block) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+
+        block->count = 0;
+        block->next = buffer->blocks;
+        buffer->blocks = block;
+    }
+
+    event = &block->events[block->count++];
+    event->name = span->name;
+    memcpy(event->detail, span->detail, TRACE_DETAIL_SIZE);
+    event->start = span->start;
+    event->duration = trace_now() - span->start;
+    span->name = NULL;
+}
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ *
+ * @param file The trace file.
+ * @param s The string.
+ */
+static void write_json_string(FILE *file, const char *s) {
+    fputc('"', file);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(file, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool trace_write(const char *path) {
+    FILE *file = fopen(path, "w"); /* The trace file */
+    TraceBuffer *buffer; /* Buffer iterator */
+    TraceBlock *block; /* Block iterator */
+    TraceEvent *event; /* Event being written */
+    bool first = true; /* Whether no event was written yet */
+    int i; /* Loop variable */
+
+    if (!file) {
+        fprintf(stderr, "Error opening trace file for writing: %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next) {
+        for (block = buffer->blocks; block != NULL; block = block->next) {
+            for (i = 0; i < block->count; i++) {
+                event = &block->events[i];
+                fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+                write_json_string(file, event->name);
+                fprintf(file, ",\"cat\":\"assembler\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"detail\":",
+                        buffer->thread_id, event->start, event->duration);
+                write_json_string(file, event->detail);
+                fprintf(file, "}}");
+                first = false;
+            }
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error writing trace file: %s\n", path);
+        return false;
+    }
+
+    return true;
+}
@@ -1,7 +1,10 @@
 #include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../header/validators.h"
 #include "../header/lib.h"
 #include "../header/assembler.h"
+#include "../header/scanner.h"
 
 /**
  * @brief Validates if an argument represents a valid register.
@@ -83,6 +86,15 @@ bool is_valid_number(char *arg) {
     return true; /* Valid number */
 }
 
+bool is_valid_space_size(char *arg) {
+    /* Digits only, so the value cannot be signed or overflow before the bound check */
+    if (arg == NULL || arg[0] == '\0' || strspn(arg, "0123456789") != strlen(arg) || strlen(arg) > 4) {
+        return false;
+    }
+
+    return atoi(arg) >= 1 && atoi(arg) <= MAX_SPACE_SIZE;
+}
+
 /**
  * @brief Validates if an argument represents a valid addressing mode.
  * 
@@ -116,19 +128,11 @@ bool is_valid_mode(char *arg) {
  * @return true if the argument is a valid string, false otherwise.
  */
 bool is_valid_string(char *arg) {
-    int i; /* Loop variable */
-
     /* Ensure the argument is not NULL and starts with a double quote */
     if (arg == NULL || arg[0] != '"') {
         return false;
     }
 
     /* Check for a closing double quote */
-    for (i = 1; arg[i] != '\0'; i++) {
-        if (arg[i] == '"') {
-            return true; /* Valid string */
-        }
-    }
-
-    return false; /* Invalid string */
+    return *scan_find(arg + 1, SCAN_QUOTE) == '"';
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 
 #include "../header/word.h"
+#include "../header/mem_stats.h"
 
 Word* create_word(uint8_t opcode, uint8_t src_mode, uint8_t src_reg,
                   uint8_t dest_mode, uint8_t dest_reg, uint8_t funct,
@@ -12,6 +13,7 @@ Word* create_word(uint8_t opcode, uint8_t src_mode, uint8_t src_reg,
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_WORDS, sizeof(Word));
 
     /* Construct the 24-bit word */
     inst->word = ((uint32_t)opcode << 18) |
@@ -32,6 +34,7 @@ Word* create_word_from_number(int16_t number, uint8_t A, uint8_t R, uint8_t E) {
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_WORDS, sizeof(Word));
 
     /* Ensure 'number' fits within 21 bits */
     uint32_t num21 = (uint32_t)(number & 0x1FFFFF);  /* Mask to 21 bits */
@@ -51,6 +54,7 @@ Word* create_word_from_only_number(int16_t number) {
         perror("Memory allocation failed");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_WORDS, sizeof(Word));
 
     /* Ensure 'number' expands to use all 24 bits */
     uint32_t num24 = (uint32_t)(number) & 0xFFFFFF;  /* Mask to 24 bits */
@@ -62,6 +66,7 @@ Word* create_word_from_only_number(int16_t number) {
 
 void free_word(Word* inst) {
     if (inst != NULL){
+        mem_track_free(MEM_WORDS, sizeof(Word));
         free(inst);
     }
 }
@@ -70,7 +75,7 @@ uint32_t word_to_hex(Word* inst) {
     return inst->word & 0xFFFFFF;
 }
 
-void print_word_hex(Word* inst, uint8_t *line, FILE* file) {
+void print_word_hex(Word* inst, uint16_t *line, FILE* file) {
     fprintf(file, "%07d %06x\n", *line, word_to_hex(inst));
     (*line)++;
 }
\ No newline at end of file
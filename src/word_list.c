@@ -1,8 +1,49 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "../header/word_list.h" /* <stdint.h>, word.h are already included within */
 #include "../header/assembler.h" /* Mainly for constants extraction */
+#include "../header/mem_stats.h"
+
+#define BINARY_BLOCK_SIZE 256 /* Slots per block of the side table */
+
+/**
+ * @brief Side table of the .incbin ranges, shared by every assembly of the process
+ *
+ * Blocks are allocated once and never moved, so a slot can be read without the
+ * lock by the thread that holds its node. A released slot is chained into the
+ * free list through its `size`, storing the next free slot plus one.
+ */
+static struct {
+    pthread_mutex_t lock;                                    /* Guards every field below */
+    BinaryRange *blocks[MAX_BINARIES / BINARY_BLOCK_SIZE];   /* Blocks of slots, allocated on demand */
+    size_t used;                                             /* Slots handed out at least once */
+    size_t released;                                         /* First released slot plus one, 0 if none */
+} binaries = {PTHREAD_MUTEX_INITIALIZER, {NULL}, 0, 0};
+
+/**
+ * @brief Finds a slot of the side table
+ * @param index Index of the slot
+ * @return The slot
+ */
+static BinaryRange* binary_slot(size_t index) {
+    return &binaries.blocks[index / BINARY_BLOCK_SIZE][index % BINARY_BLOCK_SIZE];
+}
+
+/**
+ * @brief Returns a slot to the side table
+ * @param index Index of the slot
+ */
+static void release_binary(uint16_t index) {
+    BinaryRange *slot = binary_slot(index);
+
+    pthread_mutex_lock(&binaries.lock);
+    slot->bytes = NULL;
+    slot->size = binaries.released;
+    binaries.released = (size_t)index + 1;
+    pthread_mutex_unlock(&binaries.lock);
+}
 
 void add_word(WordList **head, Word *word) {
     if (!word) {
@@ -15,26 +56,88 @@ void add_word(WordList **head, Word *word) {
         perror("Failed to allocate memory");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_LIST_NODES, sizeof(WordList));
 
     new_node->data.word = word; /* Store the Word pointer in the union */
-    new_node->is_line = false;  /* Indicate that this node stores a Word */
+    new_node->kind = WORD_NODE; /* Indicate that this node stores a Word */
     new_node->next = *head;     /* Insert at the beginning for O(1) insertion */
     *head = new_node;
 }
 
-void add_line(WordList **head, uint8_t line) {
+void add_line(WordList **head, uint32_t line) {
     WordList *new_node = (WordList *)malloc(sizeof(WordList));
     if (!new_node) {
         perror("Failed to allocate memory");
         exit(EXIT_FAILURE);
     }
+    mem_track_alloc(MEM_LIST_NODES, sizeof(WordList));
 
     new_node->data.line = line; /* Store the line number in the union */
-    new_node->is_line = true;   /* Indicate that this node stores a line */
+    new_node->kind = LINE_NODE; /* Indicate that this node stores a line */
     new_node->next = *head;     /* Insert at the beginning for O(1) insertion */
     *head = new_node;
 }
 
+void add_fill(WordList **head, uint16_t count) {
+    WordList *new_node = (WordList *)malloc(sizeof(WordList));
+    if (!new_node) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    mem_track_alloc(MEM_LIST_NODES, sizeof(WordList));
+
+    new_node->data.fill = count; /* Store the run length in the union */
+    new_node->kind = FILL_NODE;  /* Indicate that this node stores a run of zero words */
+    new_node->next = *head;      /* Insert at the beginning for O(1) insertion */
+    *head = new_node;
+}
+
+bool add_binary(WordList **head, const unsigned char *bytes, size_t size) {
+    WordList *new_node; /* The node */
+    BinaryRange *block; /* Block of slots, when a new one is needed */
+    size_t index; /* Slot of the range */
+
+    pthread_mutex_lock(&binaries.lock);
+    if (binaries.released != 0) {
+        index = binaries.released - 1; /* Reuse the last released slot */
+        binaries.released = binary_slot(index)->size;
+    } else if (binaries.used < MAX_BINARIES) {
+        index = binaries.used++;
+        if (binaries.blocks[index / BINARY_BLOCK_SIZE] == NULL) {
+            block = (BinaryRange *)malloc(BINARY_BLOCK_SIZE * sizeof(BinaryRange));
+            if (!block) {
+                perror("Failed to allocate memory");
+                exit(EXIT_FAILURE);
+            }
+            binaries.blocks[index / BINARY_BLOCK_SIZE] = block;
+        }
+    } else {
+        pthread_mutex_unlock(&binaries.lock);
+        return false; /* Every slot is held */
+    }
+    pthread_mutex_unlock(&binaries.lock);
+
+    binary_slot(index)->bytes = bytes; /* Store the byte range in the side table */
+    binary_slot(index)->size = size;
+
+    new_node = (WordList *)malloc(sizeof(WordList));
+    if (!new_node) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    mem_track_alloc(MEM_LIST_NODES, sizeof(WordList));
+
+    new_node->data.binary = (uint16_t)index; /* Store the slot in the union */
+    new_node->kind = BINARY_NODE;
+    new_node->next = *head;      /* Insert at the beginning for O(1) insertion */
+    *head = new_node;
+    return true;
+}
+
+const BinaryRange* get_binary(const WordList *node) {
+    return binary_slot(node->data.binary);
+}
+
 void reverse_list(WordList **head) {
     WordList *prev = NULL;
     WordList *current = *head;
@@ -48,4 +151,25 @@ void reverse_list(WordList **head) {
     }
 
     *head = prev; /* Update the head pointer */
-}
\ No newline at end of file
+}
+
+void free_word_node(WordList *node) {
+    if (node->kind == WORD_NODE && node->data.word != NULL) {
+        free_word(node->data.word); /* Free the dynamically allocated word */
+    } else if (node->kind == BINARY_NODE) {
+        release_binary(node->data.binary); /* Free the slot of its byte range */
+    }
+
+    mem_track_free(MEM_LIST_NODES, sizeof(WordList));
+    free(node);
+}
+
+void free_word_list(WordList *head) {
+    WordList *next = NULL;
+
+    while (head != NULL) {
+        next = head->next; /* Store the next node */
+        free_word_node(head);
+        head = next;
+    }
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../header/word_sink.h"
+#include "../header/assembler.h"
+#include "../header/data_pool.h" /* WORD_BYTES */
+
+/**
+ * @brief A node waiting in the spill file, with its word when it stores one.
+ */
+typedef struct {
+    WordList node;             /* The node, `next` unused */
+    Word word;                 /* Value of the node's word */
+} SpilledNode;
+
+/**
+ * @brief Writes a word to the .ob file, the flat image and the line table.
+ *
+ * @param word The word.
+ * @param address Address of the word, advanced past it.
+ * @param ob The .ob stream.
+ * @param image The flat image, or NULL when no format was requested.
+ * @param map The line table, or NULL when it was not requested.
+ */
+static void put_word(Word *word, uint16_t *address, FILE *ob, ImageWriter *image, LineMapWriter *map) {
+    if (map) {
+        line_map_put(map, *address);
+    }
+
+    print_word_hex(word, address, ob);
+    if (image) {
+        image_put_word(image, word);
+    }
+}
+
+void write_word_node(WordList *node, uint16_t *address, FILE *ob, ImageWriter *image, LineMapWriter *map) {
+    Word word; /* Word of a reservation or embedded file */
+    const BinaryRange *binary; /* Bytes of an embedded file */
+    const unsigned char *bytes; /* Next bytes of the embedded file */
+    size_t left; /* Bytes of the embedded file not written yet */
+    size_t chunk; /* Bytes packed into the current word */
+    uint16_t i; /* Loop variable */
+
+    if (node->kind == LINE_NODE) {
+        if (map) {
+            line_map_set_line(map, node->data.line);
+        }
+        return;
+    }
+
+    if (node->kind == WORD_NODE) {
+        put_word(node->data.word, address, ob, image, map);
+        return;
+    }
+
+    word.word = 0;
+    if (node->kind == FILL_NODE) {
+        for (i = 0; i < node->data.fill; i++) {
+            put_word(&word, address, ob, image, map);
+        }
+        return;
+    }
+
+    /* Pack 3 bytes per word, most significant first, the last word padded with zeros */
+    binary = get_binary(node);
+    bytes = binary->bytes;
+    for (left = binary->size; left > 0; left -= chunk) {
+        chunk = left < WORD_BYTES ? left : WORD_BYTES;
+        word.word = (uint32_t)bytes[0] << 16 |
+                    (uint32_t)(chunk > 1 ? bytes[1] : 0) << 8 |
+                    (uint32_t)(chunk > 2 ? bytes[2] : 0);
+        bytes += chunk;
+        put_word(&word, address, ob, image, map);
+    }
+}
+
+bool word_sink_begin(WordSink *sink, FILE *ob, LineMapWriter *map, SizeReport *report, uint16_t load_address) {
+    sink->ob = ob;
+    sink->map = map;
+    sink->report = report;
+    sink->address = load_address;
+    sink->binaries = NULL;
+    sink->spill = tmpfile();
+    sink->body = tmpfile();
+    if (!sink->spill || !sink->body) {
+        perror("Error creating temporary word file");
+        word_sink_abort(sink);
+        return false;
+    }
+
+    return true;
+}
+
+void word_sink_flush(WordSink *sink, WordList **inst_list, WordList **data_list) {
+    SpilledNode spilled; /* Record of a data node */
+    WordList *node; /* Node being written */
+    WordList *next; /* Next node */
+
+    /* Instruction words are final, write them in order */
+    reverse_list(inst_list);
+    for (node = *inst_list; node != NULL; node = next) {
+        next = node->next;
+        if (sink->report) {
+            size_report_add(sink->report, node, sink->address, SIZE_CODE);
+        }
+        write_word_node(node, &sink->address, sink->body, NULL, sink->map);
+        free_word_node(node);
+    }
+    *inst_list = NULL;
+
+    /* Data words follow every instruction, keep them aside */
+    reverse_list(data_list);
+    for (node = *data_list; node != NULL; node = next) {
+        next = node->next;
+        spilled.node = *node;
+        if (node->kind == WORD_NODE) {
+            spilled.word = *node->data.word;
+        }
+        fwrite(&spilled, sizeof(SpilledNode), 1, sink->spill);
+        if (node->kind == BINARY_NODE) {
+            node->next = sink->binaries; /* Keeps the slot of its byte range until written */
+            sink->binaries = node;
+        } else {
+            free_word_node(node);
+        }
+    }
+    *data_list = NULL;
+}
+
+void word_sink_end(WordSink *sink, uint8_t ic, uint16_t dc) {
+    SpilledNode spilled; /* Record of a data node */
+    char buffer[4096]; /* Instruction words being copied */
+    size_t read; /* Bytes read in one call */
+    int ic_length = 1; /* Length of the instruction counter (IC) */
+    unsigned digits; /* IC, with its counted digits removed */
+
+    /* Same "IC DC" line as `assemble` writes, now that the section sizes are known */
+    for (digits = ic; digits >= 10; digits /= 10) {
+        ic_length++;
+    }
+    fprintf(sink->ob, "%*d %d\n", 9 - ic_length, ic, dc);
+
+    rewind(sink->body);
+    while ((read = fread(buffer, 1, sizeof(buffer), sink->body)) > 0) {
+        fwrite(buffer, 1, read, sink->ob);
+    }
+
+    rewind(sink->spill);
+    while (fread(&spilled, sizeof(SpilledNode), 1, sink->spill) == 1) {
+        if (spilled.node.kind == WORD_NODE) {
+            spilled.node.data.word = &spilled.word;
+        }
+        if (sink->report) {
+            size_report_add(sink->report, &spilled.node, sink->address, SIZE_DATA);
+        }
+        write_word_node(&spilled.node, &sink->address, sink->ob, NULL, sink->map);
+    }
+
+    word_sink_abort(sink); /* Both temporary files are used up */
+}
+
+void word_sink_abort(WordSink *sink) {
+    if (sink->spill) {
+        fclose(sink->spill);
+        sink->spill = NULL;
+    }
+
+    if (sink->body) {
+        fclose(sink->body);
+        sink->body = NULL;
+    }
+
+    free_word_list(sink->binaries);
+    sink->binaries = NULL;
+}
@@ -0,0 +1,440 @@
+#define _POSIX_C_SOURCE 200809L /* fork, pipes, poll, ftruncate, strsignal */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../header/workers.h"
+#include "../header/include.h"
+
+/**
+ * @brief Diagnostics of an input, waiting for the inputs before it.
+ */
+typedef struct {
+    char *out;                 /* What the input printed on stdout */
+    size_t out_size;           /* Size of `out` */
+    char *err;                 /* What the input printed on stderr, and the loss of its worker */
+    size_t err_size;           /* Size of `err` */
+    bool done;                 /* true once the input was assembled or lost */
+} WorkerReport;
+
+/**
+ * @brief State of the coordinator.
+ */
+static struct {
+    Worker workers[MAX_JOBS];          /* The pool */
+    int count;                         /* Number of workers in the pool */
+    char **inputs;                     /* The input file names */
+    int inputs_count;                  /* The number of input files */
+    int next;                          /* Next input to hand out */
+    int reported;                      /* Number of inputs whose diagnostics were printed */
+    int failed;                        /* Number of inputs whose outputs were not written */
+    WorkerReport *reports;             /* Diagnostics of every input */
+    WorkerTask task;                   /* Assembles an input, in a worker */
+    const AssemblerOptions *options;   /* Modes selected on the command line */
+} pool;
+
+/**
+ * @brief Reads exactly `size` bytes from a descriptor.
+ *
+ * @param fd The descriptor.
+ * @param buffer Output for the bytes.
+ * @param size Number of bytes to read.
+ * @return true if every byte was read, false on end of file or error.
+ */
+static bool read_all(int fd, void *buffer, size_t size) {
+    char *bytes = (char *)buffer; /* Next byte to read */
+    ssize_t count; /* Bytes read by one call */
+
+    while (size > 0) {
+        count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= (size_t)count;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes exactly `size` bytes to a descriptor.
+ *
+ * @param fd The descriptor.
+ * @param buffer The bytes.
+ * @param size Number of bytes to write.
+ * @return true if every byte was written, false on error (e.g., the reader is gone).
+ */
+static bool write_all(int fd, const void *buffer, size_t size) {
+    const char *bytes = (const char *)buffer; /* Next byte to write */
+    ssize_t count; /* Bytes written by one call */
+
+    while (size > 0) {
+        count = write(fd, bytes, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= (size_t)count;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Closes the coordinator's side of a worker.
+ *
+ * @param worker The worker.
+ */
+static void close_worker(Worker *worker) {
+    if (worker->jobs >= 0) close(worker->jobs);
+    if (worker->results >= 0) close(worker->results);
+    if (worker->out) fclose(worker->out);
+    if (worker->err) fclose(worker->err);
+
+    worker->pid = 0;
+    worker->jobs = -1;
+    worker->results = -1;
+    worker->out = NULL;
+    worker->err = NULL;
+    worker->input = -1;
+}
+
+/**
+ * @brief Body of a worker process: assembles the inputs it is handed until its job pipe is closed.
+ *
+ * @param k Index of the worker in the pool.
+ * @param jobs Read end of the job pipe.
+ * @param results Write end of the result pipe.
+ */
+static void run_worker(int k, int jobs, int results) {
+    int input; /* Index of the input to assemble */
+    int reply[2]; /* Index of the input, and whether its outputs were written */
+    int j; /* Loop variable */
+
+    /* Other workers must see the end of their pipes when the coordinator closes them */
+    for (j = 0; j < pool.count; j++) {
+        if (j != k && pool.workers[j].pid != 0) {
+            close_worker(&pool.workers[j]);
+        }
+    }
+
+    dup2(fileno(pool.workers[k].out), STDOUT_FILENO);
+    dup2(fileno(pool.workers[k].err), STDERR_FILENO);
+
+    while (read_all(jobs, &input, sizeof(input))) {
+        fprintf(pool.options->log, "Processing file: %s\n", pool.inputs[input]);
+        fflush(pool.options->log); /* Kept even if the input crashes the worker */
+        reply[0] = input;
+        reply[1] = pool.task(pool.inputs[input], pool.options);
+
+        /* The coordinator reads the temporary files once it has the reply */
+        fflush(stdout);
+        fflush(stderr);
+        if (!write_all(results, reply, sizeof(reply))) {
+            break;
+        }
+    }
+
+    include_free_all();
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Starts a worker process in a slot of the pool.
+ *
+ * @param k Index of the slot.
+ * @return true if the worker was started, false otherwise.
+ */
+static bool start_worker(int k) {
+    Worker *worker = &pool.workers[k]; /* The slot */
+    int jobs[2] = {-1, -1}; /* Job pipe */
+    int results[2] = {-1, -1}; /* Result pipe */
+    pid_t pid = -1; /* The worker */
+
+    worker->out = tmpfile();
+    worker->err = tmpfile();
+    if (worker->out && worker->err && pipe(jobs) == 0 && pipe(results) == 0) {
+        fflush(stdout); /* Nothing buffered may be printed twice */
+        fflush(stderr);
+        pid = fork();
+    }
+
+    if (pid == 0) {
+        close(jobs[1]);
+        close(results[0]);
+        run_worker(k, jobs[0], results[1]);
+    }
+
+    if (jobs[0] >= 0) close(jobs[0]);
+    if (results[1] >= 0) close(results[1]);
+    worker->jobs = jobs[1];
+    worker->results = results[0];
+    worker->input = -1;
+    if (pid < 0) {
+        perror("Error starting worker process");
+        close_worker(worker);
+        return false;
+    }
+
+    worker->pid = pid;
+    return true;
+}
+
+/**
+ * @brief Reads and empties a temporary file receiving a worker's output.
+ *
+ * @param file The temporary file.
+ * @param size Output for the size of the contents.
+ * @return The contents.
+ */
+static char* read_capture(FILE *file, size_t *size) {
+    char *contents; /* What the worker printed */
+
+    rewind(file);
+    contents = read_stream(file, size);
+    if (!contents) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ftruncate(fileno(file), 0) != 0) {
+        perror("Error emptying worker output");
+    }
+    rewind(file);
+    return contents;
+}
+
+/**
+ * @brief Stores the diagnostics of the input a worker finished.
+ *
+ * @param worker The worker.
+ * @param assembled Whether the outputs of the input were written.
+ */
+static void finish_input(Worker *worker, bool assembled) {
+    WorkerReport *report = &pool.reports[worker->input]; /* Diagnostics of the input */
+
+    report->out = read_capture(worker->out, &report->out_size);
+    report->err = read_capture(worker->err, &report->err_size);
+    report->done = true;
+    pool.failed += !assembled;
+    worker->input = -1;
+}
+
+/**
+ * @brief Appends a message to the stderr diagnostics of an input.
+ *
+ * @param report Diagnostics of the input.
+ * @param message The message, ending with a newline.
+ */
+static void append_message(WorkerReport *report, const char *message) {
+    size_t length = strlen(message); /* Length of the message */
+    char *grown = (char *)realloc(report->err, report->err_size + length + 1); /* Diagnostics with the message */
+
+    if (!grown) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(grown + report->err_size, message, length + 1);
+    report->err = grown;
+    report->err_size += length;
+}
+
+/**
+ * @brief Reaps a worker that died, failing the input it was assembling.
+ *
+ * @param worker The worker, closed afterwards.
+ */
+static void lose_worker(Worker *worker) {
+    char message[512]; /* How the worker died */
+    int status = 0; /* Exit status of the worker */
+    int input = worker->input; /* The lost input, -1 if it died while idle */
+
+    close(worker->jobs); /* Lets a worker stuck on its reply exit */
+    worker->jobs = -1;
+    while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    if (input >= 0) {
+        if (WIFSIGNALED(status)) {
+            sprintf(message, "Worker %ld killed by signal %d (%s) while assembling %.256s\n",
+                    (long)worker->pid, WTERMSIG(status), strsignal(WTERMSIG(status)), pool.inputs[input]);
+        } else {
+            sprintf(message, "Worker %ld exited with status %d while assembling %.256s\n",
+                    (long)worker->pid, WEXITSTATUS(status), pool.inputs[input]);
+        }
+
+        finish_input(worker, false); /* Keeps what it printed before dying */
+        append_message(&pool.reports[input], message);
+    }
+
+    close_worker(worker);
+}
+
+/**
+ * @brief Hands the next input to an idle worker, replacing the worker if it died meanwhile.
+ *
+ * @param k Index of the worker.
+ */
+static void hand_out(int k) {
+    Worker *worker = &pool.workers[k]; /* The worker */
+    int input; /* Index of the input */
+
+    while (worker->pid != 0 && pool.next < pool.inputs_count) {
+        input = pool.next;
+        if (write_all(worker->jobs, &input, sizeof(input))) {
+            worker->input = input;
+            pool.next++;
+            return;
+        }
+
+        lose_worker(worker); /* Died while idle: the input was never started */
+        if (!start_worker(k)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Prints the diagnostics of the finished inputs, in input order.
+ */
+static void print_reports(void) {
+    WorkerReport *report; /* Diagnostics of the next input */
+
+    while (pool.reported < pool.inputs_count && pool.reports[pool.reported].done) {
+        report = &pool.reports[pool.reported++];
+        fwrite(report->out, 1, report->out_size, stdout);
+        fwrite(report->err, 1, report->err_size, stderr);
+        free(report->out);
+        free(report->err);
+        report->out = NULL;
+        report->err = NULL;
+    }
+    fflush(stdout);
+}
+
+bool run_workers(char **inputs, int inputs_count, WorkerTask task,
+                 const AssemblerOptions *options, int *failed) {
+    struct pollfd polls[MAX_JOBS]; /* Result pipes of the busy workers */
+    int owners[MAX_JOBS]; /* Worker of each polled pipe */
+    int reply[2]; /* Index of an input, and whether its outputs were written */
+    char message[512]; /* Why an input was not assembled */
+    int started = 0; /* Number of workers started */
+    int busy; /* Number of busy workers */
+    int i; /* Loop variable */
+    int k; /* Worker loop variable */
+
+    memset(&pool, 0, sizeof(pool));
+    pool.count = options->workers < inputs_count ? options->workers : inputs_count;
+    pool.inputs = inputs;
+    pool.inputs_count = inputs_count;
+    pool.task = task;
+    pool.options = options;
+    pool.reports = (WorkerReport *)calloc(inputs_count + 1, sizeof(WorkerReport));
+    if (!pool.reports) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (k = 0; k < pool.count; k++) {
+        pool.workers[k].jobs = -1;
+        pool.workers[k].results = -1;
+        pool.workers[k].input = -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN); /* A worker dying must not stop the coordinator */
+    for (k = 0; k < pool.count; k++) {
+        started += start_worker(k);
+    }
+
+    if (started == 0 && inputs_count > 0) {
+        free(pool.reports);
+        return false;
+    }
+
+    for (k = 0; k < pool.count; k++) {
+        hand_out(k);
+    }
+
+    while (pool.reported < inputs_count) {
+        busy = 0;
+        for (k = 0; k < pool.count; k++) {
+            if (pool.workers[k].input >= 0) {
+                polls[busy].fd = pool.workers[k].results;
+                polls[busy].events = POLLIN;
+                polls[busy].revents = 0;
+                owners[busy++] = k;
+            }
+        }
+
+        if (busy == 0) {
+            break; /* No worker could be restarted */
+        }
+
+        if (poll(polls, busy, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error waiting for workers");
+            break;
+        }
+
+        for (i = 0; i < busy; i++) {
+            if (polls[i].revents == 0) {
+                continue;
+            }
+
+            k = owners[i];
+            if (read_all(pool.workers[k].results, reply, sizeof(reply)) &&
+                reply[0] == pool.workers[k].input) {
+                finish_input(&pool.workers[k], reply[1] != 0);
+            } else {
+                lose_worker(&pool.workers[k]);
+                start_worker(k);
+            }
+            hand_out(k);
+        }
+
+        print_reports();
+    }
+
+    /* Inputs never handed out, if every worker was lost */
+    for (i = 0; i < inputs_count; i++) {
+        if (!pool.reports[i].done) {
+            sprintf(message, "%.256s not assembled: no worker process left\n", inputs[i]);
+            append_message(&pool.reports[i], message);
+            pool.reports[i].done = true;
+            pool.failed++;
+        }
+    }
+    print_reports();
+
+    /* Closing the job pipes stops the workers */
+    for (k = 0; k < pool.count; k++) {
+        if (pool.workers[k].pid != 0) {
+            close(pool.workers[k].jobs);
+            pool.workers[k].jobs = -1;
+            while (waitpid(pool.workers[k].pid, NULL, 0) < 0 && errno == EINTR) {
+            }
+            close_worker(&pool.workers[k]);
+        }
+    }
+
+    *failed += pool.failed;
+    free(pool.reports);
+    return true;
+}
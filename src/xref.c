@@ -0,0 +1,210 @@
+#define _POSIX_C_SOURCE 200809L /* strdup */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header/xref.h"
+
+/**
+ * @brief A symbol of the index, before it is written.
+ */
+typedef struct {
+    const char *name;          /* Symbol name */
+    uint32_t name_offset;      /* Offset of the name in the string table */
+    uint32_t definition;       /* Definition line, 0 if none */
+    uint32_t address;          /* Resolved address, 0 if unknown */
+    uint32_t first_ref;        /* Index of the symbol's first reference */
+    uint32_t ref_count;        /* Number of references */
+    XrefType type;             /* Symbol type */
+    uint8_t flags;             /* XREF_ENTRY */
+} XrefSymbol;
+
+void xref_add(XrefEvent **events, const char *name, uint32_t line, bool definition) {
+    XrefEvent *event = (XrefEvent *)malloc(sizeof(XrefEvent));
+    if (!event) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    event->name = strdup(name);
+    if (!event->name) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    event->line = line;
+    event->definition = definition;
+    event->next = *events; /* Insert at the beginning for O(1) insertion */
+    *events = event;
+}
+
+/**
+ * @brief Orders events by name, then definitions first, then by line.
+ */
+static int compare_events(const void *a, const void *b) {
+    const XrefEvent *x = *(const XrefEvent * const *)a;
+    const XrefEvent *y = *(const XrefEvent * const *)b;
+    int order = strcmp(x->name, y->name);
+
+    if (order != 0) return order;
+    if (x->definition != y->definition) return x->definition ? -1 : 1;
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+/**
+ * @brief Orders symbol table nodes by label.
+ */
+static int compare_symbols(const void *a, const void *b) {
+    return strcmp((*(SymbolList * const *)a)->label, (*(SymbolList * const *)b)->label);
+}
+
+/**
+ * @brief Writes a 32-bit number, least significant byte first.
+ *
+ * @param stream The output.
+ * @param value The number.
+ */
+static void put_u32(FILE *stream, uint32_t value) {
+    fputc((int)(value & 0xFF), stream);
+    fputc((int)((value >> 8) & 0xFF), stream);
+    fputc((int)((value >> 16) & 0xFF), stream);
+    fputc((int)((value >> 24) & 0xFF), stream);
+}
+
+/**
+ * @brief Sets the type, flags and address of an index symbol from the symbol table nodes of its name.
+ *
+ * @param symbol The index symbol.
+ * @param node Symbol table node with the same name.
+ */
+static void apply_symbol(XrefSymbol *symbol, const SymbolList *node) {
+    switch (node->symbol_type) {
+        case SYMBOL_INSTRUCTION:
+            symbol->type = XREF_CODE;
+            symbol->address = (uint32_t)(uint16_t)node->value.number;
+            break;
+        case SYMBOL_DATA:
+            symbol->type = XREF_DATA;
+            symbol->address = (uint32_t)(uint16_t)node->value.number;
+            break;
+        case SYMBOL_EXTERN:
+            symbol->type = XREF_EXTERNAL;
+            break;
+        case SYMBOL_ENTRY:
+            symbol->flags |= XREF_ENTRY;
+            break;
+        default:
+            break;
+    }
+}
+
+void xref_write(FILE *stream, XrefEvent *events, SymbolList *symbols) {
+    XrefEvent **sorted; /* Events by name */
+    SymbolList **table; /* Symbol table nodes by label */
+    XrefSymbol *index; /* Symbols of the index */
+    size_t events_count = 0; /* Number of events */
+    size_t table_count = 0; /* Number of symbol table nodes */
+    size_t count = 0; /* Number of index symbols */
+    uint32_t refs = 0; /* Number of references */
+    uint32_t strings = 0; /* Size of the string table */
+    uint32_t last_line; /* Last reference line of the current symbol, to drop repeats */
+    size_t i, j, k; /* Loop variables */
+    XrefEvent *event; /* Event iterator */
+    SymbolList *node; /* Symbol iterator */
+
+    for (event = events; event != NULL; event = event->next) events_count++;
+    for (node = symbols; node != NULL; node = node->next) table_count++;
+
+    sorted = (XrefEvent **)malloc((events_count + 1) * sizeof(XrefEvent *));
+    table = (SymbolList **)malloc((table_count + 1) * sizeof(SymbolList *));
+    index = (XrefSymbol *)malloc((events_count + 1) * sizeof(XrefSymbol));
+    if (!sorted || !table || !index) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0, event = events; event != NULL; event = event->next) sorted[i++] = event;
+    for (i = 0, node = symbols; node != NULL; node = node->next) table[i++] = node;
+    qsort(sorted, events_count, sizeof(XrefEvent *), compare_events);
+    qsort(table, table_count, sizeof(SymbolList *), compare_symbols);
+
+    /* Group the events by name, walking the sorted symbol table alongside */
+    for (i = 0, k = 0; i < events_count; i = j) {
+        XrefSymbol *symbol = &index[count++];
+
+        symbol->name = sorted[i]->name;
+        symbol->name_offset = strings;
+        symbol->definition = sorted[i]->definition ? sorted[i]->line : 0;
+        symbol->address = 0;
+        symbol->first_ref = refs;
+        symbol->ref_count = 0;
+        symbol->type = XREF_UNKNOWN;
+        symbol->flags = 0;
+        strings += (uint32_t)strlen(symbol->name) + 1;
+
+        last_line = 0;
+        for (j = i; j < events_count && !strcmp(sorted[j]->name, symbol->name); j++) {
+            if (!sorted[j]->definition && sorted[j]->line != last_line) {
+                symbol->ref_count++;
+                last_line = sorted[j]->line;
+            }
+        }
+        refs += symbol->ref_count;
+
+        while (k < table_count && strcmp(table[k]->label, symbol->name) < 0) k++;
+        for (; k < table_count && !strcmp(table[k]->label, symbol->name); k++) {
+            apply_symbol(symbol, table[k]);
+        }
+    }
+
+    /* Header */
+    fwrite(XREF_MAGIC, 1, 4, stream);
+    put_u32(stream, (uint32_t)count);
+    put_u32(stream, refs);
+    put_u32(stream, strings);
+
+    /* Symbols */
+    for (i = 0; i < count; i++) {
+        put_u32(stream, index[i].name_offset);
+        put_u32(stream, index[i].definition);
+        put_u32(stream, index[i].address);
+        put_u32(stream, index[i].first_ref);
+        put_u32(stream, index[i].ref_count);
+        fputc((int)index[i].type, stream);
+        fputc((int)index[i].flags, stream);
+        fputc((int)(strlen(index[i].name) & 0xFF), stream);
+        fputc((int)((strlen(index[i].name) >> 8) & 0xFF), stream);
+    }
+
+    /* References, in the order of the symbols */
+    for (i = 0; i < events_count; i = j) {
+        last_line = 0;
+        for (j = i; j < events_count && !strcmp(sorted[j]->name, sorted[i]->name); j++) {
+            if (!sorted[j]->definition && sorted[j]->line != last_line) {
+                put_u32(stream, sorted[j]->line);
+                last_line = sorted[j]->line;
+            }
+        }
+    }
+
+    /* String table */
+    for (i = 0; i < count; i++) {
+        fwrite(index[i].name, 1, strlen(index[i].name) + 1, stream);
+    }
+
+    free(sorted);
+    free(table);
+    free(index);
+}
+
+void xref_free(XrefEvent *events) {
+    XrefEvent *next; /* Next event to free */
+
+    while (events != NULL) {
+        next = events->next;
+        free(events->name);
+        free(events);
+        events = next;
+    }
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Runs the assembler twice with --cache and --write-if-changed, and checks that
+# the cache hit of the second run leaves the identical outputs untouched.
+#
+# Usage: tests/cache_write_if_changed.sh ASSEMBLER
+
+ASSEMBLER=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+INPUTS=$(cd "$(dirname "$0")/../inputs" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir "$WORK/run" "$WORK/outputs"
+ln -s "$INPUTS" "$WORK/inputs"
+cd "$WORK/run" || exit 1
+
+"$ASSEMBLER" --cache "$WORK/cache" --write-if-changed w1 > first.log 2>&1 || {
+    echo "FAIL: first run"; cat first.log; exit 1
+}
+before=$(cd ../outputs && ls | sort | while read -r f; do stat -c '%n %y' "$f"; done)
+sleep 1
+
+"$ASSEMBLER" --cache "$WORK/cache" --write-if-changed w1 > second.log 2>&1 || {
+    echo "FAIL: second run"; cat second.log; exit 1
+}
+grep -q "Cache: 1 hit(s)" second.log || {
+    echo "FAIL: second run missed the cache"; cat second.log; exit 1
+}
+after=$(cd ../outputs && ls | sort | while read -r f; do stat -c '%n %y' "$f"; done)
+
+if [ "$before" != "$after" ]; then
+    echo "FAIL: outputs were touched by the cache hit"
+    echo "before:"; echo "$before"
+    echo "after:"; echo "$after"
+    exit 1
+fi
+
+echo "PASS: cache hit keeps the modification times of identical outputs"